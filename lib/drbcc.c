@@ -44,6 +44,7 @@
 #include "drbcc.h"
 #include "drbcc_trace.h"
 #include "drbcc_utils.h"
+#include "drbcc_alloc.h"
 
 #ifdef HAVE_LIBDRTRACE
 #else
@@ -72,6 +73,18 @@ uint16_t libdrbcc_crc_ccitt_update(uint16_t crc, uint8_t data)
 		^ ((uint16_t)data << 3));
 }
 
+uint32_t libdrbcc_fnv1a_update(uint32_t hash, const uint8_t *data, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
 void libdrbcc_add_msg_prio(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 {
 	DRBCC_MESSAGE_t *next;
@@ -114,6 +127,32 @@ void libdrbcc_add_msg_sec(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 	msg->next = NULL;
 }
 
+// last message of the 2nd queue, NULL: queue empty
+DRBCC_MESSAGE_t *libdrbcc_last_msg_sec(DRBCC_t *drbcc)
+{
+	DRBCC_MESSAGE_t *last = drbcc->secQueue;
+
+	while (last && last->next)
+	{
+		last = last->next;
+	}
+	return last;
+}
+
+// drop the messages queued behind mark (NULL: all), queued messages are not sent yet
+void libdrbcc_drop_msg_sec(DRBCC_t *drbcc, DRBCC_MESSAGE_t *mark)
+{
+	DRBCC_MESSAGE_t **next = mark ? (DRBCC_MESSAGE_t **) &mark->next : &drbcc->secQueue;
+
+	while (*next)
+	{
+		DRBCC_MESSAGE_t *msg = *next;
+
+		*next = msg->next;
+		free(msg);
+	}
+}
+
 static void libdrbcc_proc_ack_msg(DRBCC_t *drbcc)
 {
 	switch(drbcc->repeatMsg->msg[0] & ~TOGGLE_BITMASK)
@@ -128,6 +167,12 @@ static void libdrbcc_proc_ack_msg(DRBCC_t *drbcc)
 				drbcc->wait_for_first_sync_ack = 0;
 				return;
 			}
+			if (drbcc->state == DRBCC_STATE_FW_UPDATE)
+			{
+				// new firmware answers, see libdrbcc_update_poll
+				libdrbcc_update_event(drbcc, DRBCC_SYNC);
+				return;
+			}
 		} // NO break here! we have to close the session
 	case DRBCC_REQ_DEBUG_SET:
 	case DRBCC_REQ_HEARTBEAT:
@@ -263,6 +308,7 @@ static DRBCC_RC_t libdrbcc_proc_msg(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 	case DRBCC_IND_EXTFLASH_ID:// <mid> <mid> <devid1> <devid2>
 		if (msg->msg_len >= 4)
 		{
+			libdrbcc_set_flash_geometry(drbcc, msg->msg[1], msg->msg[2], msg->msg[3]);
 			TRACE(DRBCC_TR_MSGS, "Try to call flash id callback");
 			if (drbcc->flash_id_cb)
 			{
@@ -288,7 +334,7 @@ static DRBCC_RC_t libdrbcc_proc_msg(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 		{
 			unsigned addr = (msg->msg[1] << 16) | (msg->msg[2] << 8) | msg->msg[3];
 			TRACE(DRBCC_TR_MSGS,  "Try to call read flash callback");
-			if (drbcc->read_flash_cb)
+			if (drbcc->read_flash_cb && (drbcc->state != DRBCC_STATE_READ_INTO))
 			{
 				drbcc->read_flash_cb(drbcc->context, addr, msg->msg[4], &(msg->msg[5]));
 				if (drbcc->flashLen)
@@ -440,7 +486,11 @@ static DRBCC_RC_t libdrbcc_proc_msg(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 			char s[] = "BCTRL firmware successfully invalidated";
 			drbcc->error_cb(drbcc->context, s);
 		}
-		if ((0 != drbcc->session) && drbcc->session_cb)
+		if (drbcc->state == DRBCC_STATE_FW_UPDATE)
+		{
+			libdrbcc_update_event(drbcc, msg->msg[0] & ~TOGGLE_BITMASK);
+		}
+		else if ((0 != drbcc->session) && drbcc->session_cb)
 		{
 			drbcc->session_cb(drbcc->context, drbcc->session, 1);
 			drbcc->session = 0;
@@ -452,7 +502,11 @@ static DRBCC_RC_t libdrbcc_proc_msg(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 			char s[] = "BCTRL restart successfully initiated";
 			drbcc->error_cb(drbcc->context, s);
 		}
-		if ((0 != drbcc->session) && drbcc->session_cb)
+		if (drbcc->state == DRBCC_STATE_FW_UPDATE)
+		{
+			libdrbcc_update_event(drbcc, msg->msg[0] & ~TOGGLE_BITMASK);
+		}
+		else if ((0 != drbcc->session) && drbcc->session_cb)
 		{
 			drbcc->session_cb(drbcc->context, drbcc->session, 1);
 			drbcc->session = 0;
@@ -464,6 +518,10 @@ static DRBCC_RC_t libdrbcc_proc_msg(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg)
 			char s[] = "BCTRL firmware update successfully started";
 			drbcc->error_cb(drbcc->context, s);
 		}
+		if (drbcc->state == DRBCC_STATE_FW_UPDATE)
+		{
+			libdrbcc_update_event(drbcc, DRBCC_IND_FW_UPDATE_STARTED);
+		}
 		break;
 	case DRBCC_IND_BL_UPDATE:
 		if (drbcc->error_cb)
@@ -926,12 +984,20 @@ static DRBCC_RC_t libdrbcc_receive(DRBCC_t *drbcc)
 							char s[] = "TOGGLE_BIT ERROR";
 							drbcc->error_cb(drbcc->context, s);
 						}
-						if ((0 != drbcc->session) && drbcc->session_cb)
+						if (!libdrbcc_update_error(drbcc, "toggle bit error"))
 						{
-							drbcc->session_cb(drbcc->context, drbcc->session, 0);
-							drbcc->session = 0;
+							if (drbcc->logMirror)
+							{
+								// drbcc_log_mirror_sync: store the mirror header and unlock the file
+								libdrbcc_log_mirror_end(drbcc, 0);
+							}
+							if ((0 != drbcc->session) && drbcc->session_cb)
+							{
+								drbcc->session_cb(drbcc->context, drbcc->session, 0);
+								drbcc->session = 0;
+							}
+							drbcc->state = DRBCC_STATE_USER;
 						}
-						drbcc->state = DRBCC_STATE_USER;
 					}
 					if (drbcc->sync_mode)
 					{
@@ -1037,7 +1103,21 @@ DRBCC_RC_t drbcc_trigger(DRBCC_HANDLE_t h, int maxLoops)
 					char s[] = "ERROR: Sending failed after repeat counter reached maximum";
 					drbcc->error_cb(drbcc->context, s);
 				}
-				if ((0 != drbcc->session) && drbcc->session_cb)
+				if (libdrbcc_update_error(drbcc, "sending failed"))
+				{
+					// handled by drbcc_update_firmware
+				}
+				else if (drbcc->logMirror)
+				{
+					// drbcc_log_mirror_sync: store the mirror header and unlock the file
+					libdrbcc_log_mirror_end(drbcc, 0);
+					if ((0 != drbcc->session) && drbcc->session_cb)
+					{
+						drbcc->session_cb(drbcc->context, drbcc->session, 0);
+					}
+					drbcc->session = 0;
+				}
+				else if ((0 != drbcc->session) && drbcc->session_cb)
 				{
 					drbcc->session_cb(drbcc->context, drbcc->session, 1);
 					drbcc->session = 0;
@@ -1049,6 +1129,15 @@ DRBCC_RC_t drbcc_trigger(DRBCC_HANDLE_t h, int maxLoops)
 			}
 		}
 
+		if (drbcc->state == DRBCC_STATE_FW_UPDATE)
+		{
+			libdrbcc_update_poll(drbcc, &now);
+		}
+		else if ((drbcc->state == DRBCC_STATE_GET_LOG) && drbcc->logFollow)
+		{
+			libdrbcc_log_follow_poll(drbcc, &now);
+		}
+
 		if (!drbcc->wait_for_ack && !drbcc->wait_for_answer && !drbcc->secQueue && !drbcc->prioQueue)
 		{
 			// nothing to do
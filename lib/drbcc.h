@@ -112,6 +112,12 @@ DRBCC_RC_t drbcc_register_flash_read_cb(DRBCC_HANDLE_t h, DRBCC_READ_FLASH_CB_t
 
 DRBCC_RC_t drbcc_req_flash_read(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsigned addr, unsigned len);
 
+// read len bytes into buf without read flash callbacks, the session callback is called once at the end
+DRBCC_RC_t drbcc_flash_read_into(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsigned addr, unsigned len, uint8_t *buf);
+
+// number of bytes stored by the last drbcc_flash_read_into
+DRBCC_RC_t drbcc_flash_read_count(DRBCC_HANDLE_t h, unsigned *count);
+
 DRBCC_RC_t drbcc_register_flash_write_cb(DRBCC_HANDLE_t h, DRBCC_WRITE_FLASH_CB_t cb);
 
 DRBCC_RC_t drbcc_req_flash_write(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsigned addr, unsigned len, uint8_t* data);
@@ -120,6 +126,10 @@ DRBCC_RC_t drbcc_register_flash_erase_cb(DRBCC_HANDLE_t h, DRBCC_ERASE_FLASH_CB_
 
 DRBCC_RC_t drbcc_req_flash_erase_block(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsigned blocknum);
 
+// write the segments in address order, erase blocks only if needed and keep the
+// rest of partially written blocks (read-modify-write), flash callbacks must not be registered
+DRBCC_RC_t drbcc_flash_write_sg(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const DRBCC_FLASH_SEGMENT_t segs[], unsigned count);
+
 
 // fw stuff
 DRBCC_RC_t drbcc_invalidate_bctrl_fw(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
@@ -0,0 +1,227 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation, either version 3 of the 
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "drbcc.h"
+#include "drbcc_ll.h"
+#include "drbcc_trace.h"
+#include "drbcc_alloc.h"
+
+#define EMPTY_ENTRY 0xF
+
+void libdrbcc_set_flash_geometry(DRBCC_t *drbcc, uint8_t mid, uint8_t devid1, uint8_t devid2)
+{
+	unsigned int shift = 0;
+
+	if (mid == 0x1F)
+	{
+		// Atmel: density code in bit 4..0 of device id 1, 0x04 = 4 MBit
+		shift = (devid1 & 0x1F) + 15;
+	}
+	else if ((devid2 >= 0x10) && (devid2 <= 0x20))
+	{
+		// JEDEC: capacity code is log2 of the size in bytes
+		shift = devid2;
+	}
+
+	if ((shift >= 16) && (shift <= 32))
+	{
+		unsigned long long size = 1ULL << shift;
+
+		drbcc->flashBlocks = (size >= DRBCC_MAX_BLOCKS * DRBCC_BLOCK_SIZE) ? DRBCC_MAX_BLOCKS : (unsigned int) (size / DRBCC_BLOCK_SIZE);
+		TRACE(DRBCC_TR_TRANS, "flash size %llu KByte, using %u blocks", size / 1024, drbcc->flashBlocks);
+	}
+	else
+	{
+		TRACE(DRBCC_TR_TRANS, "unknown flash id %02X %02X %02X, keep %u blocks", mid, devid1, devid2, libdrbcc_flash_blocks(drbcc));
+	}
+}
+
+unsigned int libdrbcc_flash_blocks(DRBCC_t *drbcc)
+{
+	return drbcc->flashBlocks ? drbcc->flashBlocks : DRBCC_DEFAULT_BLOCKS;
+}
+
+unsigned int libdrbcc_entry_blocks(const DRBCC_PARTENTRY_t *e)
+{
+	if ((e->type.typeinfo >> 4) == EMPTY_ENTRY)
+	{
+		return 0;
+	}
+	if (e->type.bits.blocktype)
+	{
+		return e->length;
+	}
+	return (e->length + DRBCC_BLOCK_SIZE - 1) / DRBCC_BLOCK_SIZE;
+}
+
+void libdrbcc_alloc_init(DRBCC_ALLOC_t *a, unsigned int numBlocks)
+{
+	memset(a, 0, sizeof(DRBCC_ALLOC_t));
+	a->numBlocks = (numBlocks > DRBCC_MAX_BLOCKS) ? DRBCC_MAX_BLOCKS : numBlocks;
+
+	// block 0: partition table, block 1: backup table, block 2..3: table journal
+	libdrbcc_alloc_mark(a, 0, DRBCC_LOG_FIRSTBLOCK);
+}
+
+int libdrbcc_alloc_mark(DRBCC_ALLOC_t *a, unsigned int start, unsigned int count)
+{
+	unsigned int i, j;
+	unsigned int end;
+
+	if (start >= a->numBlocks || count == 0)
+	{
+		return 0;
+	}
+	end = (count > a->numBlocks - start) ? a->numBlocks : start + count;
+
+	for (i = start; i < end; i++)
+	{
+		a->map[i / 8] |= (1 << (i % 8));
+	}
+
+	// skip extents ending before the new one
+	for (i = 0; (i < a->numExtents) && (a->used[i].start + a->used[i].count < start); i++)
+	{
+	}
+
+	// merge overlapping or adjacent extents
+	for (j = i; (j < a->numExtents) && (a->used[j].start <= end); j++)
+	{
+		if (a->used[j].start < start)
+		{
+			start = a->used[j].start;
+		}
+		if (a->used[j].start + a->used[j].count > end)
+		{
+			end = a->used[j].start + a->used[j].count;
+		}
+	}
+
+	if (j == i)
+	{
+		// insert new extent at i
+		if (a->numExtents >= DRBCC_ALLOC_MAX_EXTENTS)
+		{
+			return -1;
+		}
+		memmove(&a->used[i + 1], &a->used[i], (a->numExtents - i) * sizeof(DRBCC_EXTENT_t));
+		a->numExtents++;
+	}
+	else if (j > i + 1)
+	{
+		// extents i..j-1 are replaced by one
+		memmove(&a->used[i + 1], &a->used[j], (a->numExtents - j) * sizeof(DRBCC_EXTENT_t));
+		a->numExtents -= j - i - 1;
+	}
+	a->used[i].start = start;
+	a->used[i].count = end - start;
+	return 0;
+}
+
+int libdrbcc_alloc_mark_table(DRBCC_ALLOC_t *a, const DRBCC_PARTENTRY_t e[])
+{
+	int i;
+	int rc = 0;
+
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		if (libdrbcc_alloc_mark(a, e[i].startblock, libdrbcc_entry_blocks(&e[i])))
+		{
+			rc = -1;
+		}
+	}
+	return rc;
+}
+
+int libdrbcc_alloc_is_free(const DRBCC_ALLOC_t *a, unsigned int start, unsigned int count)
+{
+	unsigned int i;
+
+	if ((start >= a->numBlocks) || (count > a->numBlocks - start))
+	{
+		return 0;
+	}
+	for (i = start; i < start + count; i++)
+	{
+		if (a->map[i / 8] & (1 << (i % 8)))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int libdrbcc_alloc_find(const DRBCC_ALLOC_t *a, unsigned int count, DRBCC_ALLOC_POLICY_t policy)
+{
+	unsigned int i;
+	unsigned int start = 0;
+	int found = -1;
+	unsigned int foundsize = 0;
+
+	if (count == 0)
+	{
+		return -1;
+	}
+
+	// walk the gaps between the used extents, the last gap ends at the end of the flash
+	for (i = 0; i <= a->numExtents; i++)
+	{
+		unsigned int end = (i < a->numExtents) ? a->used[i].start : a->numBlocks;
+
+		if ((end > start) && (end - start >= count))
+		{
+			if (policy == DRBCC_ALLOC_FIRST_FIT)
+			{
+				return start;
+			}
+			if ((found < 0) || (end - start < foundsize))
+			{
+				// this one is better
+				found = start;
+				foundsize = end - start;
+			}
+		}
+		if (i < a->numExtents)
+		{
+			start = a->used[i].start + a->used[i].count;
+		}
+	}
+	return found;
+}
+
+/* Editor hints for emacs
+ *
+ * Local Variables:
+ * mode:c
+ * c-basic-offset:4
+ * indent-tabs-mode:t
+ * tab-width:4
+ * End:
+ *
+ * NO CODE BELOW THIS! */
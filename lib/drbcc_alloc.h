@@ -0,0 +1,80 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation, either version 3 of the 
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DRBCC_ALLOC_H_
+#define _DRBCC_ALLOC_H_
+
+#include <stdint.h>
+#include "drbcc_ll.h"
+
+// flash geometry (counted in 4k blocks)
+#define DRBCC_BLOCK_SIZE		0x1000
+#define DRBCC_DEFAULT_BLOCKS	1024	// 4 MByte, used until the flash id is known
+#define DRBCC_MAX_BLOCKS		4096	// 16 MByte, limit of the 24 bit flash address
+
+// max. number of used extents: reserved area + entries of the current and of the original table
+#define DRBCC_ALLOC_MAX_EXTENTS	(2 * DRBCC_PART_ENTRIES + 1)
+
+typedef struct
+{
+	unsigned int start;
+	unsigned int count;
+} DRBCC_EXTENT_t;
+
+typedef struct
+{
+	unsigned int numBlocks;
+	unsigned int numExtents;
+	DRBCC_EXTENT_t used[DRBCC_ALLOC_MAX_EXTENTS];	// sorted by start, not overlapping
+	uint8_t map[DRBCC_MAX_BLOCKS / 8];				// bitmap of used blocks
+} DRBCC_ALLOC_t;
+
+// number of flash blocks from the flash id (JEDEC or Atmel density code)
+void libdrbcc_set_flash_geometry(DRBCC_t *drbcc, uint8_t mid, uint8_t devid1, uint8_t devid2);
+
+unsigned int libdrbcc_flash_blocks(DRBCC_t *drbcc);
+
+// number of blocks used by a partition table entry
+unsigned int libdrbcc_entry_blocks(const DRBCC_PARTENTRY_t *e);
+
+// empty map, partition table and reserved blocks are marked as used
+void libdrbcc_alloc_init(DRBCC_ALLOC_t *a, unsigned int numBlocks);
+
+int libdrbcc_alloc_mark(DRBCC_ALLOC_t *a, unsigned int start, unsigned int count);
+
+int libdrbcc_alloc_mark_table(DRBCC_ALLOC_t *a, const DRBCC_PARTENTRY_t e[]);
+
+int libdrbcc_alloc_is_free(const DRBCC_ALLOC_t *a, unsigned int start, unsigned int count);
+
+// returns start block of a free area with count blocks or -1
+int libdrbcc_alloc_find(const DRBCC_ALLOC_t *a, unsigned int count, DRBCC_ALLOC_POLICY_t policy);
+
+#endif /* _DRBCC_ALLOC_H_ */
+
+/* Editor hints for emacs
+ *
+ * Local Variables:
+ * mode:c
+ * c-basic-offset:4
+ * indent-tabs-mode:t
+ * tab-width:4
+ * End:
+ *
+ * NO CODE BELOW THIS! */
@@ -59,6 +59,8 @@ typedef enum
 	DRBCC_RC_CBREGISTERED,
 	DRBCC_RC_INVALID_FILENAME,
 	DRBCC_RC_SESSIONACTIVE,
+	DRBCC_RC_INVALID_CHECKPOINT,
+	DRBCC_RC_INVALID_IMAGE,
 } DRBCC_RC_t;
 
 // supported serial baud rates
@@ -93,6 +95,27 @@ typedef enum
 	DRBCC_FLASHBLOCK_T_RESERVED4	= 0x0,
 } DRBCC_FLASHBLOCK_TYPES_t;
 
+// placement of new files in the flash data area
+typedef enum
+{
+	DRBCC_ALLOC_BEST_FIT,		// smallest free area the file fits in (default)
+	DRBCC_ALLOC_FIRST_FIT,		// lowest free area the file fits in
+} DRBCC_ALLOC_POLICY_t;
+
+// phases of drbcc_update_firmware
+typedef enum
+{
+	DRBCC_UPDATE_PHASE_NONE,
+	DRBCC_UPDATE_PHASE_BOOTLOADER,	// put boot loader file (optional)
+	DRBCC_UPDATE_PHASE_UPLOAD,		// put firmware file
+	DRBCC_UPDATE_PHASE_VERIFY,		// read back and compare the uploaded files
+	DRBCC_UPDATE_PHASE_INVALIDATE,	// invalidate running firmware
+	DRBCC_UPDATE_PHASE_RESTART,		// request board controller restart
+	DRBCC_UPDATE_PHASE_WAIT,		// wait for the boot loader to start the update
+	DRBCC_UPDATE_PHASE_RESYNC,		// wait for the new firmware to answer
+	DRBCC_UPDATE_PHASES
+} DRBCC_UPDATE_PHASE_t;
+
 // log event codes
 typedef enum
 {
@@ -328,6 +351,50 @@ typedef struct
 	uint32_t length; // in blocks or in bytes (number of used blocks: ((numbytes + 0xfff)/0x1000))
 } DRBCC_PARTENTRY_t;
 
+#define DRBCC_CHECKPOINT_MAGIC	0x44434b50
+
+// state of an interrupted drbcc_get_file / drbcc_put_file, see drbcc_register_checkpoint
+typedef struct
+{
+	uint32_t magic;			// DRBCC_CHECKPOINT_MAGIC if valid
+	uint8_t direction;		// 0: get file, 1: put file
+	uint8_t typeinfo;		// type of the partition table entry
+	uint16_t startblock;	// flash location of the file
+	uint32_t length;		// file size in bytes
+	uint32_t offset;		// bytes transferred and acknowledged, multiple of 4K
+	uint16_t crc;			// 16bit DRBCC CRC of the bytes 0..offset-1
+} DRBCC_CHECKPOINT_t;
+
+#define DRBCC_LOG_CURSOR_MAGIC	0x44434c43
+
+// position in the ring log after the last drbcc_get_log_since, all zero: fetch all entries
+typedef struct
+{
+	uint32_t magic;			// DRBCC_LOG_CURSOR_MAGIC if valid
+	uint32_t pos;			// next entry to fetch, index in the ring log area
+	uint32_t epoch;			// number of ring wraps seen
+	uint32_t blocks;		// size of the ring log area in 4k blocks, all entries are fetched if it changed
+} DRBCC_LOG_CURSOR_t;
+
+#define DRBCC_LOG_EVENT_BIT(event)	(1UL << (event))
+
+// log entries passed to DRBCC_GETLOG_CB_t, all zero: all entries
+typedef struct
+{
+	uint32_t events;		// DRBCC_LOG_EVENT_BIT of the events to pass (codes below 32), 0: all events
+	time_t from;			// entries with an earlier timestamp are skipped, 0: no limit
+	time_t to;				// entries with a later timestamp are skipped, 0: no limit
+	unsigned int minEpoch;	// entries of an earlier RTC epoch are skipped
+} DRBCC_LOG_FILTER_t;
+
+// flash range of drbcc_flash_write_sg
+typedef struct
+{
+	unsigned addr;
+	const uint8_t *data;	// must stay valid until the session ends
+	unsigned len;
+} DRBCC_FLASH_SEGMENT_t;
+
 // Callbacks
 typedef void (DRBCC_API *DRBCC_ERROR_CB_t)(void *context, char* msg);
 
@@ -353,6 +420,9 @@ typedef void (DRBCC_API *DRBCC_PARTITION_TABLE_CB_t)(void *context, unsigned num
 
 typedef void (DRBCC_API *DRBCC_PROGRESS_CB_t)(void *context, int cur, int max);
 
+// phase of drbcc_update_firmware done after ms milliseconds
+typedef void (DRBCC_API *DRBCC_UPDATE_CB_t)(void *context, DRBCC_UPDATE_PHASE_t phase, unsigned long ms);
+
 typedef void (DRBCC_API *DRBCC_GETLOG_CB_t)(void *context, int pos, int len, uint8_t data[]);
 
 typedef void (DRBCC_API *DRBCC_GETPOS_CB_t)(void *context, int pos, uint8_t entry, uint8_t wrapflag);
@@ -0,0 +1,431 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "drbcc_files.h"
+#include "drbcc_image.h"
+#include "drbcc_log.h"
+#include "drbcc_ll.h"
+#include "drbcc_trace.h"
+#include "drbcc_utils.h"
+
+#if USE_OPEN_BINARY
+#define OX_BINARY O_BINARY
+#else
+#define OX_BINARY 0
+#endif
+
+#define BLOCK		0x1000
+#define BLOCK_ENTRIES	(BLOCK / DRBCC_LOG_ENTRY_SIZE)
+
+// decoded chunk waiting to be passed on in log order
+typedef struct
+{
+	DRBCC_LOG_ENTRY_t *entries;
+	unsigned int count;
+	int ready;
+} DRBCC_LOG_DUMP_SLOT_t;
+
+typedef struct
+{
+	const uint8_t *data;			// ring log area, oldest entry first
+	unsigned int total;				// entries of the area
+	unsigned int first;				// index of the oldest entry in the area
+	unsigned int chunks;
+	unsigned int capacity;			// entries of a slot
+	unsigned int window;			// chunks decoded ahead of the callback
+	DRBCC_LOG_DUMP_SLOT_t *slots;	// chunk i in slot i % window
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int next;				// next chunk to decode
+	unsigned int passed;			// chunks passed to the callback
+	int stop;
+} DRBCC_LOG_DUMP_t;
+
+// oldest entry: a dump does not contain the write position, it is taken as the first empty entry behind a used
+// one, the log starts with the block after the write block like in drbcc_get_log
+static unsigned int libdrbcc_log_dump_first(const uint8_t data[], unsigned int total, int *empty)
+{
+	unsigned int i;
+	int used = 0;
+
+	for (i = 0; i < total; i++)
+	{
+		int blank = (data[i * DRBCC_LOG_ENTRY_SIZE] == DRBCC_E_EMPTY);
+
+		used |= !blank;
+		if (blank && (data[((i + total - 1) % total) * DRBCC_LOG_ENTRY_SIZE] != DRBCC_E_EMPTY))
+		{
+			*empty = 0;
+			return ((i / BLOCK_ENTRIES + 1) * BLOCK_ENTRIES) % total;
+		}
+	}
+	// all entries used: write position unknown
+	*empty = !used;
+	return 0;
+}
+
+// decode chunk c into slot, the entries around the chunk are decoded, too, to complete the extension
+// sequences crossing its borders, but only entries starting inside the chunk are kept
+static void libdrbcc_log_dump_chunk(DRBCC_LOG_DUMP_t *dump, unsigned int c, DRBCC_LOG_DUMP_SLOT_t *slot)
+{
+	unsigned int start = c * DRBCC_LOG_DUMP_CHUNK * BLOCK_ENTRIES;
+	unsigned int end = start + DRBCC_LOG_DUMP_CHUNK * BLOCK_ENTRIES;
+	unsigned int from = start;
+	unsigned int to;
+	unsigned int seen;
+	unsigned int i, n;
+
+	if (end > dump->total)
+	{
+		end = dump->total;
+	}
+	// the entry an extension belongs to is at most DRBCC_LOG_EXT_MAX used entries back
+	for (seen = 0; (from > 0) && (seen <= DRBCC_LOG_EXT_MAX); from--)
+	{
+		seen += (dump->data[(from - 1) * DRBCC_LOG_ENTRY_SIZE] != DRBCC_E_EMPTY);
+	}
+	for (to = end, seen = 0; (to < dump->total) && (seen < DRBCC_LOG_EXT_MAX); to++)
+	{
+		seen += (dump->data[to * DRBCC_LOG_ENTRY_SIZE] != DRBCC_E_EMPTY);
+	}
+
+	n = drbcc_log_decode_all(from, &dump->data[from * DRBCC_LOG_ENTRY_SIZE], to - from, slot->entries, dump->capacity);
+	slot->count = 0;
+	for (i = 0; i < n; i++)
+	{
+		DRBCC_LOG_ENTRY_t *e = &slot->entries[i];
+
+		if (((unsigned int) e->pos < start) || ((unsigned int) e->pos >= end))
+		{
+			continue;
+		}
+		if (slot->count != i)
+		{
+			memcpy(&slot->entries[slot->count], e, sizeof(DRBCC_LOG_ENTRY_t));
+		}
+		// index in the ring log area like drbcc_get_log
+		slot->entries[slot->count].pos = (dump->first + slot->entries[slot->count].pos) % dump->total;
+		slot->count++;
+	}
+}
+
+static void *libdrbcc_log_dump_worker(void *arg)
+{
+	DRBCC_LOG_DUMP_t *dump = arg;
+	DRBCC_LOG_DUMP_SLOT_t *slot;
+	unsigned int c;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&dump->lock);
+		while (!dump->stop && (dump->next < dump->chunks) && (dump->next >= dump->passed + dump->window))
+		{
+			pthread_cond_wait(&dump->cond, &dump->lock);
+		}
+		if (dump->stop || (dump->next >= dump->chunks))
+		{
+			pthread_mutex_unlock(&dump->lock);
+			break;
+		}
+		c = dump->next++;
+		pthread_mutex_unlock(&dump->lock);
+
+		slot = &dump->slots[c % dump->window];
+		libdrbcc_log_dump_chunk(dump, c, slot);
+
+		pthread_mutex_lock(&dump->lock);
+		slot->ready = 1;
+		pthread_cond_broadcast(&dump->cond);
+		pthread_mutex_unlock(&dump->lock);
+	}
+	return NULL;
+}
+
+// pass the chunks to cb in order as the workers finish them
+static void libdrbcc_log_dump_pass(DRBCC_LOG_DUMP_t *dump, DRBCC_LOG_QUERY_CB_t cb, void *context)
+{
+	DRBCC_LOG_DUMP_SLOT_t *slot;
+	unsigned int c, i;
+	int stop = 0;
+
+	for (c = 0; (c < dump->chunks) && !stop; c++)
+	{
+		slot = &dump->slots[c % dump->window];
+		pthread_mutex_lock(&dump->lock);
+		while (!slot->ready)
+		{
+			pthread_cond_wait(&dump->cond, &dump->lock);
+		}
+		pthread_mutex_unlock(&dump->lock);
+
+		for (i = 0; (i < slot->count) && !stop; i++)
+		{
+			stop = !cb(context, &slot->entries[i]);
+		}
+
+		pthread_mutex_lock(&dump->lock);
+		slot->ready = 0;
+		dump->passed++;
+		pthread_cond_broadcast(&dump->cond);
+		pthread_mutex_unlock(&dump->lock);
+	}
+}
+
+DRBCC_RC_t drbcc_log_decode_dump(const uint8_t data[], size_t size, unsigned int threads, DRBCC_LOG_QUERY_CB_t cb, void *context)
+{
+	DRBCC_LOG_DUMP_t dump;
+	pthread_t tid[DRBCC_LOG_DUMP_THREADS_MAX];
+	unsigned int blocks = size / BLOCK;
+	unsigned int started = 0;
+	unsigned int i;
+	uint8_t *ordered;
+	int empty;
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	if (cb == NULL)
+	{
+		return DRBCC_RC_UNSPEC_ERROR;
+	}
+	if ((size == 0) || (size % BLOCK))
+	{
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+	memset(&dump, 0, sizeof(dump));
+	dump.total = blocks * BLOCK_ENTRIES;
+	dump.first = libdrbcc_log_dump_first(data, dump.total, &empty);
+	if (empty)
+	{
+		return DRBCC_RC_NOERROR;
+	}
+
+	// rotate the ring, the chunks are decoded from a linear copy
+	ordered = malloc(size);
+	if (ordered == NULL)
+	{
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+	memcpy(ordered, &data[dump.first * DRBCC_LOG_ENTRY_SIZE], size - dump.first * DRBCC_LOG_ENTRY_SIZE);
+	memcpy(&ordered[size - dump.first * DRBCC_LOG_ENTRY_SIZE], data, dump.first * DRBCC_LOG_ENTRY_SIZE);
+	dump.data = ordered;
+
+	if (threads == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus > 0) ? (unsigned int) cpus : 1;
+	}
+	dump.chunks = (blocks + DRBCC_LOG_DUMP_CHUNK - 1) / DRBCC_LOG_DUMP_CHUNK;
+	if (threads > dump.chunks)
+	{
+		threads = dump.chunks;
+	}
+	if (threads > DRBCC_LOG_DUMP_THREADS_MAX)
+	{
+		threads = DRBCC_LOG_DUMP_THREADS_MAX;
+	}
+	dump.window = 2 * threads;
+	dump.capacity = DRBCC_LOG_DUMP_CHUNK * BLOCK_ENTRIES + 2 * (DRBCC_LOG_EXT_MAX + 1);
+	dump.slots = calloc(dump.window, sizeof(DRBCC_LOG_DUMP_SLOT_t));
+	for (i = 0; dump.slots && (i < dump.window); i++)
+	{
+		dump.slots[i].entries = malloc(dump.capacity * sizeof(DRBCC_LOG_ENTRY_t));
+		if (dump.slots[i].entries == NULL)
+		{
+			rc = DRBCC_RC_OUTOFMEMORY;
+		}
+	}
+	if ((dump.slots == NULL) || (rc != DRBCC_RC_NOERROR))
+	{
+		rc = DRBCC_RC_OUTOFMEMORY;
+		goto out;
+	}
+
+	pthread_mutex_init(&dump.lock, NULL);
+	pthread_cond_init(&dump.cond, NULL);
+	for (started = 0; started < threads; started++)
+	{
+		if (0 != pthread_create(&tid[started], NULL, libdrbcc_log_dump_worker, &dump))
+		{
+			break;
+		}
+	}
+	if (started == 0)
+	{
+		rc = DRBCC_RC_SYSTEM_ERROR;
+	}
+	else
+	{
+		libdrbcc_log_dump_pass(&dump, cb, context);
+	}
+
+	pthread_mutex_lock(&dump.lock);
+	dump.stop = 1;
+	pthread_cond_broadcast(&dump.cond);
+	pthread_mutex_unlock(&dump.lock);
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(tid[i], NULL);
+	}
+	pthread_cond_destroy(&dump.cond);
+	pthread_mutex_destroy(&dump.lock);
+
+out:
+	for (i = 0; dump.slots && (i < dump.window); i++)
+	{
+		free(dump.slots[i].entries);
+	}
+	free(dump.slots);
+	free(ordered);
+	return rc;
+}
+
+// ring log area of a drbcc_flash_backup image, blocks without data are empty
+static uint8_t *libdrbcc_log_dump_image(const uint8_t *map, size_t size, size_t *area)
+{
+	const uint8_t *block0 = NULL;
+	unsigned int startblock, blocks;
+	unsigned int b;
+	size_t pos;
+	uint8_t *ring;
+
+	if ((map[12] | (map[13] << 8) | (map[14] << 16) | ((uint32_t) map[15] << 24)) != BLOCK)
+	{
+		return NULL;
+	}
+	for (pos = DRBCC_IMAGE_HEADER_SIZE; pos + 2 + BLOCK <= size; pos += 2 + BLOCK)
+	{
+		b = map[pos] | (map[pos + 1] << 8);
+		if (b == DRBCC_IMAGE_END)
+		{
+			break;
+		}
+		if (b == 0)
+		{
+			block0 = &map[pos + 2];
+		}
+	}
+	if (block0)
+	{
+		libdrbcc_log_area(block0, BLOCK, &startblock, &blocks);
+	}
+	else
+	{
+		libdrbcc_log_area(map, 0, &startblock, &blocks);
+	}
+
+	*area = (size_t) blocks * BLOCK;
+	ring = malloc(*area);
+	if (ring == NULL)
+	{
+		return NULL;
+	}
+	memset(ring, 0xFF, *area);
+	for (pos = DRBCC_IMAGE_HEADER_SIZE; pos + 2 + BLOCK <= size; pos += 2 + BLOCK)
+	{
+		b = map[pos] | (map[pos + 1] << 8);
+		if (b == DRBCC_IMAGE_END)
+		{
+			break;
+		}
+		if ((b >= startblock) && (b < startblock + blocks))
+		{
+			memcpy(&ring[(b - startblock) * BLOCK], &map[pos + 2], BLOCK);
+		}
+	}
+	return ring;
+}
+
+DRBCC_RC_t drbcc_log_decode_file(const char *filename, unsigned int threads, DRBCC_LOG_QUERY_CB_t cb, void *context)
+{
+	struct stat st;
+	uint8_t *map;
+	uint8_t *ring = NULL;
+	const uint8_t *area;
+	size_t size;
+	unsigned int startblock, blocks;
+	DRBCC_RC_t rc;
+	int fd = open(filename, O_RDONLY | OX_BINARY);
+
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	if ((0 != fstat(fd, &st)) || (st.st_size < BLOCK))
+	{
+		close(fd);
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+
+	if (0 == memcmp(map, DRBCC_IMAGE_MAGIC, 8))
+	{
+		// sparse image of drbcc_flash_backup
+		ring = libdrbcc_log_dump_image(map, st.st_size, &size);
+		area = ring;
+	}
+	else if (libdrbcc_log_area(map, BLOCK, &startblock, &blocks) &&
+		((off_t) (startblock + blocks) * BLOCK <= st.st_size))
+	{
+		// whole flash read by rflash
+		area = &map[startblock * BLOCK];
+		size = (size_t) blocks * BLOCK;
+	}
+	else
+	{
+		// ring log area read by rflash
+		area = map;
+		size = st.st_size & ~(off_t) (BLOCK - 1);
+	}
+
+	rc = area ? drbcc_log_decode_dump(area, size, threads, cb, context) : DRBCC_RC_INVALID_IMAGE;
+	free(ring);
+	munmap(map, st.st_size);
+	return rc;
+}
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+*
+* NO CODE BELOW THIS! */
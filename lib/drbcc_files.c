@@ -30,12 +30,14 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "drbcc_files.h"
 #include "drbcc_ll.h"
 #include "drbcc_com.h"
 #include "drbcc_trace.h"
 #include "drbcc_utils.h"
+#include "drbcc_alloc.h"
 
 #ifdef HAVE_LIBDRTRACE
 #else
@@ -79,11 +81,27 @@ bei Fehlern in der ersten PT zur
 	o 2 byte Start-Block; LSB first, 4K-Block-weise, ab Block 4
 	o 3 byte Lnge: LSB first, bei Block-Eintrgen: Anzahl der 4K-Blcke, bei Byte-Eintrgen: Lnge in Byte; Anzahl der belegten Blcke ist dann ((Lnge + 0xfff)/0x1000)
 
+Format 2 (Version 2 im Header, fr mehr als 20 Eintrge; ltere Versionen melden einen CRC-Fehler, verwenden aber
+die falsch gelesenen Eintrge und berschreiben die Tabelle beim nchsten Schreiben einer Datei. Format 2 darf daher
+nicht verwendet werden, solange ltere Versionen auf das Gert zugreifen):
+* 16 byte Header:
+	o 2 byte Magic, 1 byte Version (2), 1 byte Flags
+	o 2 byte CRC (16bit DRBCC CRC, LSB first) ber die folgenden Bytes bis zum Ende der Tabelle
+	o 2 byte Anzahl der Eintrge N (max. 64), LSB first
+	o 1 byte Epoche des Journals, 1 byte invertierte Epoche, 6 byte 0xFF
+* N Eintrge mit je 16 Byte:
+	o 1 byte Typ wie oben, 1 byte Flags (0xFF: keine)
+	o 4 byte Start-Block, 4 byte Lnge, 4 byte Inhalts-Hash (FNV-1a), LSB first
+	o 2 byte 0xFF
+
+Format 1 speichert die Inhalts-Hashes in Page 1 des Blocks (Adresse 128 bzw. 4096 + 128).
+Bei gesetztem Journal-Flag (Bit 0 der Flags) stehen die nderungen seit dem letzten Schreiben der Tabelle als Journal in Block 2 und 3.
+
 * Ring-Log-Bereich ist immer der erste Eintrag, fest in BCTRL-Firmware: Block 4 bis 511, 508 Blcke (2032 KByte, 130048 Log-Eintrge)
 
 * unbenutzt: persistenter Log-Bereich ist immer der zweite Eintrag, default-size 64 Blcke (256 KByte, 16384 Log-Eintrge)
 
-Block 1,2,3: reserved for future use Block 4..1023: Datenbereich
+Block 2,3: Journal der Tabelle, Block 4..1023: Datenbereich
 
 * Platzhalter-Eintrge: 4..511: Ring-Log-Bereich, unbenutzt: 512..575: persistenter Log-Bereich
 * dann noch verfgbar: 448 Blcke
@@ -91,19 +109,44 @@ Block 1,2,3: reserved for future use Block 4..1023: Datenbereich
 */
 
 
-typedef struct
-{
-	int start;
-	int end;
-	int free;
-} FREE_USED_TABLE_t;
-
 DRBCC_SESSION_t drbcc_session = 1;
 
 #define EMPTY_ENTRY 0xF
 
 #define isEmpty(x) ((x.type.typeinfo >> 4) == EMPTY_ENTRY)
 
+// entry x is a file of type t (bit 3: blocktype, bit 0-2: type) with index i
+#define isFile(x, t, i) (((x).type.bits.type == ((t) & 0x07)) && ((x).type.bits.blocktype == (((t) >> 3) & 0x01)) && ((x).type.bits.idx == ((i) & 0xF)))
+
+// results of libdrbcc_parse_partition
+#define PART_OK			0
+#define PART_NO_MAGIC	1
+#define PART_CRC_ERROR	2
+
+// journal of table updates in blocks 2-3, records of 16 byte (table format 1):
+// magic, epoch, entry index (bit 7: last record of the update), entry (6 byte), crc (2 byte), content hash (4 byte), 0xFF
+// records of 32 byte (table format 2):
+// magic, epoch, entry index (bit 7: last record of the update), type, flags, start block (4 byte), length (4 byte),
+// content hash (4 byte), crc (2 byte), 0xFF...
+#define JOURNAL_START	0x2000
+#define JOURNAL_END		0x4000
+#define JOURNAL_RECORD	16
+#define JOURNAL_RECORD_V2	32
+#define JOURNAL_MAGIC	'J'
+#define JOURNAL_LAST	0x80
+
+// results of libdrbcc_parse_record besides the index byte
+#define RECORD_EMPTY	-1
+#define RECORD_INVALID	-2
+
+// content hashes behind the format 1 table in blocks 0 and 1: magic, hash of each entry (4 byte), crc (2 byte)
+#define HASH_OFFSET		128
+#define HASH_MAGIC1		'H'
+#define HASH_MAGIC2		'S'
+
+// flash address written by a table update (table and hashes of both copies or journal)
+#define isTableAddr(a) ((a) < JOURNAL_END && ((a) >= JOURNAL_START || (a) % 0x1000 < DRBCC_PART_SIZE))
+
 void libdrbcc_dump(uint8_t data[], unsigned int len)
 {
 	// hexdump to stdout
@@ -126,1331 +169,3483 @@ void libdrbcc_dump(uint8_t data[], unsigned int len)
 	}
 }
 
-void libdrbcc_create_partition(DRBCC_t *drbcc)
+void libdrbcc_end_session(DRBCC_t *drbcc, const char *msg, int success)
 {
-	int i = 0;
-	int j = 0;
-	uint8_t data[128];
-	DRBCC_PARTENTRY_t e[20];
-	uint16_t crc = 0xffff;
-
-	memset(e, 0xFF, sizeof(e));
-
-	data[i++] = DRBCC_PART_MAGIC1;	// magic
-	data[i++] = DRBCC_PART_MAGIC2;
-	data[i++] = 1;		// version
-	data[i++] = 0;
-	i++;				// crc
-	i++;
-
-	// dieser Eintrag ist ein reiner Platzhalter, die BCTRL-Firmware ist auf diesen Bereich 'festverdrahtet' (MRE 11.4.2012)
-	// Werte NICHT ndern, der BCTRL schreibt die Logdaten IMMER in diesen Bereich!!!!
-	e[0].type.bits.blocktype = 1;
-	e[0].type.bits.type = DRBCC_FLASHBLOCK_T_RING_LOG;
-	e[0].type.bits.idx = 0;
-	e[0].startblock = 4;
-	e[0].length = 508;
-
-	// dieser Bereich ist ungenutzt
-	e[1].type.bits.blocktype = 1;
-	e[1].type.bits.type = DRBCC_FLASHBLOCK_T_PERS_LOG;
-	e[1].type.bits.idx = 0;
-	e[1].startblock = 512;
-	e[1].length = 64;
-
-	// build data
-	for (j = 0; j < 20; j++)
+	drbcc->state = DRBCC_STATE_USER;
+	drbcc->ioFd = -1;
+	drbcc->ioMem = NULL;
+	if (drbcc->diffFd >= 0)
 	{
-		data[i++] = e[j].type.typeinfo;
-		data[i++] = (uint8_t) ((e[j].startblock >> 0) & 0xFF);
-		data[i++] = (uint8_t) ((e[j].startblock >> 8) & 0xFF);
-		data[i++] = (uint8_t) ((e[j].length >>  0) & 0xFF);
-		data[i++] = (uint8_t) ((e[j].length >>  8) & 0xFF);
-		data[i++] = (uint8_t) ((e[j].length >> 16) & 0xFF);
+		close(drbcc->diffFd);
+		drbcc->diffFd = -1;
 	}
-	for (i = 6; i < 126; i++)
+	if (msg && drbcc->error_cb)
 	{
-		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
+		drbcc->error_cb(drbcc->context, (char*) msg);
 	}
-	data[4] = (uint8_t) (crc & 0xFF);
-	data[5] = (uint8_t) ((crc >> 8) & 0xFF);
+	if (drbcc->logMirror)
+	{
+		// drbcc_log_mirror_sync: store the mirror header
+		success = libdrbcc_log_mirror_end(drbcc, success);
+	}
+	if (drbcc->updatePhase != DRBCC_UPDATE_PHASE_NONE)
+	{
+		// drbcc_update_firmware continues in the same session
+		libdrbcc_update_next(drbcc);
+		return;
+	}
+	if (drbcc->session_cb)
+	{
+		drbcc->session_cb(drbcc->context, drbcc->session, success);
+	}
+	drbcc->session = 0;
+}
 
-	libdrbcc_req_flash_erase_block(drbcc, 1);
-	libdrbcc_req_flash_write(drbcc, 4096, 128, data);
-	libdrbcc_req_flash_erase_block(drbcc, 0);
-	libdrbcc_req_flash_write(drbcc, 0, 128, data);
+static uint32_t libdrbcc_get32(const uint8_t d[])
+{
+	return d[0] | (d[1] << 8) | (d[2] << 16) | ((uint32_t) d[3] << 24);
 }
 
-DRBCC_RC_t libdrbcc_request_partition(DRBCC_t *drbcc)
+static void libdrbcc_put32(uint8_t d[], uint32_t value)
+{
+	d[0] = (uint8_t) ((value >>  0) & 0xFF);
+	d[1] = (uint8_t) ((value >>  8) & 0xFF);
+	d[2] = (uint8_t) ((value >> 16) & 0xFF);
+	d[3] = (uint8_t) ((value >> 24) & 0xFF);
+}
+
+// number of entries of a table in the given format
+static unsigned int libdrbcc_table_entries(int version)
 {
-	// request 1st 128 Bytes of flash
-	return libdrbcc_req_flash_read(drbcc, 0, 128);
+	return (version == 2) ? DRBCC_PART_ENTRIES : DRBCC_PART_V1_ENTRIES;
 }
 
-DRBCC_RC_t libdrbcc_request_partition2(DRBCC_t *drbcc)
+// number of entries usable for new files
+static unsigned int libdrbcc_part_entries(DRBCC_t *drbcc)
 {
-	// request 1st 128 Bytes of flash
-	return libdrbcc_req_flash_read(drbcc, 4096, 128);
+	return libdrbcc_table_entries(drbcc->partFormat ? drbcc->partFormat : drbcc->partVersion);
 }
 
-void libdrbcc_got_partition(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+// format of the next table rewrite, format 1 only if all used entries fit
+static int libdrbcc_write_version(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[])
 {
 	int i;
-	uint16_t crc = 0xffff;
+	int version = drbcc->partFormat ? drbcc->partFormat : drbcc->partVersion;
 
-	// check addr
-	if (addr != 0) //
+	if (version == 2)
 	{
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "Wrong flash space used for partition table!");
-		}
-		if (drbcc->session_cb)
-		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
-		}
-		drbcc->session = 0;
-		return;
+		return 2;
 	}
-	if (len < 126)
+	for (i = DRBCC_PART_V1_ENTRIES; i < DRBCC_PART_ENTRIES; i++)
 	{
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "Partition table is to short!");
-		}
-		if (drbcc->session_cb)
+		if (!isEmpty(e[i]))
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			return 2;
 		}
-		drbcc->session = 0;
-		return;
 	}
+	return 1;
+}
 
-	// check magic
-	if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1])) // Check partition table magic
-	{
-		libdrbcc_create_partition(drbcc);
-		libdrbcc_request_partition(drbcc);
+// bytes of the table with the 1st chunk data[], including the content hashes of format 1
+static unsigned int libdrbcc_partition_size(const uint8_t data[], unsigned int len)
+{
+	unsigned int n;
 
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "No magic in flash partition table, creating new one");
-		}
-		return;
+	if ((len < 8) || (DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1]))
+	{
+		return len;
 	}
-
-	// check crc
-	for (i = 6; i < 126; i++)
+	if (data[2] != 2)
 	{
-		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
+		return HASH_OFFSET + CHUNK;
 	}
-	if (((crc & 0xff) != data[4]) || (((crc >> 8) & 0xff) != data[5]))
+	n = data[6] | (data[7] << 8);
+	if (n > DRBCC_PART_ENTRIES)
 	{
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "CRC error in flash partition table");
-		}
-		// HACK? return;
+		// rejected by libdrbcc_parse_partition
+		n = DRBCC_PART_ENTRIES;
 	}
+	return DRBCC_PART_V2_HEADER + n * DRBCC_PART_V2_ENTRY;
+}
+
 
-	// ignore version info
-	data += 6;
+// decode the hashes, all unknown if missing (written by older versions) or damaged
+static void libdrbcc_parse_hashes(const uint8_t data[], unsigned int len, uint32_t hash[])
+{
+	int i;
+	unsigned int n = 2 + DRBCC_PART_V1_ENTRIES * 4;
+	uint16_t crc = 0xffff;
 
-	// build entries
-	DRBCC_PARTENTRY_t e[20];
-	for (i = 0; i < 20; i++)
+	for (i = 0; i < DRBCC_PART_V1_ENTRIES; i++)
 	{
-		e[i].type.typeinfo	= data[i*6];
-		e[i].startblock		= data[i*6 + 1] | (data[i*6 + 2] << 8);
-		e[i].length		= data[i*6 + 3] | (data[i*6 + 4] << 8) | (data[i*6 + 5] << 16); // size in blocks or bytes
+		hash[i] = DRBCC_HASH_UNKNOWN;
 	}
-
-	if (drbcc->partitiontable_cb)
+	if ((len < n + 2) || (data[0] != HASH_MAGIC1) || (data[1] != HASH_MAGIC2))
 	{
-		drbcc->state = DRBCC_STATE_USER;
-		drbcc->partitiontable_cb(drbcc->context, 20, e);
+		return;
 	}
-	if (drbcc->session_cb)
+	for (i = 2; i < (int) n; i++)
 	{
-		drbcc->session_cb(drbcc->context, drbcc->session, 1);
+		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
+	}
+	if (((crc & 0xff) != data[n]) || (((crc >> 8) & 0xff) != data[n + 1]))
+	{
+		return;
+	}
+	for (i = 0; i < DRBCC_PART_V1_ENTRIES; i++)
+	{
+		hash[i] = libdrbcc_get32(&data[2 + i*4]);
 	}
-	drbcc->session = 0;
 }
 
-void libdrbcc_delete(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+// decode the raw table (format 1: at least 126 byte) into e[] and hash[]
+static int libdrbcc_parse_partition(const uint8_t data[], unsigned int len, DRBCC_PARTENTRY_t e[], uint32_t hash[])
 {
-	int i;
+	unsigned int i;
+	unsigned int n;
+	int rc = PART_OK;
 	uint16_t crc = 0xffff;
 
-	// check addr
-	if (addr != 0) //
+	// check magic
+	if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1]))
 	{
-		if (drbcc->error_cb)
+		return PART_NO_MAGIC;
+	}
+
+	memset(e, 0xFF, DRBCC_PART_ENTRIES * sizeof(DRBCC_PARTENTRY_t));
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		hash[i] = DRBCC_HASH_UNKNOWN;
+	}
+
+	if (data[2] != 2)
+	{
+		// format 1, older versions ignore the version info
+
+		// build entries
+		for (i = 0; i < DRBCC_PART_V1_ENTRIES; i++)
 		{
-			drbcc->error_cb(drbcc->context, "Wrong flash space used for partition table!");
+			const uint8_t *d = &data[6 + i*6];
+
+			e[i].type.typeinfo	= d[0];
+			e[i].startblock		= d[1] | (d[2] << 8);
+			e[i].length			= d[3] | (d[4] << 8) | (d[5] << 16); // size in blocks or bytes
 		}
-		if (drbcc->session_cb)
+
+		// check crc
+		for (i = 6; i < 126; i++)
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			crc = libdrbcc_crc_ccitt_update(crc, data[i]);
 		}
-		drbcc->session = 0;
-		return;
-	}
-	if (len < 126)
-	{
-		if (drbcc->error_cb)
+		if (((crc & 0xff) != data[4]) || (((crc >> 8) & 0xff) != data[5]))
 		{
-			drbcc->error_cb(drbcc->context, "Delete: partition table is to short!");
+			return PART_CRC_ERROR;
 		}
-		if (drbcc->session_cb)
+		if (len >= HASH_OFFSET + CHUNK)
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			libdrbcc_parse_hashes(&data[HASH_OFFSET], CHUNK, hash);
 		}
-		drbcc->session = 0;
-		return;
+		return PART_OK;
 	}
 
-	// check magic
-	if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1])) // Check partition table magic
+	// format 2
+	n = data[6] | (data[7] << 8);
+	if ((n > DRBCC_PART_ENTRIES) || (len < DRBCC_PART_V2_HEADER + n * DRBCC_PART_V2_ENTRY))
 	{
-		// TODO create partition table?
-
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "No magic in flash partition table");
-		}
-		if (drbcc->session_cb)
+		return PART_CRC_ERROR;
+	}
+	for (i = 0; i < n; i++)
+	{
+		const uint8_t *d = &data[DRBCC_PART_V2_HEADER + i * DRBCC_PART_V2_ENTRY];
+		uint32_t start = libdrbcc_get32(&d[2]);
+
+		e[i].type.typeinfo	= d[0];
+		e[i].startblock		= (uint16_t) start;
+		e[i].length			= libdrbcc_get32(&d[6]);
+		hash[i]				= libdrbcc_get32(&d[10]);
+		if (!isEmpty(e[i]) && (start >= DRBCC_MAX_BLOCKS))
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			// beyond the 16 MByte reachable with the 24 bit flash address
+			rc = PART_CRC_ERROR;
 		}
-		drbcc->session = 0;
-		return;
 	}
-
-	// check crc
-	for (i = 6; i < 126; i++)
+	for (i = 6; i < DRBCC_PART_V2_HEADER + n * DRBCC_PART_V2_ENTRY; i++)
 	{
 		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
 	}
 	if (((crc & 0xff) != data[4]) || (((crc >> 8) & 0xff) != data[5]))
 	{
-		// TODO repair partition table?
-
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "CRC error in flash partition table");
-		}
+		return PART_CRC_ERROR;
 	}
-	// ignore version info
+	return rc;
+}
 
-	// delete entry
-	if((drbcc->curFileIndex & 0x80000000) == 0)
+// epoch of a table with the journal flag, -1: journal not used
+static int libdrbcc_partition_epoch(const uint8_t data[])
+{
+	int i = (data[2] == 2) ? 8 : 126;
+
+	if ((data[3] & DRBCC_PART_JOURNAL) && ((uint8_t) (data[i] ^ data[i + 1]) == 0xFF))
 	{
-		// delete file by partition table index
-		data[6 + (drbcc->curFileIndex * 6)] = 0xFF;
-		data[7 + (drbcc->curFileIndex * 6)] = 0xFF;
-		data[8 + (drbcc->curFileIndex * 6)] = 0xFF;
-		data[9 + (drbcc->curFileIndex * 6)] = 0xFF;
-		data[10 + (drbcc->curFileIndex * 6)] = 0xFF;
-		data[11 + (drbcc->curFileIndex * 6)] = 0xFF;
+		return data[i];
 	}
-	else
-	{
-		// delete file by file type
-		for (i = 0; i < 20; i++)
-		{
-			DRBCC_PARTENTRY_t e_curr;
-			e_curr.type.typeinfo = data[6 + i*6];
-			e_curr.startblock    = data[6 + i*6+1] | (data[6 + i*6+2] << 8);
-			e_curr.length        = data[6 + i*6+3] | (data[6 + i*6+4] << 8) | (data[6 + i*6+5] << 16); // size in blocks or bytes
+	return -1;
+}
 
-			// reuse entry of same type
-			if ((e_curr.type.bits.type == (drbcc->curFileType & 0x07)) &&
-				(e_curr.type.bits.blocktype == ((drbcc->curFileType>>3) & 0x01)) &&
-				(e_curr.type.bits.idx == (drbcc->curFileIndex & 0xF)))
-			{
-				data[6 + i * 6 + 0] = 0xFF;
-				data[6 + i * 6 + 1] = 0xFF;
-				data[6 + i * 6 + 2] = 0xFF;
-				data[6 + i * 6 + 3] = 0xFF;
-				data[6 + i * 6 + 4] = 0xFF;
-				data[6 + i * 6 + 5] = 0xFF;
-				break;
-			}
-		}
-	}
+// encode e[] into the raw table format 1
+void libdrbcc_build_partition(const DRBCC_PARTENTRY_t e[], uint8_t data[128])
+{
+	int i = 0;
+	int j;
+	uint16_t crc = 0xffff;
+
+	memset(data, 0xFF, 128);
+
+	data[i++] = DRBCC_PART_MAGIC1;	// magic
+	data[i++] = DRBCC_PART_MAGIC2;
+	data[i++] = 1;		// version
+	data[i++] = 0;
+	i++;				// crc
+	i++;
 
-	crc = 0xffff;
+	for (j = 0; j < DRBCC_PART_V1_ENTRIES; j++)
+	{
+		data[i++] = e[j].type.typeinfo;
+		data[i++] = (uint8_t) ((e[j].startblock >> 0) & 0xFF);
+		data[i++] = (uint8_t) ((e[j].startblock >> 8) & 0xFF);
+		data[i++] = (uint8_t) ((e[j].length >>  0) & 0xFF);
+		data[i++] = (uint8_t) ((e[j].length >>  8) & 0xFF);
+		data[i++] = (uint8_t) ((e[j].length >> 16) & 0xFF);
+	}
 	for (i = 6; i < 126; i++)
 	{
 		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
 	}
 	data[4] = (uint8_t) (crc & 0xFF);
 	data[5] = (uint8_t) ((crc >> 8) & 0xFF);
-
-	libdrbcc_req_flash_erase_block(drbcc, 1);
-	libdrbcc_req_flash_write(drbcc, 4096, 128, data);
-	libdrbcc_req_flash_erase_block(drbcc, 0);
-	libdrbcc_req_flash_write(drbcc, 0, 128, data);
 }
 
-void libdrbcc_get_file(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+void libdrbcc_build_hashes(const uint32_t hash[], uint8_t data[128])
 {
-	int i;
+	int i = 0;
+	int j;
 	uint16_t crc = 0xffff;
 
-	// check addr
-	if (addr != 0) // requested data
+	memset(data, 0xFF, 128);
+
+	data[i++] = HASH_MAGIC1;
+	data[i++] = HASH_MAGIC2;
+	for (j = 0; j < DRBCC_PART_V1_ENTRIES; j++)
 	{
-		int fd = open(drbcc->curFilename, O_RDWR | O_CREAT | OX_BINARY, 0666 );
-		if (fd != -1)
-		{
-			ssize_t wr;
-			if (-1 == lseek(fd, addr - drbcc->curFilestart, SEEK_SET))
-			{
-				if (drbcc->error_cb)
-				{
-					drbcc->error_cb(drbcc->context, "lseek to offset in file failed");
-				}
-				if (drbcc->session_cb)
-				{
-					drbcc->session_cb(drbcc->context, drbcc->session, 1);
-				}
-				drbcc->session = 0;
-				TRACE_WARN("lseek to offset %u in file %s failed", addr, drbcc->curFilename);
-			}
-			else if ((ssize_t)len == (wr = write(fd, data, len)))
-			{
-				drbcc->curFilelength += len;
+		libdrbcc_put32(&data[i], hash[j]);
+		i += 4;
+	}
+	for (j = 2; j < i; j++)
+	{
+		crc = libdrbcc_crc_ccitt_update(crc, data[j]);
+	}
+	data[i++] = (uint8_t) (crc & 0xFF);
+	data[i++] = (uint8_t) ((crc >> 8) & 0xFF);
+}
 
-				if (drbcc->progress_cb)
-				{
-					drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
-				}
-				if (drbcc->curFilelength == drbcc->maxFilelength)
-				{
-					drbcc->state = DRBCC_STATE_USER;
-					if (drbcc->error_cb)
-					{
-						drbcc->error_cb(drbcc->context, "Get flash file successfully done");
-					}
-					if (drbcc->session_cb)
-					{
-						drbcc->session_cb(drbcc->context, drbcc->session, 1);
-					}
-					drbcc->session = 0;
-				}
-				else
-				{
-					libdrbcc_req_flash_read(drbcc, drbcc->flashAddr, drbcc->flashLen);
-				}
-			}
-			else
-			{
-				TRACE_WARN("writing flash data to file %s failed", drbcc->curFilename);
-				if (drbcc->error_cb)
-				{
-					char s[512];
-					memset(s, 0, sizeof(s));
-					snprintf(s, sizeof(s)-1, "writing %d byte(s) flash data to file %s failed. write returned %zd", len, drbcc->curFilename, wr);
-					drbcc->error_cb(drbcc->context, s);
-				}
-				if (drbcc->session_cb)
-				{
-					drbcc->session_cb(drbcc->context, drbcc->session, 1);
-				}
-				drbcc->session = 0;
-			}
-			close(fd);
-			return;
-		}
-		else
+// encode e[] and hash[] into the layout of a table copy in flash, returns the number of bytes
+// epoch >= 0: set the journal flag
+static unsigned int libdrbcc_build_table(const DRBCC_PARTENTRY_t e[], const uint32_t hash[], int version, int epoch, uint8_t data[DRBCC_PART_SIZE])
+{
+	unsigned int i;
+	unsigned int len = DRBCC_PART_V2_HEADER + DRBCC_PART_ENTRIES * DRBCC_PART_V2_ENTRY;
+	uint16_t crc = 0xffff;
+
+	memset(data, 0xFF, DRBCC_PART_SIZE);
+
+	if (version != 2)
+	{
+		libdrbcc_build_partition(e, data);
+		libdrbcc_build_hashes(hash, &data[HASH_OFFSET]);
+		if (epoch >= 0)
 		{
-			TRACE_WARN("open file %s failed", drbcc->curFilename);
-			if (drbcc->error_cb)
-			{
-				drbcc->error_cb(drbcc->context, "open file failed");
-			}
-			if (drbcc->session_cb)
-			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 1);
-			}
-			drbcc->session = 0;
-			return;
+			// older readers ignore the version flag and the epoch bytes
+			data[3] |= DRBCC_PART_JOURNAL;
+			data[126] = (uint8_t) epoch;
+			data[127] = (uint8_t) ~epoch;
 		}
+		return HASH_OFFSET + CHUNK;
 	}
 
-	// check magic
-	if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1])) // Check partition table magic
+	data[0] = DRBCC_PART_MAGIC1;
+	data[1] = DRBCC_PART_MAGIC2;
+	data[2] = 2;		// version
+	data[3] = 0;		// flags
+	data[6] = (uint8_t) (DRBCC_PART_ENTRIES & 0xFF);
+	data[7] = (uint8_t) ((DRBCC_PART_ENTRIES >> 8) & 0xFF);
+	if (epoch >= 0)
 	{
-		// TODO create partition table?
-
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "No magic in flash partition table");
-		}
-		if (drbcc->session_cb)
-		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
-		}
-		drbcc->session = 0;
-		return;
+		data[3] |= DRBCC_PART_JOURNAL;
+		data[8] = (uint8_t) epoch;
+		data[9] = (uint8_t) ~epoch;
 	}
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		uint8_t *d = &data[DRBCC_PART_V2_HEADER + i * DRBCC_PART_V2_ENTRY];
 
-	// check crc
-	for (i = 6; i < 126; i++)
+		d[0] = e[i].type.typeinfo;
+		// d[1]: entry flags, none defined yet
+		libdrbcc_put32(&d[2], e[i].startblock);
+		libdrbcc_put32(&d[6], e[i].length);
+		libdrbcc_put32(&d[10], hash[i]);
+	}
+	for (i = 6; i < len; i++)
 	{
 		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
 	}
-	if (((crc & 0xff) != data[4]) || (((crc >> 8) & 0xff) != data[5]))
-	{
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "CRC error in flash partition table");
-		}
-	}
+	data[4] = (uint8_t) (crc & 0xFF);
+	data[5] = (uint8_t) ((crc >> 8) & 0xFF);
+	return len;
+}
 
-	DRBCC_PARTENTRY_t e;
-	memset(&e, 0xFF, sizeof(e));
+static uint32_t libdrbcc_hash_done(uint32_t hash)
+{
+	// DRBCC_HASH_UNKNOWN is reserved
+	return (hash == DRBCC_HASH_UNKNOWN) ? DRBCC_HASH_UNKNOWN - 1 : hash;
+}
 
+int libdrbcc_file_hash(const char *filename, uint32_t *hash)
+{
+	uint8_t buf[0x1000];
+	ssize_t n;
+	int fd = open(filename, O_RDONLY | OX_BINARY);
 
-	if((drbcc->curFileIndex & 0x80000000) == 0)
+	if (fd == -1)
 	{
-		// get file by partition table index
-		data += (6 + drbcc->curFileIndex * 6);
-
-		e.type.typeinfo	= data[0];
-		e.startblock	= data[1] | (data[2] << 8);
-		e.length	= data[3] | (data[4] << 8) | (data[5] << 16); // size in blocks or bytes
-
-		drbcc->curFilelength = 0;
-		drbcc->maxFilelength = e.length;
+		return -1;
 	}
-	else
+	*hash = DRBCC_HASH_INIT;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
 	{
-		// get file by file type
-		data += 6;
-		for (i = 0; i < 20; i++)
-		{
-			DRBCC_PARTENTRY_t e_curr;
-			e_curr.type.typeinfo = data[i*6];
-			e_curr.startblock    = data[i*6+1] | (data[i*6+2] << 8);
-			e_curr.length        = data[i*6+3] | (data[i*6+4] << 8) | (data[i*6+5] << 16); // size in blocks or bytes
-
-			// reuse entry of same type
-			if ((e_curr.type.bits.type == (drbcc->curFileType & 0x07)) &&
-				(e_curr.type.bits.blocktype == ((drbcc->curFileType>>3) & 0x01)) &&
-				(e_curr.type.bits.idx == (drbcc->curFileIndex & 0xF)))
-			{
-				e.type.typeinfo      = e_curr.type.typeinfo;
-				e.startblock         = e_curr.startblock;
-				e.length             = e_curr.length;
-				drbcc->curFilelength = 0;
-				drbcc->maxFilelength = e.length;
-				break;
-			}
-		}
+		*hash = libdrbcc_fnv1a_update(*hash, buf, n);
 	}
-
-	if ((!isEmpty(e)) && (e.length > 0))
+	close(fd);
+	if (n < 0)
 	{
-		drbcc->curFilestart = e.startblock * 0x1000;
+		return -1;
+	}
+	*hash = libdrbcc_hash_done(*hash);
+	return 0;
+}
 
-		if (e.type.bits.blocktype)
-		{
-			drbcc->maxFilelength = e.length * 0x1000;
+static int libdrbcc_same_entry(const DRBCC_PARTENTRY_t *a, const DRBCC_PARTENTRY_t *b)
+{
+	return (a->type.typeinfo == b->type.typeinfo) && (a->startblock == b->startblock) && (a->length == b->length);
+}
 
-			libdrbcc_req_flash_read(drbcc, drbcc->curFilestart, drbcc->maxFilelength);
-		}
-		else
-		{
-			drbcc->maxFilelength = e.length;
+static int libdrbcc_same_table(const DRBCC_PARTENTRY_t a[], const DRBCC_PARTENTRY_t b[])
+{
+	int i;
 
-			libdrbcc_req_flash_read(drbcc, drbcc->curFilestart, drbcc->maxFilelength);
-		}
-	}
-	else
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 	{
-		if (drbcc->error_cb)
+		if (!libdrbcc_same_entry(&a[i], &b[i]))
 		{
-			if (isEmpty(e))
-			{
-				drbcc->error_cb(drbcc->context, "Invalid flash file, empty entry");
-			}
-			else
-			{
-				drbcc->error_cb(drbcc->context, "Invalid flash file, size 0");
-			}
-			if (drbcc->session_cb)
-			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 1);
-			}
+			return 0;
 		}
-		drbcc->session = 0;
-		drbcc->state = DRBCC_STATE_USER;
 	}
+	return 1;
+}
+
+// size of a journal record in the given table format
+static unsigned int libdrbcc_record_size(int version)
+{
+	return (version == 2) ? JOURNAL_RECORD_V2 : JOURNAL_RECORD;
 }
 
-void libdrbcc_put_file(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+// encode entry i of e[] with its hash into a journal record of the current table format
+static void libdrbcc_build_record(const DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], const uint32_t hash[], int i, int last, uint8_t d[])
 {
-	unsigned int i, j;
-	int k;
+	int j;
 	uint16_t crc = 0xffff;
 
-	// check addr
-	if (addr != 0)
+	memset(d, 0xFF, libdrbcc_record_size(drbcc->partVersion));
+	d[0] = JOURNAL_MAGIC;
+	d[1] = (uint8_t) drbcc->journalEpoch;
+	d[2] = (uint8_t) (i | (last ? JOURNAL_LAST : 0));
+	d[3] = e[i].type.typeinfo;
+
+	if (drbcc->partVersion == 2)
 	{
-		if (drbcc->error_cb)
+		// d[4]: entry flags
+		libdrbcc_put32(&d[5], e[i].startblock);
+		libdrbcc_put32(&d[9], e[i].length);
+		libdrbcc_put32(&d[13], hash[i]);
+		for (j = 0; j < 17; j++)
 		{
-			drbcc->error_cb(drbcc->context, "Wrong flash space used for partition table!");
-		}
-		if (drbcc->session_cb)
-		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			crc = libdrbcc_crc_ccitt_update(crc, d[j]);
 		}
-		drbcc->session = 0;
+		d[17] = (uint8_t) (crc & 0xFF);
+		d[18] = (uint8_t) ((crc >> 8) & 0xFF);
 		return;
 	}
 
-	// check magic
-	if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1])) // Check partition table magic
+	d[4] = (uint8_t) ((e[i].startblock >> 0) & 0xFF);
+	d[5] = (uint8_t) ((e[i].startblock >> 8) & 0xFF);
+	d[6] = (uint8_t) ((e[i].length >>  0) & 0xFF);
+	d[7] = (uint8_t) ((e[i].length >>  8) & 0xFF);
+	d[8] = (uint8_t) ((e[i].length >> 16) & 0xFF);
+	libdrbcc_put32(&d[11], hash[i]);
+	for (j = 0; j < JOURNAL_RECORD - 1; j++)
 	{
-		// TODO create partition table?
-
-		if (drbcc->error_cb)
+		if ((j != 9) && (j != 10))
 		{
-			drbcc->error_cb(drbcc->context, "No magic in flash partition table");
-		}
-		if (drbcc->session_cb)
-		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			crc = libdrbcc_crc_ccitt_update(crc, d[j]);
 		}
-		drbcc->session = 0;
-		return;
 	}
+	d[9] = (uint8_t) (crc & 0xFF);
+	d[10] = (uint8_t) ((crc >> 8) & 0xFF);
+}
 
-	// check crc
-	for (i = 6; i < 126; i++)
+// apply a journal record to e[] and hash[], returns the index byte or RECORD_EMPTY/RECORD_INVALID
+static int libdrbcc_parse_record(const DRBCC_t *drbcc, const uint8_t d[], DRBCC_PARTENTRY_t e[], uint32_t hash[])
+{
+	int i;
+	int j;
+	int v2 = (drbcc->partVersion == 2);
+	int c = v2 ? 17 : 9;	// offset of the crc
+	uint16_t crc = 0xffff;
+
+	if (d[0] == 0xFF)
 	{
-		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
+		return RECORD_EMPTY;
 	}
-	if (((crc & 0xff) != data[4]) || (((crc >> 8) & 0xff) != data[5]))
+
+	for (j = 0; j < (v2 ? 17 : JOURNAL_RECORD - 1); j++)
 	{
-		if (drbcc->error_cb)
+		if ((j != c) && (j != c + 1))
 		{
-			drbcc->error_cb(drbcc->context, "CRC error in flash partition table");
+			crc = libdrbcc_crc_ccitt_update(crc, d[j]);
 		}
 	}
+	i = d[2] & ~JOURNAL_LAST;
+	if ((d[0] != JOURNAL_MAGIC) || (d[1] != (uint8_t) drbcc->journalEpoch) || (i >= (int) libdrbcc_table_entries(drbcc->partVersion)) ||
+		((crc & 0xff) != d[c]) || (((crc >> 8) & 0xff) != d[c + 1]) ||
+		(v2 && ((d[3] >> 4) != EMPTY_ENTRY) && (libdrbcc_get32(&d[5]) >= DRBCC_MAX_BLOCKS)))
+	{
+		// damaged, left over from an older epoch or beyond the 16 MByte reachable with the 24 bit flash address
+		return RECORD_INVALID;
+	}
 
-	int emptyEntry = -1;
-	uint8_t blocks[1024];
-	int endblock;
-	DRBCC_PARTENTRY_t e[20];
+	e[i].type.typeinfo = d[3];
+	if (v2)
+	{
+		e[i].startblock	= (uint16_t) libdrbcc_get32(&d[5]);
+		e[i].length		= libdrbcc_get32(&d[9]);
+		hash[i]			= libdrbcc_get32(&d[13]);
+	}
+	else
+	{
+		e[i].startblock	= d[4] | (d[5] << 8);
+		e[i].length		= d[6] | (d[7] << 8) | (d[8] << 16);
+		hash[i]			= libdrbcc_get32(&d[11]);
+	}
+	return d[2];
+}
 
-	memset(blocks, 0, sizeof(blocks));
-	blocks[0] = 1; // used for partition table
-	blocks[1] = 1; // reserved
-	blocks[2] = 1; // reserved
-	blocks[3] = 1; // reserved
+// queue the write of table data in chunks not crossing a 128 byte boundary, returns the number of chunks
+static int libdrbcc_write_table_data(DRBCC_t *drbcc, unsigned int addr, unsigned int len, uint8_t *data)
+{
+	int n = 0;
 
-	// Build partition table and find empty entry
-	data += 6;
-	for (i = 0; i < 20; i++)
+	while (len > 0)
 	{
-		e[i].type.typeinfo	= data[i*6];
-		e[i].startblock		= data[i*6+1] | (data[i*6+2] << 8);
-		e[i].length			= data[i*6+3] | (data[i*6+4] << 8) | (data[i*6+5] << 16); // size in blocks or bytes
+		unsigned int size = CHUNK - addr % CHUNK;
 
-		if ((emptyEntry == -1) && (isEmpty(e[i])))
+		if (size > len)
 		{
-			emptyEntry = i;
+			size = len;
 		}
-
-		// reuse entry of same type
-		if ((e[i].type.bits.type == (drbcc->curFileType & 0x07)) &&
-			(e[i].type.bits.blocktype == ((drbcc->curFileType>>3) & 0x01)) &&
-			(e[i].type.bits.idx  == drbcc->curFileIndex))
+		if (DRBCC_RC_NOERROR != libdrbcc_req_flash_write(drbcc, addr, size, data))
 		{
-			emptyEntry = i;
-			e[i].type.typeinfo = 0xFF;
+			return -1;
 		}
+		addr += size;
+		data += size;
+		len -= size;
+		n++;
+	}
+	return n;
+}
 
-		if (!isEmpty(e[i]))
+// append the entries of e[] differing from the cached table as one record group
+// 0: journal full or the table format changes
+static int libdrbcc_append_journal(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], const uint32_t hash[])
+{
+	uint8_t data[DRBCC_PART_ENTRIES * JOURNAL_RECORD_V2];
+	int changed[DRBCC_PART_ENTRIES];
+	int i;
+	int n = 0;
+	unsigned int size = libdrbcc_record_size(drbcc->partVersion);
+	unsigned int len, last;
+
+	if (!drbcc->partValid || drbcc->journalPos == 0 || libdrbcc_write_version(drbcc, e) != drbcc->partVersion)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		if (!libdrbcc_same_entry(&e[i], &drbcc->partTable[i]) || (hash[i] != drbcc->partHash[i]))
 		{
-			if (e[i].type.bits.blocktype)
-			{
-				endblock = e[i].startblock + e[i].length;
-			}
-			else
-			{
-				endblock = e[i].startblock + ((e[i].length + 0xfff) / 0x1000);
-			}
-			// mark used blocks
-			for (k = e[i].startblock; k < endblock; k++)
-			{
-				blocks[k] = 1;
-			}
+			changed[n++] = i;
 		}
 	}
+	if (n == 0)
+	{
+		// nothing changed, an update is written anyway to complete the operation
+		changed[n++] = 0;
+	}
+
+	len = n * size;
+	if (drbcc->journalPos + len > JOURNAL_END)
+	{
+		return 0;
+	}
+	for (i = 0; i < n; i++)
+	{
+		libdrbcc_build_record(drbcc, e, hash, changed[i], i == n - 1, &data[i * size]);
+	}
+	if (libdrbcc_write_table_data(drbcc, drbcc->journalPos, len, data) < 0)
+	{
+		return 0;
+	}
 
-	//libdrbcc_dump(blocks, sizeof(blocks));
+	// the write is split at 128 byte boundaries
+	last = drbcc->journalPos + len - 1;
+	last -= last % CHUNK;
+	drbcc->partWriteAddr = (last > drbcc->journalPos) ? last : drbcc->journalPos;
 
-	FREE_USED_TABLE_t free_used[40];
-	int last = 1; // we start with used blocks (partition table & reserved)
-	j = 0;
+	TRACE(DRBCC_TR_TRANS, "%i partition table entries journaled at 0x%04X", n, drbcc->journalPos);
+	drbcc->journalPos += len;
+	return 1;
+}
 
-	if (emptyEntry == -1)
+// content hashes of e[]: the cached hash for entries unchanged against the cached table, unknown otherwise
+static void libdrbcc_table_hashes(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], uint32_t h[])
+{
+	int i;
+
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 	{
-		if (drbcc->error_cb)
+		h[i] = DRBCC_HASH_UNKNOWN;
+		if (drbcc->partValid &&
+			(libdrbcc_same_entry(&e[i], &drbcc->partTable[i]) ||
+			// moved by the flash compaction, same content
+			((drbcc->state == DRBCC_STATE_COMPACT_FLASH) && (e[i].type.typeinfo == drbcc->partTable[i].type.typeinfo) &&
+			 (e[i].length == drbcc->partTable[i].length))))
 		{
-			drbcc->error_cb(drbcc->context, "Put flash file failed, partition table full");
-		}
-		if (drbcc->session_cb)
-		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			h[i] = drbcc->partHash[i];
 		}
-		drbcc->session = 0;
-		drbcc->state = DRBCC_STATE_USER;
-		return;
 	}
-	else
+}
+
+// queue the update of the table and take e[] with the content hashes h[] as the new cached table
+// journal enabled: append the changed entries to the journal, rewrite the table if the journal is full
+// table rewrite: update both copies (backup first), with the journal flag and a new epoch
+// all records written so far are invalid then, older readers ignore the flag
+// the table is written in format 2 if selected or if entries beyond the format 1 table are used
+static void libdrbcc_write_partition_hashes(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], const uint32_t h[])
+{
+	uint8_t data[DRBCC_PART_SIZE];
+
+	if (!drbcc->partJournal || !libdrbcc_append_journal(drbcc, e, h))
 	{
-		// collect free and used in blocks table
-		for (i = 4; i < 1024; i++)
+		int version = libdrbcc_write_version(drbcc, e);
+		unsigned int len;
+
+		if (drbcc->partJournal)
 		{
-			if (blocks[i] && last)
-			{
-				free_used[j].end = i;
-			}
-			else if (blocks[i])
-			{
-				j++;
-				last = 1;
-				free_used[j].start = i;
-				free_used[j].end = i;
-				free_used[j].free = 0;
-			}
-			else if (last)
-			{
-				j++;
-				last = 0;
-				free_used[j].start = i;
-				free_used[j].end = i;
-				free_used[j].free = 1;
-			}
-			else
-			{
-				free_used[j].end = i;
-			}
+			drbcc->journalEpoch = (drbcc->journalEpoch + 1) & 0xFF;
 		}
-
-		int requiredBlocks = (drbcc->maxFilelength + 0xfff) / 0x1000;
-		int foundsize = 0, found = 0;
-
-		// find best fitting area in used/free table
-		for (i = 0; i <= j; i++)
+		len = libdrbcc_build_table(e, h, version, drbcc->partJournal ? (int) drbcc->journalEpoch : -1, data);
+
+		//libdrbcc_dump(data, len);
+		libdrbcc_req_flash_erase_block(drbcc, 1);
+		libdrbcc_write_table_data(drbcc, 4096, len, data);
+		libdrbcc_req_flash_erase_block(drbcc, 0);
+		libdrbcc_write_table_data(drbcc, 0, len, data);
+		drbcc->partWriteAddr = ((len - 1) / CHUNK) * CHUNK;
+		drbcc->partVersion = version;
+		drbcc->journalPos = 0;
+
+		if (drbcc->partJournal)
 		{
-			int blocksize = (free_used[i].end - free_used[i].start) + 1;
-			//fprintf(stderr, "start 0x%06x, end 0x%06x, size %i, free: %u\n", free_used[i].start, free_used[i].end, blocksize, free_used[i].free);
-
-			if (free_used[i].free && (blocksize >= requiredBlocks))
-			{
-				if (found)
-				{
-					if (blocksize < foundsize)
-					{
-						// this one is better
-						found = i;
-						foundsize = blocksize;
-					}
-				}
-				else
-				{
-					found = i;
-					foundsize = blocksize;
-				}
-			}
+			// erase the records of the old epoch after the new table is written
+			libdrbcc_req_flash_erase_block(drbcc, JOURNAL_START / 0x1000);
+			libdrbcc_req_flash_erase_block(drbcc, JOURNAL_START / 0x1000 + 1);
+			drbcc->journalPos = JOURNAL_START;
 		}
+	}
 
+	memcpy(drbcc->partTable, e, sizeof(drbcc->partTable));
+	memcpy(drbcc->partHash, h, sizeof(drbcc->partHash));
+	drbcc->partValid = 1;
+	drbcc->partGeneration++;
+	TRACE(DRBCC_TR_TRANS, "partition table generation %u written (format %i)", drbcc->partGeneration, drbcc->partVersion);
+}
 
-		/*fprintf(stderr, "found %i for %i blocks start 0x%06x, end 0x%06x, free: %u using pos %i in partition table\n", found, requiredBlocks,
-			free_used[found].start, free_used[found].end, free_used[found].free, emptyEntry);*/
+// queue the update of the table, see libdrbcc_write_partition_hashes
+// the content hash of entry is set to hash, other changed entries get an unknown hash
+static void libdrbcc_write_partition(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], int entry, uint32_t hash)
+{
+	uint32_t h[DRBCC_PART_ENTRIES];
 
-		if (found > 0)
-		{
-			uint8_t buf[CHUNK];
-			int fd = open(drbcc->curFilename, O_RDONLY | OX_BINARY);
+	libdrbcc_table_hashes(drbcc, e, h);
+	if ((entry >= 0) && (entry < DRBCC_PART_ENTRIES))
+	{
+		h[entry] = hash;
+	}
+	libdrbcc_write_partition_hashes(drbcc, e, h);
+}
 
-			unsigned int write_addr = free_used[found].start * 0x1000;
+void libdrbcc_invalidate_partition(DRBCC_t *drbcc)
+{
+	drbcc->partValid = 0;
+}
 
-			if (fd != -1)
-			{
-				for (i = 0; i < drbcc->maxFilelength; i += CHUNK)
-				{
-					if (i % 0x1000 == 0) // new block
-					{
-						//fprintf(stderr, "erase data block %i\n", (i / 0x1000) + free_used[found].start);
-						libdrbcc_req_flash_erase_block(drbcc, (i / 0x1000) + free_used[found].start);
-					}
+void libdrbcc_default_partition(DRBCC_PARTENTRY_t e[])
+{
+	memset(e, 0xFF, DRBCC_PART_ENTRIES * sizeof(DRBCC_PARTENTRY_t));
 
-					DRBCC_MESSAGE_t *msg = malloc(sizeof(DRBCC_MESSAGE_t));
+	// dieser Eintrag ist ein reiner Platzhalter, die BCTRL-Firmware ist auf diesen Bereich 'festverdrahtet' (MRE 11.4.2012)
+	// Werte NICHT ndern, der BCTRL schreibt die Logdaten IMMER in diesen Bereich!!!!
+	e[0].type.bits.blocktype = 1;
+	e[0].type.bits.type = DRBCC_FLASHBLOCK_T_RING_LOG;
+	e[0].type.bits.idx = 0;
+	e[0].startblock = 4;
+	e[0].length = 508;
 
-					if (msg != NULL)
-					{
-						ssize_t rd;
-						if (write_addr + CHUNK <= (free_used[found].start * 0x1000) + drbcc->maxFilelength)
-						{
-							len = (uint8_t) CHUNK;
-						}
-						else
-						{
-							len = (uint8_t) (drbcc->maxFilelength % CHUNK);
-						}
-						msg->msg_len = 5 + len;
-						msg->msg[0] = DRBCC_REQ_EXTFLASH_WRITE;
-						msg->msg[1] = (uint8_t) ((write_addr >> 16) & 0xFF);
-						msg->msg[2] = (uint8_t) ((write_addr >>  8) & 0xFF);
-						msg->msg[3] = (uint8_t) ((write_addr >>  0) & 0xFF);
-						msg->msg[4] = (uint8_t) len;
-
-						//fprintf(stderr, " sending %x , %i\n", write_addr, msg->msg[4]);
-						write_addr = write_addr + len;
-
-						rd = read(fd, buf, len);
-						if (rd == (ssize_t)len)
-						{
-							for (j = 0; j < len; j++)
-							{
-								msg->msg[5 + j] = buf[j];
-							}
-						}
-						else
-						{
-							if (drbcc->error_cb)
-							{
-								char s[512];
-								memset(s, 0, sizeof(s));
-								sprintf(s, "Cant read %d bytes from file during put flash file operation. read returned %zd", len, rd);
-								drbcc->error_cb(drbcc->context, s);
-							}
-							if (drbcc->session_cb)
-							{
-								drbcc->session_cb(drbcc->context, drbcc->session, 1);
-							}
-							drbcc->state = DRBCC_STATE_USER;
-							close(fd);
-							return;
-						}
-
-						libdrbcc_add_msg_sec(drbcc, msg);
-					}
-					else
-					{
-						if (drbcc->error_cb)
-						{
-							drbcc->error_cb(drbcc->context, "Out of memory during get file operation");
-						}
-						if (drbcc->session_cb)
-						{
-							drbcc->session_cb(drbcc->context, drbcc->session, 1);
-						}
-						drbcc->state = DRBCC_STATE_USER;
-						close(fd);
-						return;
-					}
-				}
-				close(fd);
+	// dieser Bereich ist ungenutzt
+	e[1].type.bits.blocktype = 1;
+	e[1].type.bits.type = DRBCC_FLASHBLOCK_T_PERS_LOG;
+	e[1].type.bits.idx = 0;
+	e[1].startblock = 512;
+	e[1].length = 64;
+}
 
-				TRACE(DRBCC_TR_TRANS, "change partition table entry %i start 0x%06x length %i", emptyEntry, free_used[found].start, drbcc->maxFilelength);
+int libdrbcc_log_area(const uint8_t data[], unsigned int len, unsigned int *startblock, unsigned int *blocks)
+{
+	DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+	uint32_t hash[DRBCC_PART_ENTRIES];
+	int found = (len >= CHUNK) && (PART_OK == libdrbcc_parse_partition(data, len, e, hash));
+	int i;
 
-				e[emptyEntry].type.bits.blocktype	= 0;
-				e[emptyEntry].type.bits.type		= drbcc->curFileType;
-				e[emptyEntry].type.bits.idx			= drbcc->curFileIndex;
-				e[emptyEntry].startblock			= free_used[found].start;
-				e[emptyEntry].length				= drbcc->maxFilelength;  // size in bytes
-
-				uint8_t data[128];
-				uint16_t crc = 0xffff;
-
-				i = 0;
-				data[i++] = DRBCC_PART_MAGIC1;	// magic
-				data[i++] = DRBCC_PART_MAGIC2;
-				data[i++] = 1;		// version
-				data[i++] = 0;
-				i++;				// crc
-				i++;
-
-				// build free_used
-				for (j = 0; j < 20; j++)
-				{
-					data[i++] = e[j].type.typeinfo;
-					data[i++] = (uint8_t) ((e[j].startblock >> 0) & 0xFF);
-					data[i++] = (uint8_t) ((e[j].startblock >> 8) & 0xFF);
-					data[i++] = (uint8_t) ((e[j].length >>  0) & 0xFF);
-					data[i++] = (uint8_t) ((e[j].length >>  8) & 0xFF);
-					data[i++] = (uint8_t) ((e[j].length >> 16) & 0xFF);
-				}
-				for (i = 6; i < 126; i++)
-				{
-					crc = libdrbcc_crc_ccitt_update(crc, data[i]);
-				}
-				data[4] = (uint8_t) (crc & 0xFF);
-				data[5] = (uint8_t) ((crc >> 8) & 0xFF);
-
-				//libdrbcc_dump(data, sizeof(data));
-				libdrbcc_req_flash_erase_block(drbcc, 1);
-				libdrbcc_req_flash_write(drbcc, 4096, 128, data);
-				libdrbcc_req_flash_erase_block(drbcc, 0);
-				libdrbcc_req_flash_write(drbcc, 0, 128, data);
-			}
-		}
-		else
+	if (found)
+	{
+		for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 		{
-			if (drbcc->error_cb)
-			{
-				drbcc->error_cb(drbcc->context, "Put flash file failed, no space left");
-			}
-			if (drbcc->session_cb)
+			if ((e[i].type.bits.type == DRBCC_FLASHBLOCK_T_RING_LOG) && (e[i].type.bits.blocktype == 0x01))
 			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 1);
+				*startblock = e[i].startblock;
+				*blocks = e[i].length;
+				return 1;
 			}
-			drbcc->session = 0;
-			drbcc->state = DRBCC_STATE_USER;
 		}
 	}
+	// the BCTRL firmware uses the default area anyway
+	libdrbcc_default_partition(e);
+	*startblock = e[0].startblock;
+	*blocks = e[0].length;
+	return 0;
 }
 
-static void handle_logentry(DRBCC_t *drbcc, unsigned int pos, int len, uint8_t* buf)
+void libdrbcc_create_partition(DRBCC_t *drbcc)
 {
-	if (0xFF == drbcc->logwrapflag)
+	DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+
+	libdrbcc_default_partition(e);
+	libdrbcc_write_partition(drbcc, e, -1, DRBCC_HASH_UNKNOWN);
+}
+
+// read the partition table from flash, even if a cached copy exists
+DRBCC_RC_t libdrbcc_read_partition(DRBCC_t *drbcc)
+{
+	// request 1st 128 Bytes of flash, the rest follows from the table header
+	drbcc->partRead = 1;
+	drbcc->partPos = 0;
+	drbcc->partDamaged = 0;
+	return libdrbcc_req_flash_read(drbcc, 0, CHUNK);
+}
+
+// find the entry selected by curFileIndex (partition table index or file type, see drbcc_get_file_type)
+static int libdrbcc_find_entry(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[])
+{
+	int i;
+
+	if ((drbcc->curFileIndex & 0x80000000) == 0)
 	{
-		if (pos < drbcc->start) { return; }
+		// by partition table index
+		return (drbcc->curFileIndex < DRBCC_PART_ENTRIES) ? (int) drbcc->curFileIndex : -1;
 	}
-	else
+
+	// by file type
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 	{
-		unsigned int curr_log_pos = drbcc->curFileIndex * 0x1000 / 16 + drbcc->logentry;
-		if (curr_log_pos > drbcc->start)
-		{
-			if(pos < drbcc->start) { return; }
-		}
-		else
+		if (isFile(e[i], drbcc->curFileType, drbcc->curFileIndex))
 		{
-			if((curr_log_pos < pos) && (pos < drbcc->start)) { return; }
+			return i;
 		}
 	}
-	if (drbcc->getlog_cb)
+	return -1;
+}
+
+static void libdrbcc_got_partition(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	drbcc->state = DRBCC_STATE_USER;
+	if (drbcc->partitiontable_cb)
 	{
-		drbcc->getlog_cb(drbcc->context, pos, len, &buf[0]);
+		drbcc->partitiontable_cb(drbcc->context, libdrbcc_table_entries(drbcc->partVersion), e);
 	}
+	libdrbcc_end_session(drbcc, NULL, 1);
 }
 
-static unsigned int calculate_start_addr_wrap(DRBCC_t *drbcc, unsigned int from_x, unsigned curr_log_pos)
+static void libdrbcc_delete(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
 {
-	unsigned start_addr;
+	int i = libdrbcc_find_entry(drbcc, e);
 
-	if(from_x >= curr_log_pos)
+	if (i >= 0)
 	{
-		unsigned int next_entry = drbcc->curFileIndex + 1;
-		next_entry %= (drbcc->maxFilelength / 0x1000); // take ring memory log into account
-		next_entry *= 0x1000; // block to addr offset
-		next_entry /= 16; // addr offset to entry index
+		memset(&e[i], 0xFF, sizeof(e[i]));
+	}
+	libdrbcc_write_partition(drbcc, e, -1, DRBCC_HASH_UNKNOWN);
+}
 
-		if(0 == next_entry) // was last block, ring starts now at offset 0
+// update crc with the bytes from..to-1 of a local file
+static int libdrbcc_file_crc(const char *filename, unsigned int from, unsigned int to, uint16_t *crc)
+{
+	uint8_t buf[0x1000];
+	int fd = open(filename, O_RDONLY | OX_BINARY);
+
+	if (fd == -1)
+	{
+		return -1;
+	}
+	if (-1 == lseek(fd, from, SEEK_SET))
+	{
+		close(fd);
+		return -1;
+	}
+	while (from < to)
+	{
+		unsigned int i;
+		unsigned int n = ((to - from) > sizeof(buf)) ? sizeof(buf) : (to - from);
+
+		if ((ssize_t)n != read(fd, buf, n))
 		{
-			drbcc->start = 0;
-			start_addr = 0;
-		}
-		else if(next_entry < from_x) // request entry is in upper ring buffer
-		{
-			drbcc->start = from_x;
-			start_addr = ((drbcc->start*16) & (~0x7F)); // alignment 128
+			close(fd);
+			return -1;
 		}
-		else // request entry is invalid, start with next valid entry
+		for (i = 0; i < n; i++)
 		{
-			drbcc->start = next_entry;
-			start_addr = (drbcc->start*16);
+			*crc = libdrbcc_crc_ccitt_update(*crc, buf[i]);
 		}
+		from += n;
 	}
-	else
+	close(fd);
+	return 0;
+}
+
+static int libdrbcc_checkpoint_enabled(DRBCC_t *drbcc)
+{
+	// the checkpoint crc is read from the local file
+	if ((drbcc->ioFd >= 0) || drbcc->ioMem)
 	{
-		drbcc->start = from_x;
-		start_addr = ((drbcc->start*16) & (~0x7F)); // alignment 128
+		return 0;
 	}
-	return start_addr;
+	return (drbcc->checkpoint != NULL) || drbcc->checkpointFile[0];
 }
 
-void libdrbcc_get_log(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+// replace the sidecar file atomically
+static void libdrbcc_write_sidecar(const char *sidecar, const void *data, unsigned int len)
 {
-	unsigned int i;
-	uint16_t crc = 0xffff;
+	char tmp[FILENAME_MAX + 4];
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", sidecar);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | OX_BINARY, 0666);
+	if ((fd == -1) ||
+		((ssize_t)len != write(fd, data, len)) ||
+		(0 != fsync(fd)) ||
+		(0 != rename(tmp, sidecar)))
+	{
+		TRACE_WARN("writing sidecar file %s failed", sidecar);
+	}
+	if (fd != -1)
+	{
+		close(fd);
+	}
+}
+
+static void libdrbcc_checkpoint_store(DRBCC_t *drbcc)
+{
+	if (drbcc->checkpoint)
+	{
+		memcpy(drbcc->checkpoint, &drbcc->cp, sizeof(DRBCC_CHECKPOINT_t));
+	}
+	if (drbcc->checkpointFile[0])
+	{
+		libdrbcc_write_sidecar(drbcc->checkpointFile, &drbcc->cp, sizeof(DRBCC_CHECKPOINT_t));
+	}
+}
+
+static void libdrbcc_checkpoint_begin(DRBCC_t *drbcc, int direction, uint8_t typeinfo, unsigned int startblock, unsigned int length)
+{
+	memset(&drbcc->cp, 0, sizeof(drbcc->cp));
+	drbcc->cp.magic			= DRBCC_CHECKPOINT_MAGIC;
+	drbcc->cp.direction		= direction;
+	drbcc->cp.typeinfo		= typeinfo;
+	drbcc->cp.startblock	= startblock;
+	drbcc->cp.length		= length;
+	drbcc->cp.offset		= 0;
+	drbcc->cp.crc			= 0xffff;
+
+	if (libdrbcc_checkpoint_enabled(drbcc))
+	{
+		libdrbcc_checkpoint_store(drbcc);
+	}
+}
+
+// the bytes up to offset of the current transfer are acknowledged, stored every 4K and at the end
+static void libdrbcc_checkpoint_update(DRBCC_t *drbcc, unsigned int offset)
+{
+	if (!libdrbcc_checkpoint_enabled(drbcc) || (offset <= drbcc->cp.offset))
+	{
+		return;
+	}
+	if ((offset % 0x1000) && (offset != drbcc->cp.length))
+	{
+		return;
+	}
+	if (libdrbcc_file_crc(drbcc->curFilename, drbcc->cp.offset, offset, &drbcc->cp.crc))
+	{
+		TRACE_WARN("checkpoint: reading file %s failed", drbcc->curFilename);
+		drbcc->cp.magic = 0;
+	}
+	drbcc->cp.offset = offset;
+	libdrbcc_checkpoint_store(drbcc);
+}
+
+// transfer complete, nothing to resume
+static void libdrbcc_checkpoint_clear(DRBCC_t *drbcc)
+{
+	if (!libdrbcc_checkpoint_enabled(drbcc))
+	{
+		return;
+	}
+	drbcc->cp.magic = 0;
+	if (drbcc->checkpoint)
+	{
+		memcpy(drbcc->checkpoint, &drbcc->cp, sizeof(DRBCC_CHECKPOINT_t));
+	}
+	if (drbcc->checkpointFile[0])
+	{
+		unlink(drbcc->checkpointFile);
+	}
+}
+
+static void libdrbcc_get_file(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	DRBCC_PARTENTRY_t entry;
+	int i = libdrbcc_find_entry(drbcc, e);
+
+	memset(&entry, 0xFF, sizeof(entry));
+	if (i >= 0)
+	{
+		entry = e[i];
+	}
 
-	// check addr
-	if (addr != 0)
+	if ((!isEmpty(entry)) && (entry.length > 0))
 	{
-		unsigned pos = (addr - drbcc->curFilestart) / 16;
-		for (i = 0; i+16 <= len; i += 16)
+		drbcc->curFilelength = 0;
+		drbcc->curFilestart = entry.startblock * 0x1000;
+
+		if (entry.type.bits.blocktype)
 		{
-			if (data[i] != 0xff)
-			{
-				if (data[i] != DRBCC_E_EXTENSION)
-				{
-					// if (data[i + 1] == 0xff) this is a invalid entry made by AVR programmer
-					if ((data[i + 1] != 0xff) && (data[i + 8] > sizeof(drbcc->dlpf.data)))
-					{
-						if (drbcc->logdata)
-						{
-							free(drbcc->logdata);
-						}
-						drbcc->logdata = malloc(data[i + 8] * 3);
-						memcpy(drbcc->logdata, &data[i], 16);
-						drbcc->logrest = data[i + 8] - sizeof(drbcc->dlpf.data);
-						drbcc->logindex = 16;
-						drbcc->logpos = (pos + i/16);
-					}
-					else
-					{
-						handle_logentry(drbcc, pos + i/16, data[i+8]+9, &data[i]);
-					}
-				}
-				else
-				{
-					if(NULL == drbcc->logdata)
-					{
-						// unexpected extention log
-						handle_logentry(drbcc, pos + i/16, 16, &data[i]);
-					}
-					// extension log seq ...
-					else if (drbcc->logrest > 15)
-					{
-						memcpy(drbcc->logdata + drbcc->logindex, &data[i + 1], 15);
-						drbcc->logindex += 15;
-						drbcc->logrest -= 15;
-					}
-					else
-					{
-						memcpy(drbcc->logdata + drbcc->logindex, &data[i + 1], drbcc->logrest);
-						// complete
-						handle_logentry(drbcc, drbcc->logpos, drbcc->logdata[8]+9, drbcc->logdata);
-						free(drbcc->logdata);
-						drbcc->logdata = NULL;
-					}
-				}
-			}
-			else  // empty log entry
-			{
-				// stop getting more data
-				if ((addr + i) == (drbcc->curFilestart + drbcc->curFileIndex * 0x1000 + drbcc->logentry * 16))
-				{
-					drbcc->state = DRBCC_STATE_USER;
-					if (drbcc->session_cb)
-					{
-						drbcc->session_cb(drbcc->context, drbcc->session, 1);
-					}
-					drbcc->session = 0;
-					return;
-				}
-			}
+			drbcc->maxFilelength = entry.length * 0x1000;
+		}
+		else
+		{
+			drbcc->maxFilelength = entry.length;
 		}
 
-
-		if ((addr + 128) == (drbcc->curFilestart + drbcc->curFileIndex * 0x1000 + drbcc->logentry * 16))
+		if (drbcc->ioMem && (drbcc->maxFilelength > drbcc->ioSize))
 		{
-			drbcc->state = DRBCC_STATE_USER;
-			if (drbcc->session_cb)
-			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 1);
-			}
-			drbcc->session = 0;
+			libdrbcc_end_session(drbcc, "Get flash file failed, buffer too small", 1);
 			return;
 		}
 
-		if ((addr + 128) == (drbcc->curFilestart + drbcc->maxFilelength)) // end of ring
+		if (!drbcc->resume)
+		{
+			libdrbcc_checkpoint_begin(drbcc, 0, entry.type.typeinfo, entry.startblock, drbcc->maxFilelength);
+		}
+		else if ((entry.type.typeinfo != drbcc->cp.typeinfo) || (entry.startblock != drbcc->cp.startblock) || (drbcc->maxFilelength != drbcc->cp.length))
+		{
+			libdrbcc_end_session(drbcc, "Resume get flash file failed, flash file changed", 1);
+			return;
+		}
+		else if (drbcc->cp.offset >= drbcc->maxFilelength)
 		{
-			libdrbcc_req_flash_read(drbcc, drbcc->curFilestart, 128);	// now get entries from start of ring
+			libdrbcc_checkpoint_clear(drbcc);
+			libdrbcc_end_session(drbcc, "Get flash file successfully done", 1);
+			return;
 		}
 		else
 		{
-			libdrbcc_req_flash_read(drbcc, addr + 128, 128);
+			drbcc->curFilelength = drbcc->cp.offset;
 		}
-
-		return;
+		libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + drbcc->curFilelength, drbcc->maxFilelength - drbcc->curFilelength);
 	}
-
-	// check magic
-	if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1])) // Check partition table magic
+	else if (isEmpty(entry))
+	{
+		libdrbcc_end_session(drbcc, "Invalid flash file, empty entry", 1);
+	}
+	else
 	{
-		// TODO create partition table?
+		libdrbcc_end_session(drbcc, "Invalid flash file, size 0", 1);
+	}
+}
 
-		if (drbcc->error_cb)
+// write all bytes, fd may be a pipe
+static ssize_t libdrbcc_write_full(int fd, const uint8_t *data, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t wr = write(fd, data + done, len - done);
+		if (wr <= 0)
 		{
-			drbcc->error_cb(drbcc->context, "No magic in flash partition table");
+			return done ? (ssize_t)done : wr;
 		}
-		drbcc->state = DRBCC_STATE_USER;
-		if (drbcc->session_cb)
+		done += wr;
+	}
+	return done;
+}
+
+// read all bytes, fd may be a pipe
+static ssize_t libdrbcc_read_full(int fd, uint8_t *data, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		ssize_t rd = read(fd, data + done, len - done);
+		if (rd <= 0)
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			return done ? (ssize_t)done : rd;
 		}
-		drbcc->session = 0;
-		return;
+		done += rd;
 	}
+	return done;
+}
 
-	// check crc
-	for (i = 6; i < 126; i++)
+static void libdrbcc_get_file_next(DRBCC_t *drbcc, unsigned len)
+{
+	drbcc->curFilelength += len;
+	libdrbcc_checkpoint_update(drbcc, drbcc->curFilelength);
+
+	if (drbcc->progress_cb)
 	{
-		crc = libdrbcc_crc_ccitt_update(crc, data[i]);
+		drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
 	}
-	if (((crc & 0xff) != data[4]) || (((crc >> 8) & 0xff) != data[5]))
+	if (drbcc->curFilelength == drbcc->maxFilelength)
 	{
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "CRC error in flash partition table");
-		}
+		libdrbcc_checkpoint_clear(drbcc);
+		libdrbcc_end_session(drbcc, "Get flash file successfully done", 1);
+	}
+	else
+	{
+		libdrbcc_req_flash_read(drbcc, drbcc->flashAddr, drbcc->flashLen);
 	}
+}
 
-	int logEntry = -1;
-	DRBCC_PARTENTRY_t e[20];
+static void libdrbcc_get_file_data(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	int fd;
 
-	// Build partition table and find log entry
-	data += 6;
-	for (i = 0; i < 20; i++)
+	if (drbcc->ioMem)
+	{
+		memcpy(&drbcc->ioMem[addr - drbcc->curFilestart], data, len);
+		libdrbcc_get_file_next(drbcc, len);
+		return;
+	}
+	if (drbcc->ioFd >= 0)
 	{
-		e[i].type.typeinfo	= data[i*6];
-		e[i].startblock		= data[i*6+1] | (data[i*6+2] << 8);
-		e[i].length			= data[i*6+3] | (data[i*6+4] << 8) | (data[i*6+5] << 16); // size in blocks or bytes
+		// data arrives in order, no seek for pipes
+		if ((ssize_t)len != libdrbcc_write_full(drbcc->ioFd, data, len))
+		{
+			TRACE_WARN("writing flash data to fd %i failed", drbcc->ioFd);
+			libdrbcc_end_session(drbcc, "writing flash data to file descriptor failed", 1);
+			return;
+		}
+		libdrbcc_get_file_next(drbcc, len);
+		return;
+	}
 
-		if (drbcc->logtype &&
-			(e[i].type.bits.type == DRBCC_FLASHBLOCK_T_RING_LOG) &&
-			(e[i].type.bits.blocktype ==  0x01) )
+	fd = open(drbcc->curFilename, O_RDWR | O_CREAT | OX_BINARY, 0666 );
+	if (fd != -1)
+	{
+		ssize_t wr;
+		if (-1 == lseek(fd, addr - drbcc->curFilestart, SEEK_SET))
 		{
-			logEntry = i;
-			break;
+			TRACE_WARN("lseek to offset %u in file %s failed", addr, drbcc->curFilename);
+			libdrbcc_end_session(drbcc, "lseek to offset in file failed", 1);
 		}
-		if (!drbcc->logtype &&
-			(e[i].type.bits.type == DRBCC_FLASHBLOCK_T_PERS_LOG) &&
-			(e[i].type.bits.blocktype ==  0x01) )
+		else if ((ssize_t)len == (wr = write(fd, data, len)))
 		{
-			logEntry = i;
-			break;
+			close(fd);
+			libdrbcc_get_file_next(drbcc, len);
+			return;
+		}
+		else
+		{
+			char s[512];
+			TRACE_WARN("writing flash data to file %s failed", drbcc->curFilename);
+			memset(s, 0, sizeof(s));
+			snprintf(s, sizeof(s)-1, "writing %d byte(s) flash data to file %s failed. write returned %zd", len, drbcc->curFilename, wr);
+			libdrbcc_end_session(drbcc, s, 1);
 		}
+		close(fd);
+	}
+	else
+	{
+		TRACE_WARN("open file %s failed", drbcc->curFilename);
+		libdrbcc_end_session(drbcc, "open file failed", 1);
 	}
+}
+
+// queue erase and write requests for the bytes offset..length-1 of filename to flash at startblock,
+// offset is a multiple of 4K; returns 0 on success, on errors the requests queued behind mark are dropped
+// and the session is ended
+static int libdrbcc_queue_file(DRBCC_t *drbcc, const char *filename, unsigned int startblock, unsigned int length, unsigned int offset,
+	DRBCC_MESSAGE_t *mark)
+{
+	unsigned int i, j, len;
+	uint8_t buf[CHUNK];
+	int fd = -1;
+	int ownFd = 0;
 
-	//libdrbcc_dump(blocks, sizeof(blocks));
+	unsigned int write_addr = startblock * 0x1000 + offset;
 
-	if (logEntry == -1)
+	if (drbcc->ioMem)
 	{
-		if (drbcc->error_cb)
-		{
-			drbcc->error_cb(drbcc->context, "Get log failed, partition entry missing");
-		}
-		if (drbcc->session_cb)
+		// data taken from caller memory
+	}
+	else if (drbcc->ioFd >= 0)
+	{
+		// caller fd, read sequentially (pipe)
+		fd = drbcc->ioFd;
+	}
+	else
+	{
+		fd = open(filename, O_RDONLY | OX_BINARY);
+		ownFd = 1;
+		if ((fd == -1) || (-1 == lseek(fd, offset, SEEK_SET)))
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			TRACE_WARN("open file %s failed", filename);
+			if (fd != -1)
+			{
+				close(fd);
+			}
+			libdrbcc_drop_msg_sec(drbcc, mark);
+			libdrbcc_end_session(drbcc, "open file failed", 0);
+			return -1;
 		}
-		drbcc->session = 0;
-		drbcc->state = DRBCC_STATE_USER;
-		return;
 	}
-	else
+
+	for (i = offset; i < length; i += CHUNK)
 	{
-		int entries = drbcc->entries;
-		unsigned int abs_entries = entries >= 0 ? entries : -entries;
-		unsigned int curr_log_pos;
-		unsigned int start_addr;
-		drbcc->curFilestart = e[logEntry].startblock * 0x1000;
-		drbcc->maxFilelength =  e[logEntry].length * 0x1000;
-		// cur pos in drbcc->curFileIndex as abs block number
-		drbcc->curFileIndex  = drbcc->curFileIndex - (drbcc->curFilestart / 0x1000);
-		curr_log_pos = drbcc->curFileIndex * 0x1000 / 16 + drbcc->logentry;
+		if (i % 0x1000 == 0) // new block
+		{
+			//fprintf(stderr, "erase data block %i\n", (i / 0x1000) + startblock);
+			libdrbcc_req_flash_erase_block(drbcc, (i / 0x1000) + startblock);
+		}
 
-		if (0xFF == drbcc->logwrapflag)
-		{  // no wrap, start from block 0;
-			if(abs_entries >= (drbcc->maxFilelength/16)) // all
+		DRBCC_MESSAGE_t *msg = malloc(sizeof(DRBCC_MESSAGE_t));
+
+		if (msg != NULL)
+		{
+			ssize_t rd;
+			if (write_addr + CHUNK <= (startblock * 0x1000) + length)
 			{
-				start_addr = 0;
+				len = (uint8_t) CHUNK;
 			}
-			else if(0 > entries) // last x entries
+			else
 			{
-				unsigned int last_x = -entries;
-				if(last_x >= curr_log_pos)
-				{
-					drbcc->start = 0;
-					start_addr = 0;
-				}
-				else
-				{
-					drbcc->start = (curr_log_pos-last_x);
-					start_addr =  ((drbcc->start*16) & (~0x7F)); // alignment 128
-				}
+				len = (uint8_t) (length % CHUNK);
 			}
-			else // from entry x to now
+			msg->msg_len = 5 + len;
+			msg->msg[0] = DRBCC_REQ_EXTFLASH_WRITE;
+			msg->msg[1] = (uint8_t) ((write_addr >> 16) & 0xFF);
+			msg->msg[2] = (uint8_t) ((write_addr >>  8) & 0xFF);
+			msg->msg[3] = (uint8_t) ((write_addr >>  0) & 0xFF);
+			msg->msg[4] = (uint8_t) len;
+
+			//fprintf(stderr, " sending %x , %i\n", write_addr, msg->msg[4]);
+			write_addr = write_addr + len;
+
+			if (drbcc->ioMem)
 			{
-				unsigned int from_x = entries;
-				if(from_x >= curr_log_pos)
+				memcpy(buf, &drbcc->ioMem[i], len);
+				rd = len;
+			}
+			else
+			{
+				rd = libdrbcc_read_full(fd, buf, len);
+			}
+			if (rd == (ssize_t)len)
+			{
+				for (j = 0; j < len; j++)
 				{
-					drbcc->start = 0;
-					start_addr = 0;
+					msg->msg[5 + j] = buf[j];
 				}
-				else
+			}
+			else
+			{
+				char s[512];
+				memset(s, 0, sizeof(s));
+				sprintf(s, "Cant read %d bytes from file during put flash file operation. read returned %zd", len, rd);
+				free(msg);
+				if (ownFd)
 				{
-					drbcc->start = from_x;
-					start_addr = ((drbcc->start*16) & (~0x7F)); // alignment 128
+					close(fd);
 				}
+				libdrbcc_drop_msg_sec(drbcc, mark);
+				libdrbcc_end_session(drbcc, s, 0);
+				return -1;
 			}
+
+			libdrbcc_add_msg_sec(drbcc, msg);
 		}
 		else
 		{
-			if(abs_entries >= (drbcc->maxFilelength/16)) // all
+			if (ownFd)
 			{
-				start_addr = drbcc->curFileIndex;
-				start_addr += 1; // log starts from next block
-				start_addr %= (drbcc->maxFilelength / 0x1000); // take ring memory log into account
-				start_addr *= 0x1000; // block to addr offset
-				drbcc->start = (start_addr/16);
+				close(fd);
 			}
-			else if(0 > entries) // last x entries
-			{
-				unsigned int last_x = -entries;
-				if(last_x > curr_log_pos)
-				{
-					unsigned int rest = (last_x - curr_log_pos);
-					unsigned int from_x = (drbcc->maxFilelength / 16) - 1 - rest; // -1, because pos is an index
-					start_addr = calculate_start_addr_wrap(drbcc, from_x, curr_log_pos);
-				}
-				else
-				{
-					start_addr = calculate_start_addr_wrap(drbcc, curr_log_pos-last_x, curr_log_pos);
-				}
-			}
-			else // from entry x to now
+			libdrbcc_drop_msg_sec(drbcc, mark);
+			libdrbcc_end_session(drbcc, "Out of memory during put file operation", 0);
+			return -1;
+		}
+	}
+	if (ownFd)
+	{
+		close(fd);
+	}
+	return 0;
+}
+
+// compare the existing entry i of the same size with the file, see libdrbcc_put_diff_data
+static void libdrbcc_put_diff(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], int i)
+{
+	const DRBCC_PARTENTRY_t *entry = &e[i];
+
+	free(drbcc->diffBlocks);
+	drbcc->diffBlocks = calloc(libdrbcc_entry_blocks(entry), 1);
+	if (drbcc->diffBlocks == NULL)
+	{
+		libdrbcc_end_session(drbcc, "Out of memory during put file operation", 0);
+		return;
+	}
+	// kept open while the flash content is compared
+	drbcc->diffFd = open(drbcc->curFilename, O_RDONLY | OX_BINARY);
+	if (drbcc->diffFd == -1)
+	{
+		free(drbcc->diffBlocks);
+		drbcc->diffBlocks = NULL;
+		libdrbcc_end_session(drbcc, "open file failed", 0);
+		return;
+	}
+
+	TRACE(DRBCC_TR_TRANS, "differential put, compare with block %u length %u", entry->startblock, entry->length);
+
+	drbcc->curFilestart = entry->startblock * 0x1000;
+	drbcc->curFilelength = 0;
+	drbcc->diffError = 0;
+	drbcc->diffWritten = 0;
+	drbcc->diffSkipped = 0;
+	drbcc->diffEntry = i;
+	drbcc->state = DRBCC_STATE_PUT_DIFF;
+	if (DRBCC_RC_NOERROR != libdrbcc_req_flash_read_all(drbcc, drbcc->curFilestart, drbcc->maxFilelength))
+	{
+		free(drbcc->diffBlocks);
+		drbcc->diffBlocks = NULL;
+		libdrbcc_end_session(drbcc, "Out of memory during put file operation", 0);
+	}
+}
+
+static void libdrbcc_put_diff_done(DRBCC_t *drbcc)
+{
+	char s[256];
+
+	if (drbcc->diffWritten == 0)
+	{
+		snprintf(s, sizeof(s), "Put flash file skipped, content unchanged (%u blocks)", drbcc->diffSkipped);
+	}
+	else
+	{
+		snprintf(s, sizeof(s), "Put flash file successfully done, %u blocks written, %u blocks unchanged", drbcc->diffWritten, drbcc->diffSkipped);
+	}
+	libdrbcc_end_session(drbcc, s, 1);
+}
+
+// all blocks written: store the hash of the file in the table entry, the journal takes a single record
+static void libdrbcc_put_diff_hash(DRBCC_t *drbcc)
+{
+	DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+
+	if (!drbcc->partValid || (drbcc->putHash == DRBCC_HASH_UNKNOWN) || (drbcc->partHash[drbcc->diffEntry] == drbcc->putHash))
+	{
+		libdrbcc_put_diff_done(drbcc);
+		return;
+	}
+	memcpy(e, drbcc->partTable, sizeof(e));
+	libdrbcc_write_partition(drbcc, e, drbcc->diffEntry, drbcc->putHash);
+}
+
+// queue erase and write of the changed blocks
+static void libdrbcc_put_diff_write(DRBCC_t *drbcc)
+{
+	unsigned int offset;
+	unsigned int total = 0;
+	unsigned int length = drbcc->maxFilelength;
+	DRBCC_MESSAGE_t *mark = libdrbcc_last_msg_sec(drbcc);
+
+	for (offset = 0; offset < length; offset += 0x1000)
+	{
+		if (drbcc->diffBlocks[offset / 0x1000])
+		{
+			unsigned int end = (length - offset > 0x1000) ? offset + 0x1000 : length;
+
+			if (libdrbcc_queue_file(drbcc, drbcc->curFilename, drbcc->curFilestart / 0x1000, end, offset, mark))
 			{
-				start_addr = calculate_start_addr_wrap(drbcc, entries, curr_log_pos);
+				return;
 			}
+			drbcc->diffWritten++;
+			total += end - offset;
+		}
+		else
+		{
+			drbcc->diffSkipped++;
 		}
+	}
+	free(drbcc->diffBlocks);
+	drbcc->diffBlocks = NULL;
 
-		libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + start_addr, 128);
+	TRACE(DRBCC_TR_TRANS, "differential put, %u blocks written, %u blocks skipped", drbcc->diffWritten, drbcc->diffSkipped);
+
+	// progress of the writes
+	drbcc->curFilelength = 0;
+	drbcc->maxFilelength = total;
+
+	if (total == 0)
+	{
+		libdrbcc_put_diff_hash(drbcc);
 	}
 }
 
-void libdrbcc_readflash_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+static void libdrbcc_put_diff_data(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
 {
-	static int retry = 0;
+	unsigned int offset = addr - drbcc->curFilestart;
+	uint8_t buf[CHUNK];
 
-	// check magic
-	if (retry == 0 && addr == 0 && ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1]))) // Check partition table magic
+	if ((drbcc->diffBlocks == NULL) || (drbcc->diffFd == -1))
 	{
-		libdrbcc_request_partition2(drbcc);
-		retry = 1;
-		if (drbcc->error_cb)
+		return;
+	}
+
+	if ((-1 == lseek(drbcc->diffFd, offset, SEEK_SET)) ||
+		(len > sizeof(buf)) ||
+		((ssize_t)len != libdrbcc_read_full(drbcc->diffFd, buf, len)))
+	{
+		TRACE_WARN("reading %u bytes at offset %u of file %s failed", len, offset, drbcc->curFilename);
+		drbcc->diffError = 1;
+	}
+	else if (memcmp(buf, data, len))
+	{
+		drbcc->diffBlocks[offset / 0x1000] = 1;
+	}
+
+	drbcc->curFilelength += len;
+	if (drbcc->curFilelength < drbcc->maxFilelength)
+	{
+		return;
+	}
+	close(drbcc->diffFd);
+	drbcc->diffFd = -1;
+
+	if (drbcc->diffError)
+	{
+		free(drbcc->diffBlocks);
+		drbcc->diffBlocks = NULL;
+		libdrbcc_end_session(drbcc, "Cant read file during differential put flash file operation", 0);
+		return;
+	}
+	libdrbcc_put_diff_write(drbcc);
+}
+
+static void libdrbcc_put_diff_written(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result)
+{
+	if (!result)
+	{
+		// the changed blocks still queued must not reach the flash
+		libdrbcc_drop_msg_sec(drbcc, NULL);
+		libdrbcc_end_session(drbcc, "Flash file error result", 0);
+		return;
+	}
+	if (isTableAddr(addr))
+	{
+		// hash invalidated before the file blocks are written, stored after them
+		if ((drbcc->curFilelength == drbcc->maxFilelength) && (addr == drbcc->partWriteAddr))
 		{
-			drbcc->error_cb(drbcc->context, "No magic in flash partition table, try other one");
+			libdrbcc_put_diff_done(drbcc);
 		}
 		return;
 	}
 
-	if (addr == 4096)
+	drbcc->curFilelength += len;
+	if (drbcc->progress_cb)
+	{
+		drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
+	}
+	if (drbcc->curFilelength == drbcc->maxFilelength)
+	{
+		libdrbcc_put_diff_hash(drbcc);
+	}
+}
+
+static void libdrbcc_put_file(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	unsigned int i;
+	int emptyEntry = -1;
+	int startblock;
+	DRBCC_ALLOC_t alloc;
+
+	// content hash of the local data, not available for streams
+	drbcc->putHash = DRBCC_HASH_UNKNOWN;
+	if (drbcc->ioMem)
+	{
+		drbcc->putHash = libdrbcc_hash_done(libdrbcc_fnv1a_update(DRBCC_HASH_INIT, drbcc->ioMem, drbcc->maxFilelength));
+	}
+	else if ((drbcc->ioFd < 0) && libdrbcc_file_hash(drbcc->curFilename, &drbcc->putHash))
+	{
+		drbcc->putHash = DRBCC_HASH_UNKNOWN;
+	}
+
+	if (!drbcc->resume && drbcc->partValid && (drbcc->putHash != DRBCC_HASH_UNKNOWN))
 	{
-		if ((DRBCC_PART_MAGIC1 != data[0]) || (DRBCC_PART_MAGIC2 != data[1])) // Check partition table magic
+		// nothing to do if the file in flash has the same content
+		for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 		{
-			if (drbcc->error_cb)
+			if (isFile(e[i], drbcc->curFileType, drbcc->curFileIndex) && (e[i].length == drbcc->maxFilelength) &&
+				(drbcc->partHash[i] == drbcc->putHash))
 			{
-				drbcc->error_cb(drbcc->context, "No magic in 2nd flash partition table, try without");
-				addr = 0;
+				TRACE(DRBCC_TR_TRANS, "put file skipped, entry %u has the same hash 0x%08X", i, drbcc->putHash);
+				libdrbcc_end_session(drbcc, "Put flash file skipped, content unchanged", 1);
+				return;
 			}
 		}
-		else
+	}
+
+	if (drbcc->putDiff && !drbcc->resume)
+	{
+		// rewrite changed blocks in place if an entry of the same size exists
+		for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 		{
-			libdrbcc_req_flash_erase_block(drbcc, 0);
-			libdrbcc_req_flash_write(drbcc, 0, 128, data);
-			libdrbcc_req_flash_read(drbcc, 0, 128);
-			return;
+			if (isFile(e[i], drbcc->curFileType, drbcc->curFileIndex) && (e[i].length == drbcc->maxFilelength))
+			{
+				if (drbcc->partValid && (drbcc->partHash[i] != DRBCC_HASH_UNKNOWN))
+				{
+					// the blocks are changed in place, the hash is stored again when all are written
+					libdrbcc_write_partition(drbcc, e, i, DRBCC_HASH_UNKNOWN);
+				}
+				libdrbcc_put_diff(drbcc, e, i);
+				return;
+			}
 		}
+		TRACE(DRBCC_TR_TRANS, "differential put, no entry of same size, write whole file");
 	}
-	retry = 0;
 
-	switch (drbcc->state)
+	// find empty entry
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
 	{
-	case DRBCC_STATE_PARTITION_REQ:
-		libdrbcc_got_partition(drbcc, addr, len, data);
-		break;
-	case DRBCC_STATE_DELETE_FILE:
-		libdrbcc_delete(drbcc, addr, len, data);
-		break;
-	case DRBCC_STATE_GET_FILE:
-		libdrbcc_get_file(drbcc, addr, len, data);
-		break;
-	case DRBCC_STATE_PUT_FILE:
-		libdrbcc_put_file(drbcc, addr, len, data);
-		break;
-	case DRBCC_STATE_GET_LOG:
-		libdrbcc_get_log(drbcc, addr, len, data);
-		break;
-	default:
-		if (drbcc->error_cb)
+		if ((emptyEntry == -1) && (i < libdrbcc_part_entries(drbcc)) && (isEmpty(e[i])))
 		{
-			drbcc->error_cb(drbcc->context, "No handler for read flash callback");
+			emptyEntry = i;
 		}
-		if (drbcc->session_cb)
+
+		// reuse entry of same type
+		if (isFile(e[i], drbcc->curFileType, drbcc->curFileIndex))
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			emptyEntry = i;
+			e[i].type.typeinfo = 0xFF;
 		}
-		drbcc->session = 0;
 	}
-}
 
-void libdrbcc_logpos_cb(DRBCC_t *drbcc)
-{
-	switch(drbcc->state)
+	if (emptyEntry == -1)
 	{
-	case DRBCC_STATE_GET_LOG:
-		libdrbcc_request_partition(drbcc);
-		break;
-	default:
-		if (drbcc->error_cb)
+		libdrbcc_end_session(drbcc, "Put flash file failed, partition table full", 0);
+		return;
+	}
+
+	libdrbcc_alloc_init(&alloc, libdrbcc_flash_blocks(drbcc));
+	libdrbcc_alloc_mark_table(&alloc, e);
+
+	if (drbcc->resume)
+	{
+		// continue at the location of the interrupted upload
+		startblock = drbcc->cp.startblock;
+		if (!libdrbcc_alloc_is_free(&alloc, startblock, (drbcc->maxFilelength + 0xfff) / 0x1000))
 		{
-			drbcc->error_cb(drbcc->context, "No handler for logpos callback");
+			libdrbcc_end_session(drbcc, "Resume put flash file failed, flash area in use", 0);
+			return;
 		}
-		if (drbcc->session_cb)
+		if (drbcc->cp.offset && !drbcc->resumeVerified)
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			// check the already written part 1st, see libdrbcc_put_verify_data
+			drbcc->resumeCrc = 0xffff;
+			libdrbcc_req_flash_read(drbcc, startblock * 0x1000, drbcc->cp.offset);
+			return;
 		}
-		drbcc->session = 0;
 	}
+	else
+	{
+		startblock = libdrbcc_alloc_find(&alloc, (drbcc->maxFilelength + 0xfff) / 0x1000, drbcc->allocPolicy);
+		if (startblock < 0)
+		{
+			libdrbcc_end_session(drbcc, "Put flash file failed, no space left", 0);
+			return;
+		}
+		libdrbcc_checkpoint_begin(drbcc, 1, (drbcc->curFileType << 4) | (drbcc->curFileIndex & 0xF), startblock, drbcc->maxFilelength);
+	}
+
+	drbcc->curFilelength = drbcc->cp.offset;
+	if (libdrbcc_queue_file(drbcc, drbcc->curFilename, startblock, drbcc->maxFilelength, drbcc->cp.offset, libdrbcc_last_msg_sec(drbcc)))
+	{
+		return;
+	}
+
+	TRACE(DRBCC_TR_TRANS, "change partition table entry %i start 0x%06x length %i", emptyEntry, startblock, drbcc->maxFilelength);
+
+	e[emptyEntry].type.bits.blocktype	= 0;
+	e[emptyEntry].type.bits.type		= drbcc->curFileType;
+	e[emptyEntry].type.bits.idx			= drbcc->curFileIndex;
+	e[emptyEntry].startblock			= startblock;
+	e[emptyEntry].length				= drbcc->maxFilelength;  // size in bytes
+
+	libdrbcc_write_partition(drbcc, e, emptyEntry, drbcc->putHash);
 }
-void libdrbcc_writeflash_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result)
+
+// read back of the part written before a put file was interrupted
+static void libdrbcc_put_verify_data(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
 {
-	switch(drbcc->state)
+	unsigned int i;
+
+	(void) addr;
+	for (i = 0; i < len; i++)
 	{
-	case DRBCC_STATE_PARTITION_REQ:
-		// new partition table created, nothing to do
-		break;
-	case DRBCC_STATE_DELETE_FILE:
-		drbcc->state = DRBCC_STATE_USER;
+		drbcc->resumeCrc = libdrbcc_crc_ccitt_update(drbcc->resumeCrc, data[i]);
+	}
+
+	if (drbcc->flashLen)
+	{
+		libdrbcc_req_flash_read(drbcc, drbcc->flashAddr, drbcc->flashLen);
+		return;
+	}
+
+	if (drbcc->resumeCrc != drbcc->cp.crc)
+	{
+		TRACE_WARN("flash content differs from checkpoint, crc 0x%04x expected 0x%04x", drbcc->resumeCrc, drbcc->cp.crc);
 		if (drbcc->error_cb)
 		{
-			if (result)
-			{
-				drbcc->error_cb(drbcc->context, "Flash file successfully deleted.");
-			}
-			else
-			{
-				drbcc->error_cb(drbcc->context, "Delete flash file failed!");
-			}
+			drbcc->error_cb(drbcc->context, "Flash content differs from checkpoint, restart upload");
 		}
-		if (drbcc->session_cb)
+		drbcc->cp.offset = 0;
+		drbcc->cp.crc = 0xffff;
+	}
+	drbcc->resumeVerified = 1;
+	libdrbcc_request_partition(drbcc);
+}
+
+void libdrbcc_free_fileops(DRBCC_t *drbcc)
+{
+	while (drbcc->fileOps)
+	{
+		DRBCC_FILEOP_t *op = drbcc->fileOps;
+		drbcc->fileOps = op->next;
+		free(op);
+	}
+}
+
+// plan all operations of the file transaction against e[], then queue the data and write the partition table once
+static void libdrbcc_commit_files(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	DRBCC_FILEOP_t *op;
+	const char *err = NULL;
+	unsigned int i;
+	DRBCC_PARTENTRY_t orig[DRBCC_PART_ENTRIES];
+	uint32_t hash[DRBCC_PART_ENTRIES];
+	DRBCC_ALLOC_t alloc;
+	DRBCC_MESSAGE_t *mark;
+
+	if (drbcc->fileOps == NULL)
+	{
+		libdrbcc_end_session(drbcc, "No flash file operations to commit", 1);
+		return;
+	}
+
+	// blocks of replaced or deleted files are not reused before the new table is written
+	memcpy(orig, e, sizeof(orig));
+
+	drbcc->curFilelength = 0;
+	drbcc->maxFilelength = 0;
+
+	for (op = drbcc->fileOps; (op != NULL) && (err == NULL); op = op->next)
+	{
+		int emptyEntry = -1;
+		int startblock;
+		struct stat st;
+
+		op->entry = -1;
+		if (op->put)
 		{
-			if (result)
+			if ((stat(op->filename, &st) != 0) || (st.st_size != (off_t)op->length) ||
+				libdrbcc_file_hash(op->filename, &op->hash))
 			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 1);
+				TRACE_WARN("file %s changed since it was added", op->filename);
+				err = "Commit flash files failed, file changed";
+				break;
 			}
-			else
+			for (i = 0; drbcc->partValid && (i < DRBCC_PART_ENTRIES); i++)
 			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 0);
+				if (isFile(e[i], op->type >> 4, op->type) && libdrbcc_same_entry(&e[i], &orig[i]) &&
+					(e[i].length == op->length) && (drbcc->partHash[i] == op->hash))
+				{
+					break;
+				}
 			}
-		}
-		drbcc->session = 0;
-		break;
-	case DRBCC_STATE_PUT_FILE:
-		if (result)
-		{
-			if (addr != 0 && addr != 4096)
+			if (drbcc->partValid && (i < DRBCC_PART_ENTRIES))
 			{
-				drbcc->curFilelength += len;
+				// the file in flash has the same content
+				TRACE(DRBCC_TR_TRANS, "put %s skipped, entry %u has the same hash 0x%08X", op->filename, i, op->hash);
+				op->put = 0;
+				continue;
 			}
-			if (drbcc->progress_cb)
+		}
+
+		for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+		{
+			// delete entry, or reuse entry of same type
+			if (isFile(e[i], op->type >> 4, op->type))
 			{
-				drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
+				memset(&e[i], 0xFF, sizeof(e[i]));
+				emptyEntry = i;
 			}
-			if (addr == 0 && drbcc->curFilelength == drbcc->maxFilelength)
+			else if ((emptyEntry == -1) && (i < libdrbcc_part_entries(drbcc)) && (isEmpty(e[i])))
 			{
-				if (drbcc->error_cb)
-				{
-					drbcc->error_cb(drbcc->context, "Put flash file successfully done");
-				}
-				if (drbcc->session_cb)
-				{
-					drbcc->session_cb(drbcc->context, drbcc->session, 1);
-				}
-				drbcc->session = 0;
+				emptyEntry = i;
 			}
 		}
+
+		if (!op->put)
+		{
+			continue;
+		}
+
+		if (emptyEntry == -1)
+		{
+			err = "Commit flash files failed, partition table full";
+		}
 		else
 		{
-			if (drbcc->error_cb)
+			libdrbcc_alloc_init(&alloc, libdrbcc_flash_blocks(drbcc));
+			libdrbcc_alloc_mark_table(&alloc, orig);
+			libdrbcc_alloc_mark_table(&alloc, e);
+
+			startblock = libdrbcc_alloc_find(&alloc, (op->length + 0xfff) / 0x1000, drbcc->allocPolicy);
+			if (startblock < 0)
 			{
-				drbcc->error_cb(drbcc->context, "Flash file error result");
+				err = "Commit flash files failed, no space left";
 			}
-			if (drbcc->session_cb)
+			else
 			{
-				drbcc->session_cb(drbcc->context, drbcc->session, 1);
+				TRACE(DRBCC_TR_TRANS, "change partition table entry %i start 0x%06x length %i", emptyEntry, startblock, op->length);
+
+				op->startblock = startblock;
+				op->entry = emptyEntry;
+				e[emptyEntry].type.bits.blocktype	= 0;
+				e[emptyEntry].type.bits.type		= (op->type >> 4) & 0x07;
+				e[emptyEntry].type.bits.idx			= op->type & 0x0F;
+				e[emptyEntry].startblock			= startblock;
+				e[emptyEntry].length				= op->length;  // size in bytes
+				drbcc->maxFilelength += op->length;
 			}
-			drbcc->session = 0;
 		}
-		break;
-	default:
-		if (drbcc->error_cb)
+	}
+
+	if (err)
+	{
+		// nothing queued yet, flash is unchanged
+		libdrbcc_free_fileops(drbcc);
+		libdrbcc_end_session(drbcc, err, 1);
+		return;
+	}
+	if (libdrbcc_same_table(e, orig))
+	{
+		libdrbcc_free_fileops(drbcc);
+		libdrbcc_end_session(drbcc, "Commit flash files skipped, content unchanged", 1);
+		return;
+	}
+
+	// the files are read again while queued, a read error drops all requests of the commit
+	libdrbcc_table_hashes(drbcc, e, hash);
+	mark = libdrbcc_last_msg_sec(drbcc);
+	for (op = drbcc->fileOps; op != NULL; op = op->next)
+	{
+		if (op->put && libdrbcc_queue_file(drbcc, op->filename, op->startblock, op->length, 0, mark))
 		{
-			drbcc->error_cb(drbcc->context, "No handler for write flash callback");
+			libdrbcc_free_fileops(drbcc);
+			return;
 		}
-		if (drbcc->session_cb)
+		if (op->put)
 		{
-			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			hash[op->entry] = op->hash;
 		}
-		drbcc->session = 0;
 	}
+	libdrbcc_free_fileops(drbcc);
+
+	libdrbcc_write_partition_hashes(drbcc, e, hash);
+}
+
+static void handle_logentry(DRBCC_t *drbcc, unsigned int pos, int len, uint8_t* buf)
+{
+	if (0xFF == drbcc->logwrapflag)
+	{
+		if (pos < drbcc->start) { return; }
+	}
+	else
+	{
+		unsigned int curr_log_pos = drbcc->curFileIndex * 0x1000 / 16 + drbcc->logentry;
+		if (curr_log_pos > drbcc->start)
+		{
+			if(pos < drbcc->start) { return; }
+		}
+		else
+		{
+			if((curr_log_pos < pos) && (pos < drbcc->start)) { return; }
+		}
+	}
+	if (drbcc->logMirror)
+	{
+		libdrbcc_log_mirror_entry(drbcc, pos, len, &buf[0]);
+	}
+	else if (drbcc->logAggregate)
+	{
+		libdrbcc_log_aggregate_entry(drbcc, pos, len, &buf[0]);
+	}
+	else if (drbcc->logFollowCb)
+	{
+		drbcc->logFollowCb(drbcc->context, pos, len, &buf[0]);
+	}
+	else if (drbcc->getlog_cb)
+	{
+		drbcc->getlog_cb(drbcc->context, pos, len, &buf[0]);
+	}
+	if ((drbcc->logCount > 0) && (--drbcc->logCount == 0))
+	{
+		drbcc->logStop = 1;
+	}
+}
+
+static unsigned int calculate_start_addr_wrap(DRBCC_t *drbcc, unsigned int from_x, unsigned curr_log_pos)
+{
+	unsigned start_addr;
+
+	if(from_x >= curr_log_pos)
+	{
+		unsigned int next_entry = drbcc->curFileIndex + 1;
+		next_entry %= (drbcc->maxFilelength / 0x1000); // take ring memory log into account
+		next_entry *= 0x1000; // block to addr offset
+		next_entry /= 16; // addr offset to entry index
+
+		if(0 == next_entry) // was last block, ring starts now at offset 0
+		{
+			drbcc->start = 0;
+			start_addr = 0;
+		}
+		else if(next_entry < from_x) // request entry is in upper ring buffer
+		{
+			drbcc->start = from_x;
+			start_addr = ((drbcc->start*16) & (~0x7F)); // alignment 128
+		}
+		else // request entry is invalid, start with next valid entry
+		{
+			drbcc->start = next_entry;
+			start_addr = (drbcc->start*16);
+		}
+	}
+	else
+	{
+		drbcc->start = from_x;
+		start_addr = ((drbcc->start*16) & (~0x7F)); // alignment 128
+	}
+	return start_addr;
+}
+
+// cursor for the caller, an entry whose extension entries are not all written yet is fetched again next time
+static void libdrbcc_log_cursor_store(DRBCC_t *drbcc, DRBCC_LOG_CURSOR_t *cursor)
+{
+	memcpy(cursor, &drbcc->logCursorNext, sizeof(DRBCC_LOG_CURSOR_t));
+	if (drbcc->logdata)
+	{
+		if ((unsigned int) drbcc->logpos > cursor->pos)
+		{
+			// written before the ring wrapped, the wrap is counted again with the next call
+			cursor->epoch--;
+		}
+		cursor->pos = drbcc->logpos;
+	}
+}
+
+// drbcc_log_follow: poll again soon after new entries, back off up to logFollowMax while idle
+static void libdrbcc_log_follow_next(DRBCC_t *drbcc)
+{
+	const DRBCC_LOG_CURSOR_t *next = &drbcc->logCursorNext;
+	struct timeval now, ms;
+
+	if ((drbcc->logFollowCursor.magic == DRBCC_LOG_CURSOR_MAGIC) && (drbcc->logFollowCursor.pos != next->pos))
+	{
+		drbcc->logFollowMs = DRBCC_LOG_FOLLOW_MIN;
+	}
+	else if (drbcc->logFollowMs < drbcc->logFollowMax)
+	{
+		drbcc->logFollowMs = (drbcc->logFollowMs * 2 < drbcc->logFollowMax) ? drbcc->logFollowMs * 2 : drbcc->logFollowMax;
+	}
+	memcpy(&drbcc->logFollowCursor, next, sizeof(DRBCC_LOG_CURSOR_t));
+	if (drbcc->logFollowUser)
+	{
+		libdrbcc_log_cursor_store(drbcc, drbcc->logFollowUser);
+	}
+
+	gettimeofday(&now, NULL);
+	ms.tv_sec = drbcc->logFollowMs / 1000;
+	ms.tv_usec = (drbcc->logFollowMs % 1000) * 1000;
+	timeradd(&now, &ms, &drbcc->logFollowNext);
+	drbcc->logFollowWait = 1;
+}
+
+// all entries up to the write position fetched
+static void libdrbcc_get_log_done(DRBCC_t *drbcc)
+{
+	if (drbcc->logFollow)
+	{
+		// the session goes on until drbcc_get_log_stop
+		libdrbcc_log_follow_next(drbcc);
+		return;
+	}
+	if (drbcc->logCursor)
+	{
+		libdrbcc_log_cursor_store(drbcc, drbcc->logCursor);
+		if (drbcc->logCursorFile[0])
+		{
+			libdrbcc_write_sidecar(drbcc->logCursorFile, drbcc->logCursor, sizeof(DRBCC_LOG_CURSOR_t));
+		}
+		drbcc->logCursor = NULL;
+	}
+	if (drbcc->logdata)
+	{
+		free(drbcc->logdata);
+		drbcc->logdata = NULL;
+	}
+	libdrbcc_end_session(drbcc, NULL, 1);
+}
+
+// set drbcc->entries for drbcc_get_log_since, 1: nothing to fetch, session ended
+static int libdrbcc_get_log_cursor(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t *e)
+{
+	const DRBCC_LOG_CURSOR_t *cursor = drbcc->logCursor;
+	DRBCC_LOG_CURSOR_t *next = &drbcc->logCursorNext;
+	unsigned int curr_log_pos = (drbcc->curFileIndex - e->startblock) * 0x1000 / 16 + drbcc->logentry;
+
+	next->magic = DRBCC_LOG_CURSOR_MAGIC;
+	next->pos = curr_log_pos;
+	next->epoch = cursor->epoch;
+	next->blocks = e->length;
+
+	if (drbcc->logFollow && (cursor->magic != DRBCC_LOG_CURSOR_MAGIC))
+	{
+		// drbcc_log_follow without cursor: entries written from now on
+		libdrbcc_get_log_done(drbcc);
+		return 1;
+	}
+	if ((cursor->magic != DRBCC_LOG_CURSOR_MAGIC) || (cursor->blocks != e->length) ||
+		(cursor->pos >= e->length * 0x1000 / 16))
+	{
+		// new cursor or other log area: all entries
+		next->epoch = 0;
+		drbcc->entries = e->length * 0x1000 / 16;
+		return 0;
+	}
+	if (cursor->pos == curr_log_pos)
+	{
+		libdrbcc_get_log_done(drbcc);
+		return 1;
+	}
+	if (cursor->pos > curr_log_pos)
+	{
+		// ring wrapped, entries overwritten since the last call are skipped by calculate_start_addr_wrap
+		next->epoch++;
+	}
+	drbcc->entries = cursor->pos;
+	return 0;
+}
+
+// drbcc_get_log_stop: end the session without storing the cursor of drbcc_get_log_since
+static void libdrbcc_get_log_stopped(DRBCC_t *drbcc)
+{
+	if (drbcc->logdata)
+	{
+		free(drbcc->logdata);
+		drbcc->logdata = NULL;
+	}
+	drbcc->logCursor = NULL;
+	drbcc->logFollow = 0;
+	drbcc->logFollowWait = 0;
+	libdrbcc_end_session(drbcc, NULL, 1);
+}
+
+// reverse: deliver one entry, 1: stop reading
+static int libdrbcc_get_log_reverse_entry(DRBCC_t *drbcc, int pos, int len, uint8_t *buf)
+{
+	if (drbcc->getlog_cb)
+	{
+		drbcc->getlog_cb(drbcc->context, pos, len, buf);
+	}
+	if ((drbcc->entries > 0) && (--drbcc->entries == 0))
+	{
+		drbcc->logStop = 1;
+	}
+	return drbcc->logStop;
+}
+
+// reverse: deliver the extension entries whose entry was not found, newest first
+static int libdrbcc_get_log_reverse_orphans(DRBCC_t *drbcc, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (drbcc->logFiltered && (DRBCC_LOG_FILTER_PASS != libdrbcc_log_filter(&drbcc->logFilter, drbcc->logExt[i])))
+		{
+			continue;
+		}
+		if (libdrbcc_get_log_reverse_entry(drbcc, drbcc->logExtPos[i], 16, drbcc->logExt[i]))
+		{
+			return 1;
+		}
+	}
+	drbcc->logExtCount -= count;
+	memmove(drbcc->logExt[0], drbcc->logExt[count], drbcc->logExtCount * 16);
+	memmove(&drbcc->logExtPos[0], &drbcc->logExtPos[count], drbcc->logExtCount * sizeof(int));
+	return 0;
+}
+
+// reverse: handle the 16 byte entry at pos, 1: stop reading
+static int libdrbcc_get_log_reverse_data(DRBCC_t *drbcc, int pos, const uint8_t *data)
+{
+	unsigned int needed = 0;
+	int filter = DRBCC_LOG_FILTER_PASS;
+	int i;
+	int n;
+
+	if (data[0] == 0xff)
+	{
+		// empty log entry
+		return 0;
+	}
+	if (data[0] == DRBCC_E_EXTENSION)
+	{
+		if ((drbcc->logExtCount == DRBCC_LOG_EXT_MAX) && libdrbcc_get_log_reverse_orphans(drbcc, 1))
+		{
+			return 1;
+		}
+		memcpy(drbcc->logExt[drbcc->logExtCount], data, 16);
+		drbcc->logExtPos[drbcc->logExtCount++] = pos;
+		return 0;
+	}
+
+	// if (data[1] == 0xff) this is a invalid entry made by AVR programmer
+	if ((data[1] != 0xff) && (data[8] > sizeof(drbcc->dlpf.data)))
+	{
+		needed = (data[8] - sizeof(drbcc->dlpf.data) + 14) / 15;
+	}
+	n = (drbcc->logExtCount < (int)needed) ? drbcc->logExtCount : (int)needed;
+	if (libdrbcc_get_log_reverse_orphans(drbcc, drbcc->logExtCount - n))
+	{
+		return 1;
+	}
+	if (drbcc->logFiltered)
+	{
+		filter = libdrbcc_log_filter(&drbcc->logFilter, data);
+	}
+	if (filter != DRBCC_LOG_FILTER_PASS)
+	{
+		// drop the extension entries of the skipped entry
+		drbcc->logExtCount = 0;
+		return (filter == DRBCC_LOG_FILTER_STOP);
+	}
+
+	// the last extension entries read are the first ones of this entry
+	memset(drbcc->logRevBuf, 0, sizeof(drbcc->logRevBuf));
+	memcpy(drbcc->logRevBuf, data, 16);
+	for (i = 0; i < n; i++)
+	{
+		memcpy(drbcc->logRevBuf + 16 + i * 15, &drbcc->logExt[n - 1 - i][1], 15);
+	}
+	drbcc->logExtCount = 0;
+	return libdrbcc_get_log_reverse_entry(drbcc, pos, data[8] + 9, drbcc->logRevBuf);
+}
+
+// reverse: request the next 128 bytes below drbcc->logLimit
+static void libdrbcc_get_log_reverse_next(DRBCC_t *drbcc)
+{
+	if (drbcc->logLimit == 0)
+	{
+		// ring wrapped, continue at the end of the log area
+		drbcc->logLimit = drbcc->maxFilelength;
+	}
+	libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + ((drbcc->logLimit - 1) & (~0x7F)), 128);
+}
+
+// set drbcc->logEnd to the offset of the oldest entry in the log area
+static void libdrbcc_get_log_oldest(DRBCC_t *drbcc)
+{
+	if (0xFF == drbcc->logwrapflag)
+	{
+		// no wrap, log starts at block 0
+		drbcc->logEnd = 0;
+	}
+	else
+	{
+		// log starts from next block
+		drbcc->logEnd = ((drbcc->curFileIndex + 1) % (drbcc->maxFilelength / 0x1000)) * 0x1000;
+	}
+}
+
+static void libdrbcc_get_log_reverse_start(DRBCC_t *drbcc, unsigned int curr_log_pos)
+{
+	libdrbcc_get_log_oldest(drbcc);
+	drbcc->logLimit = curr_log_pos * 16;
+	drbcc->logExtCount = 0;
+
+	if (drbcc->logLimit == drbcc->logEnd)
+	{
+		libdrbcc_get_log_done(drbcc);
+		return;
+	}
+	libdrbcc_get_log_reverse_next(drbcc);
+}
+
+static void libdrbcc_get_log_reverse(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int offset = addr - drbcc->curFilestart;
+	unsigned int i = (drbcc->logLimit - offset) / 16;
+
+	if (len < drbcc->logLimit - offset)
+	{
+		libdrbcc_end_session(drbcc, "Get log failed, short read", 1);
+		return;
+	}
+	while (i-- > 0)
+	{
+		if (drbcc->logStop || libdrbcc_get_log_reverse_data(drbcc, offset / 16 + i, &data[i * 16]))
+		{
+			libdrbcc_get_log_stopped(drbcc);
+			return;
+		}
+	}
+	drbcc->logLimit = offset;
+
+	if (offset == drbcc->logEnd)
+	{
+		// oldest entry reached, the entries of the remaining extension entries are overwritten
+		if (libdrbcc_get_log_reverse_orphans(drbcc, drbcc->logExtCount))
+		{
+			libdrbcc_get_log_stopped(drbcc);
+			return;
+		}
+		libdrbcc_get_log_done(drbcc);
+		return;
+	}
+	libdrbcc_get_log_reverse_next(drbcc);
+}
+
+// seek: offset of the chunk of 128 bytes in the log area, chunk 0 holds the oldest entry
+static unsigned int libdrbcc_log_seek_offset(DRBCC_t *drbcc, unsigned int chunk)
+{
+	return (drbcc->logEnd + chunk * 128) % drbcc->maxFilelength;
+}
+
+// seek: 1 if the 16 byte entry is older than the time searched or has no timestamp
+static int libdrbcc_log_seek_before(DRBCC_t *drbcc, const uint8_t *data)
+{
+	time_t t = libdrbcc_log_entry_time(data);
+
+	if (t == (time_t) -1)
+	{
+		return 1;
+	}
+	if (data[4] != drbcc->logSeekEpoch)
+	{
+		// the epoch only grows, entries of other epochs are older than the newest one
+		return 1;
+	}
+	return (t < drbcc->logSeekTime);
+}
+
+// seek: index of the first (last: 1) entry with timestamp in the chunk, -1: extension entries only
+static int libdrbcc_log_seek_entry(const uint8_t *data, int last)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+	{
+		int n = last ? 7 - i : i;
+
+		if (libdrbcc_log_entry_time(&data[n * 16]) != (time_t) -1)
+		{
+			return n;
+		}
+	}
+	return -1;
+}
+
+// seek: probe the middle of the search range or read the entries from the chunk found
+static void libdrbcc_log_seek_next(DRBCC_t *drbcc)
+{
+	unsigned int chunk;
+
+	if (drbcc->logSeekLo < drbcc->logSeekHi)
+	{
+		drbcc->logSeekChunk = drbcc->logSeekLo + (drbcc->logSeekHi - drbcc->logSeekLo) / 2;
+		drbcc->logSeekRead = drbcc->logSeekChunk;
+		libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + libdrbcc_log_seek_offset(drbcc, drbcc->logSeekRead), 128);
+		return;
+	}
+
+	// logSeekLo is the first chunk starting at or after the time, the entry searched may be in the chunk before
+	chunk = drbcc->logSeekLo ? drbcc->logSeekLo - 1 : 0;
+	TRACE(DRBCC_TR_TRANS, "log seek: read from chunk %u", chunk);
+	drbcc->logSeek = 0;
+	drbcc->logSeekSkip = 1;
+	drbcc->start = libdrbcc_log_seek_offset(drbcc, chunk) / 16;
+	libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + libdrbcc_log_seek_offset(drbcc, chunk), 128);
+}
+
+static void libdrbcc_log_seek_start(DRBCC_t *drbcc, unsigned int curr_log_pos)
+{
+	libdrbcc_get_log_oldest(drbcc);
+	// number of chunks with entries
+	drbcc->logSeekHi = ((curr_log_pos * 16 + drbcc->maxFilelength - drbcc->logEnd) % drbcc->maxFilelength + 127) / 128;
+	if (drbcc->logSeekHi == 0)
+	{
+		libdrbcc_get_log_done(drbcc);
+		return;
+	}
+	// read the newest entry for its epoch
+	drbcc->logSeekChunk = drbcc->logSeekHi - 1;
+	drbcc->logSeekRead = drbcc->logSeekChunk;
+	libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + libdrbcc_log_seek_offset(drbcc, drbcc->logSeekRead), 128);
+}
+
+static void libdrbcc_log_seek_data(DRBCC_t *drbcc, uint8_t* data)
+{
+	// the owner of the extension entries in a chunk is the last entry of the chunks before
+	int n = libdrbcc_log_seek_entry(data, (drbcc->logSeek == 1) || (drbcc->logSeekRead != drbcc->logSeekChunk));
+
+	if ((n < 0) && (drbcc->logSeekRead > 0))
+	{
+		drbcc->logSeekRead--;
+		libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + libdrbcc_log_seek_offset(drbcc, drbcc->logSeekRead), 128);
+		return;
+	}
+	if (drbcc->logSeek == 1)
+	{
+		if (n < 0)
+		{
+			// no entry with timestamp
+			libdrbcc_get_log_done(drbcc);
+			return;
+		}
+		drbcc->logSeekEpoch = data[n * 16 + 4];
+		drbcc->logSeek = 2;
+		drbcc->logSeekLo = 0;
+	}
+	else if ((n < 0) || libdrbcc_log_seek_before(drbcc, &data[n * 16]))
+	{
+		drbcc->logSeekLo = drbcc->logSeekChunk + 1;
+	}
+	else
+	{
+		drbcc->logSeekHi = drbcc->logSeekChunk;
+	}
+	libdrbcc_log_seek_next(drbcc);
+}
+
+static void libdrbcc_get_log_data(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int i;
+	unsigned pos = (addr - drbcc->curFilestart) / 16;
+
+	if (drbcc->logReverse)
+	{
+		libdrbcc_get_log_reverse(drbcc, addr, len, data);
+		return;
+	}
+	if (drbcc->logSeek)
+	{
+		libdrbcc_log_seek_data(drbcc, data);
+		return;
+	}
+	for (i = 0; i+16 <= len; i += 16)
+	{
+		if (drbcc->logStop)
+		{
+			libdrbcc_get_log_stopped(drbcc);
+			return;
+		}
+		if (drbcc->logFollow &&
+			((addr + i) == (drbcc->curFilestart + drbcc->curFileIndex * 0x1000 + drbcc->logentry * 16)))
+		{
+			// entries behind the write position are written after the poll, they follow with the next one
+			libdrbcc_get_log_done(drbcc);
+			return;
+		}
+		if (data[i] != 0xff)
+		{
+			if (data[i] != DRBCC_E_EXTENSION)
+			{
+				drbcc->logSkip = 0;
+				if (drbcc->logSeekSkip && !libdrbcc_log_seek_before(drbcc, &data[i]))
+				{
+					// first entry at or after the time searched
+					drbcc->logSeekSkip = 0;
+				}
+				if (drbcc->logSeekSkip || (drbcc->logFiltered && !drbcc->logMirror &&
+					(DRBCC_LOG_FILTER_PASS != libdrbcc_log_filter(&drbcc->logFilter, &data[i]))))
+				{
+					// skip the entry and its extension entries without collecting them
+					if ((data[i + 1] != 0xff) && (data[i + 8] > sizeof(drbcc->dlpf.data)))
+					{
+						drbcc->logSkip = (data[i + 8] - sizeof(drbcc->dlpf.data) + 14) / 15;
+					}
+					continue;
+				}
+				// if (data[i + 1] == 0xff) this is a invalid entry made by AVR programmer
+				if ((data[i + 1] != 0xff) && (data[i + 8] > sizeof(drbcc->dlpf.data)))
+				{
+					if (drbcc->logdata)
+					{
+						free(drbcc->logdata);
+					}
+					drbcc->logdata = malloc(data[i + 8] * 3);
+					memcpy(drbcc->logdata, &data[i], 16);
+					drbcc->logrest = data[i + 8] - sizeof(drbcc->dlpf.data);
+					drbcc->logindex = 16;
+					drbcc->logpos = (pos + i/16);
+				}
+				else
+				{
+					handle_logentry(drbcc, pos + i/16, data[i+8]+9, &data[i]);
+				}
+			}
+			else
+			{
+				if (drbcc->logSkip > 0)
+				{
+					drbcc->logSkip--;
+				}
+				else if(NULL == drbcc->logdata)
+				{
+					// unexpected extention log
+					if (!drbcc->logSeekSkip && (!drbcc->logFiltered || drbcc->logMirror ||
+						(DRBCC_LOG_FILTER_PASS == libdrbcc_log_filter(&drbcc->logFilter, &data[i]))))
+					{
+						handle_logentry(drbcc, pos + i/16, 16, &data[i]);
+					}
+				}
+				// extension log seq ...
+				else if (drbcc->logrest > 15)
+				{
+					memcpy(drbcc->logdata + drbcc->logindex, &data[i + 1], 15);
+					drbcc->logindex += 15;
+					drbcc->logrest -= 15;
+				}
+				else
+				{
+					memcpy(drbcc->logdata + drbcc->logindex, &data[i + 1], drbcc->logrest);
+					// complete
+					handle_logentry(drbcc, drbcc->logpos, drbcc->logdata[8]+9, drbcc->logdata);
+					free(drbcc->logdata);
+					drbcc->logdata = NULL;
+				}
+			}
+		}
+		else  // empty log entry
+		{
+			// stop getting more data
+			if ((addr + i) == (drbcc->curFilestart + drbcc->curFileIndex * 0x1000 + drbcc->logentry * 16))
+			{
+				libdrbcc_get_log_done(drbcc);
+				return;
+			}
+		}
+	}
+
+	if (drbcc->logStop)
+	{
+		libdrbcc_get_log_stopped(drbcc);
+		return;
+	}
+
+	if ((addr + 128) == (drbcc->curFilestart + drbcc->curFileIndex * 0x1000 + drbcc->logentry * 16))
+	{
+		libdrbcc_get_log_done(drbcc);
+		return;
+	}
+
+	if ((addr + 128) == (drbcc->curFilestart + drbcc->maxFilelength)) // end of ring
+	{
+		libdrbcc_req_flash_read(drbcc, drbcc->curFilestart, 128);	// now get entries from start of ring
+	}
+	else
+	{
+		libdrbcc_req_flash_read(drbcc, addr + 128, 128);
+	}
+}
+
+static void libdrbcc_get_log(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	unsigned int i;
+	int logEntry = -1;
+
+	// find log entry
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		if (drbcc->logtype &&
+			(e[i].type.bits.type == DRBCC_FLASHBLOCK_T_RING_LOG) &&
+			(e[i].type.bits.blocktype ==  0x01) )
+		{
+			logEntry = i;
+			break;
+		}
+		if (!drbcc->logtype &&
+			(e[i].type.bits.type == DRBCC_FLASHBLOCK_T_PERS_LOG) &&
+			(e[i].type.bits.blocktype ==  0x01) )
+		{
+			logEntry = i;
+			break;
+		}
+	}
+
+	if (logEntry == -1)
+	{
+		libdrbcc_end_session(drbcc, "Get log failed, partition entry missing", 1);
+		return;
+	}
+	else if (drbcc->logCursor && libdrbcc_get_log_cursor(drbcc, &e[logEntry]))
+	{
+		return;
+	}
+	else
+	{
+		int entries = drbcc->entries;
+		unsigned int abs_entries = entries >= 0 ? entries : -entries;
+		unsigned int curr_log_pos;
+		unsigned int start_addr;
+		drbcc->curFilestart = e[logEntry].startblock * 0x1000;
+		drbcc->maxFilelength =  e[logEntry].length * 0x1000;
+		// cur pos in drbcc->curFileIndex as abs block number
+		drbcc->curFileIndex  = drbcc->curFileIndex - (drbcc->curFilestart / 0x1000);
+		curr_log_pos = drbcc->curFileIndex * 0x1000 / 16 + drbcc->logentry;
+
+		if (drbcc->logReverse)
+		{
+			libdrbcc_get_log_reverse_start(drbcc, curr_log_pos);
+			return;
+		}
+		if (drbcc->logSeek)
+		{
+			libdrbcc_log_seek_start(drbcc, curr_log_pos);
+			return;
+		}
+		if (0xFF == drbcc->logwrapflag)
+		{  // no wrap, start from block 0;
+			if(abs_entries >= (drbcc->maxFilelength/16)) // all
+			{
+				start_addr = 0;
+			}
+			else if(0 > entries) // last x entries
+			{
+				unsigned int last_x = -entries;
+				if(last_x >= curr_log_pos)
+				{
+					drbcc->start = 0;
+					start_addr = 0;
+				}
+				else
+				{
+					drbcc->start = (curr_log_pos-last_x);
+					start_addr =  ((drbcc->start*16) & (~0x7F)); // alignment 128
+				}
+			}
+			else // from entry x to now
+			{
+				unsigned int from_x = entries;
+				if(from_x >= curr_log_pos)
+				{
+					drbcc->start = 0;
+					start_addr = 0;
+				}
+				else
+				{
+					drbcc->start = from_x;
+					start_addr = ((drbcc->start*16) & (~0x7F)); // alignment 128
+				}
+			}
+		}
+		else
+		{
+			if(abs_entries >= (drbcc->maxFilelength/16)) // all
+			{
+				start_addr = drbcc->curFileIndex;
+				start_addr += 1; // log starts from next block
+				start_addr %= (drbcc->maxFilelength / 0x1000); // take ring memory log into account
+				start_addr *= 0x1000; // block to addr offset
+				drbcc->start = (start_addr/16);
+			}
+			else if(0 > entries) // last x entries
+			{
+				unsigned int last_x = -entries;
+				if(last_x > curr_log_pos)
+				{
+					unsigned int rest = (last_x - curr_log_pos);
+					unsigned int from_x = (drbcc->maxFilelength / 16) - 1 - rest; // -1, because pos is an index
+					start_addr = calculate_start_addr_wrap(drbcc, from_x, curr_log_pos);
+				}
+				else
+				{
+					start_addr = calculate_start_addr_wrap(drbcc, curr_log_pos-last_x, curr_log_pos);
+				}
+			}
+			else // from entry x to now
+			{
+				start_addr = calculate_start_addr_wrap(drbcc, entries, curr_log_pos);
+			}
+		}
+
+		libdrbcc_req_flash_read(drbcc, drbcc->curFilestart + start_addr, 128);
+	}
+}
+
+// find the next entry to move by drbcc_compact_flash: the lowest file with a free area below it,
+// the old copy must stay valid until the table is written, a file overlapping its new location *dstblock
+// is moved to a free area *tmpblock elsewhere first (-1: not needed), and from there to *dstblock
+static int libdrbcc_compact_plan(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], int *dstblock, int *tmpblock)
+{
+	int i;
+	int found = -1;
+	DRBCC_PARTENTRY_t others[DRBCC_PART_ENTRIES];
+	DRBCC_ALLOC_t alloc;
+
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		unsigned int n = libdrbcc_entry_blocks(&e[i]);
+		int d;
+		int t = -1;
+
+		// log areas are fixed in the BCTRL firmware
+		if ((n == 0) || e[i].type.bits.blocktype)
+		{
+			continue;
+		}
+		if ((found >= 0) && (e[i].startblock >= e[found].startblock))
+		{
+			continue;
+		}
+
+		// the blocks of the file itself count as free
+		memcpy(others, e, sizeof(others));
+		memset(&others[i], 0xFF, sizeof(others[i]));
+		libdrbcc_alloc_init(&alloc, libdrbcc_flash_blocks(drbcc));
+		libdrbcc_alloc_mark_table(&alloc, others);
+		d = libdrbcc_alloc_find(&alloc, n, DRBCC_ALLOC_FIRST_FIT);
+		if ((d < 0) || (d >= e[i].startblock))
+		{
+			continue;
+		}
+		if (d + n > e[i].startblock)
+		{
+			libdrbcc_alloc_mark(&alloc, d, e[i].startblock + n - d);
+			t = libdrbcc_alloc_find(&alloc, n, DRBCC_ALLOC_BEST_FIT);
+			if (t < 0)
+			{
+				// no room for the intermediate copy
+				continue;
+			}
+		}
+		found = i;
+		*dstblock = d;
+		*tmpblock = t;
+	}
+	return found;
+}
+
+// bytes copied for an entry, whole chunks
+static unsigned int libdrbcc_compact_size(const DRBCC_PARTENTRY_t *e)
+{
+	return ((e->length + CHUNK - 1) / CHUNK) * CHUNK;
+}
+
+static void libdrbcc_compact_done(DRBCC_t *drbcc)
+{
+	char s[256];
+	struct timeval now, dur;
+	unsigned long ms;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &drbcc->compactStart, &dur);
+	ms = dur.tv_sec * 1000 + dur.tv_usec / 1000;
+
+	snprintf(s, sizeof(s), "Flash compaction done, %u file(s) moved, %u bytes copied in %lu.%03lu s (%lu bytes/s)",
+		drbcc->compactFiles, drbcc->curFilelength, ms / 1000, ms % 1000,
+		ms ? (unsigned long) drbcc->curFilelength * 1000 / ms : 0);
+	libdrbcc_end_session(drbcc, s, 1);
+}
+
+// the new location of entry i is still free, the blocks of the file itself count as free
+static int libdrbcc_compact_free(DRBCC_t *drbcc, const DRBCC_PARTENTRY_t e[], int i, int dst)
+{
+	DRBCC_PARTENTRY_t others[DRBCC_PART_ENTRIES];
+	DRBCC_ALLOC_t alloc;
+
+	memcpy(others, e, sizeof(others));
+	memset(&others[i], 0xFF, sizeof(others[i]));
+	libdrbcc_alloc_init(&alloc, libdrbcc_flash_blocks(drbcc));
+	libdrbcc_alloc_mark_table(&alloc, others);
+	return libdrbcc_alloc_is_free(&alloc, dst, libdrbcc_entry_blocks(&e[i]));
+}
+
+// move the next file, one file per partition table update
+static void libdrbcc_compact(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	int i;
+	int dst = 0;
+	int tmp = -1;
+
+	if (!drbcc->partValid)
+	{
+		libdrbcc_end_session(drbcc, "Flash compaction failed, invalid partition table", 0);
+		return;
+	}
+
+	if ((drbcc->compactFiles == 0) && (drbcc->maxFilelength == 0))
+	{
+		// calculate the amount of data to copy for the progress callback
+		DRBCC_PARTENTRY_t sim[DRBCC_PART_ENTRIES];
+
+		memcpy(sim, e, sizeof(sim));
+		while ((i = libdrbcc_compact_plan(drbcc, sim, &dst, &tmp)) >= 0)
+		{
+			drbcc->maxFilelength += libdrbcc_compact_size(&sim[i]) * ((tmp >= 0) ? 2 : 1);
+			sim[i].startblock = dst;
+		}
+	}
+
+	if (drbcc->compactNext >= 0)
+	{
+		// 2nd move of a file moved to an intermediate area
+		i = drbcc->compactEntry;
+		dst = drbcc->compactNext;
+		drbcc->compactNext = -1;
+		if ((e[i].startblock * 0x1000 != drbcc->compactDst) || !libdrbcc_compact_free(drbcc, e, i, dst))
+		{
+			libdrbcc_end_session(drbcc, "Flash compaction failed, partition table changed", 0);
+			return;
+		}
+	}
+	else
+	{
+		i = libdrbcc_compact_plan(drbcc, e, &dst, &tmp);
+		if (i < 0)
+		{
+			libdrbcc_compact_done(drbcc);
+			return;
+		}
+		if (tmp >= 0)
+		{
+			TRACE(DRBCC_TR_TRANS, "partition table entry %i overlaps block %i, move it to block %i first", i, dst, tmp);
+			drbcc->compactNext = dst;
+			dst = tmp;
+		}
+	}
+
+	TRACE(DRBCC_TR_TRANS, "move partition table entry %i from block %u to %i, %u blocks", i, e[i].startblock, dst, libdrbcc_entry_blocks(&e[i]));
+
+	drbcc->compactEntry	= i;
+	drbcc->compactSrc	= e[i].startblock * 0x1000;
+	drbcc->compactDst	= dst * 0x1000;
+	drbcc->compactLen	= libdrbcc_compact_size(&e[i]);
+	drbcc->compactPos	= 0;
+
+	// all reads are queued at once, source and destination do not overlap
+	if (DRBCC_RC_NOERROR != libdrbcc_req_flash_read_all(drbcc, drbcc->compactSrc, drbcc->compactLen))
+	{
+		libdrbcc_end_session(drbcc, "Flash compaction failed, out of memory", 0);
+	}
+}
+
+static void libdrbcc_compact_data(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int dst = drbcc->compactDst + (addr - drbcc->compactSrc);
+
+	if (dst % 0x1000 == 0) // new block
+	{
+		libdrbcc_req_flash_erase_block(drbcc, dst / 0x1000);
+	}
+	if (DRBCC_RC_NOERROR != libdrbcc_req_flash_write(drbcc, dst, len, data))
+	{
+		// the reads still queued are not answered
+		libdrbcc_drop_msg_sec(drbcc, NULL);
+		libdrbcc_end_session(drbcc, "Flash compaction failed, invalid chunk", 0);
+	}
+}
+
+static void libdrbcc_compact_written(DRBCC_t *drbcc, unsigned addr, unsigned len)
+{
+	if (isTableAddr(addr))
+	{
+		if (addr == drbcc->partWriteAddr)
+		{
+			// file moved, continue with the next one
+			if (drbcc->compactNext < 0)
+			{
+				drbcc->compactFiles++;
+			}
+			libdrbcc_request_partition(drbcc);
+		}
+		// wait for the last write of the table update otherwise
+		return;
+	}
+
+	drbcc->compactPos += len;
+	drbcc->curFilelength += len;
+	if (drbcc->progress_cb)
+	{
+		drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
+	}
+
+	if (drbcc->compactPos < drbcc->compactLen)
+	{
+		// more writes queued
+	}
+	else if (drbcc->partValid)
+	{
+		// copy complete, switch the entry to the new location
+		DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+
+		memcpy(e, drbcc->partTable, sizeof(e));
+		e[drbcc->compactEntry].startblock = drbcc->compactDst / 0x1000;
+		libdrbcc_write_partition(drbcc, e, -1, DRBCC_HASH_UNKNOWN);
+	}
+	else
+	{
+		libdrbcc_end_session(drbcc, "Flash compaction failed, partition table changed", 0);
+	}
+}
+
+// continue the current operation with the partition table e[]
+static void libdrbcc_dispatch_partition(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	switch (drbcc->state)
+	{
+	case DRBCC_STATE_PARTITION_REQ:
+		libdrbcc_got_partition(drbcc, e);
+		break;
+	case DRBCC_STATE_DELETE_FILE:
+		libdrbcc_delete(drbcc, e);
+		break;
+	case DRBCC_STATE_GET_FILE:
+		libdrbcc_get_file(drbcc, e);
+		break;
+	case DRBCC_STATE_PUT_FILE:
+		libdrbcc_put_file(drbcc, e);
+		break;
+	case DRBCC_STATE_GET_LOG:
+		libdrbcc_get_log(drbcc, e);
+		break;
+	case DRBCC_STATE_COMMIT_FILES:
+		libdrbcc_commit_files(drbcc, e);
+		break;
+	case DRBCC_STATE_COMPACT_FLASH:
+		libdrbcc_compact(drbcc, e);
+		break;
+	case DRBCC_STATE_FW_UPDATE:
+		libdrbcc_update_partition(drbcc, e);
+		break;
+	default:
+		libdrbcc_end_session(drbcc, "No handler for partition table", 1);
+	}
+}
+
+// use the cached partition table if available, read it from flash otherwise
+DRBCC_RC_t libdrbcc_request_partition(DRBCC_t *drbcc)
+{
+	if (drbcc->partValid)
+	{
+		DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+
+		memcpy(e, drbcc->partTable, sizeof(e));
+		libdrbcc_dispatch_partition(drbcc, e);
+		return DRBCC_RC_NOERROR;
+	}
+	return libdrbcc_read_partition(drbcc);
+}
+
+// take the read and replayed table as the cached table
+static void libdrbcc_got_all(DRBCC_t *drbcc)
+{
+	DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+
+	drbcc->partRead = 0;
+	memcpy(drbcc->partTable, drbcc->journalTable, sizeof(drbcc->partTable));
+	memcpy(drbcc->partHash, drbcc->journalHash, sizeof(drbcc->partHash));
+	drbcc->partValid = 1;
+	memcpy(e, drbcc->journalTable, sizeof(e));
+	libdrbcc_dispatch_partition(drbcc, e);
+}
+
+static void libdrbcc_got_table(DRBCC_t *drbcc, unsigned len, uint8_t* data)
+{
+	DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+	uint32_t hash[DRBCC_PART_ENTRIES];
+	int rc;
+	int epoch;
+	int chunks;
+
+	if (len < 126)
+	{
+		drbcc->partRead = 0;
+		libdrbcc_end_session(drbcc, "Partition table is to short!", 1);
+		return;
+	}
+
+	rc = libdrbcc_parse_partition(data, len, e, hash);
+	if (rc != PART_OK && drbcc->partRead == 1)
+	{
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, (rc == PART_NO_MAGIC) ? "No magic in flash partition table, try other one" :
+				"CRC error in flash partition table, try other one");
+		}
+		drbcc->partDamaged = (rc == PART_CRC_ERROR);
+		drbcc->partRead = 2;
+		drbcc->partPos = 0;
+		libdrbcc_req_flash_read(drbcc, 4096, CHUNK);
+		return;
+	}
+
+	if (drbcc->partRead == 2)
+	{
+		if (rc == PART_NO_MAGIC)
+		{
+			if (drbcc->error_cb)
+			{
+				drbcc->error_cb(drbcc->context, "No magic in 2nd flash partition table, try without");
+			}
+			if (drbcc->partDamaged)
+			{
+				// no new table over the damaged one, no entries known
+				memset(e, 0xFF, sizeof(e));
+				rc = PART_CRC_ERROR;
+			}
+		}
+		else if (rc == PART_OK)
+		{
+			// restore 1st table from backup and read it again
+			libdrbcc_req_flash_erase_block(drbcc, 0);
+			chunks = libdrbcc_write_table_data(drbcc, 0, len, data);
+			drbcc->partRestore = (chunks > 0) ? chunks : 0;
+			drbcc->partRead = 3;
+			drbcc->partPos = 0;
+			libdrbcc_req_flash_read(drbcc, 0, CHUNK);
+			return;
+		}
+	}
+	drbcc->partRead = 0;
+
+	if (rc == PART_NO_MAGIC)
+	{
+		if (drbcc->state == DRBCC_STATE_PARTITION_REQ)
+		{
+			libdrbcc_create_partition(drbcc);
+			libdrbcc_read_partition(drbcc);
+
+			if (drbcc->error_cb)
+			{
+				drbcc->error_cb(drbcc->context, "No magic in flash partition table, creating new one");
+			}
+		}
+		else
+		{
+			// TODO create partition table?
+			libdrbcc_end_session(drbcc, "No magic in flash partition table", 1);
+		}
+		return;
+	}
+
+	if (rc == PART_CRC_ERROR)
+	{
+		// TODO repair partition table?
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, "CRC error in flash partition table");
+		}
+		drbcc->partValid = 0;
+		switch (drbcc->state)
+		{
+		case DRBCC_STATE_DELETE_FILE:
+		case DRBCC_STATE_PUT_FILE:
+		case DRBCC_STATE_COMMIT_FILES:
+		case DRBCC_STATE_COMPACT_FLASH:
+			// no copy verifies, a new table would lose the entries of the damaged one
+			libdrbcc_end_session(drbcc, "Flash partition table damaged, not changed", 0);
+			return;
+		default:
+			break;
+		}
+	}
+	else
+	{
+		drbcc->partVersion = (data[2] == 2) ? 2 : 1;
+		memcpy(drbcc->journalTable, e, sizeof(drbcc->journalTable));
+		memcpy(drbcc->journalHash, hash, sizeof(drbcc->journalHash));
+		epoch = libdrbcc_partition_epoch(data);
+		if (epoch >= 0)
+		{
+			// replay the journal before the table is used
+			drbcc->journalEpoch = epoch;
+			memcpy(drbcc->journalGroup, e, sizeof(drbcc->journalGroup));
+			memcpy(drbcc->journalGroupHash, hash, sizeof(drbcc->journalGroupHash));
+			drbcc->partRead = 4;
+			libdrbcc_req_flash_read(drbcc, JOURNAL_START, CHUNK);
+			return;
+		}
+		drbcc->journalPos = 0;
+		libdrbcc_got_all(drbcc);
+		return;
+	}
+
+	libdrbcc_dispatch_partition(drbcc, e);
+}
+
+// collect a table copy in partBuf, its size follows from the 1st chunk
+static void libdrbcc_got_chunk(DRBCC_t *drbcc, unsigned len, uint8_t* data)
+{
+	unsigned int base = (drbcc->partRead == 2) ? 4096 : 0;
+
+	if (drbcc->partPos + len > sizeof(drbcc->partBuf))
+	{
+		len = sizeof(drbcc->partBuf) - drbcc->partPos;
+	}
+	memcpy(&drbcc->partBuf[drbcc->partPos], data, len);
+	drbcc->partPos += len;
+
+	if ((len == CHUNK) && (drbcc->partPos < libdrbcc_partition_size(drbcc->partBuf, drbcc->partPos)))
+	{
+		libdrbcc_req_flash_read(drbcc, base + drbcc->partPos, CHUNK);
+		return;
+	}
+	libdrbcc_got_table(drbcc, drbcc->partPos, drbcc->partBuf);
+}
+
+// apply the journal records, only complete record groups are used
+static void libdrbcc_got_journal(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int i;
+	unsigned int size = libdrbcc_record_size(drbcc->partVersion);
+	int rc = RECORD_EMPTY;
+
+	for (i = 0; i + size <= len; i += size)
+	{
+		rc = libdrbcc_parse_record(drbcc, &data[i], drbcc->journalGroup, drbcc->journalGroupHash);
+		if (rc < 0)
+		{
+			break;
+		}
+		if (rc & JOURNAL_LAST)
+		{
+			memcpy(drbcc->journalTable, drbcc->journalGroup, sizeof(drbcc->journalTable));
+			memcpy(drbcc->journalHash, drbcc->journalGroupHash, sizeof(drbcc->journalHash));
+		}
+	}
+	if (rc >= 0 && i > 0 && addr + i < JOURNAL_END)
+	{
+		libdrbcc_req_flash_read(drbcc, addr + i, CHUNK);
+		return;
+	}
+	if (rc == RECORD_EMPTY && libdrbcc_same_table(drbcc->journalGroup, drbcc->journalTable) &&
+		!memcmp(drbcc->journalGroupHash, drbcc->journalHash, sizeof(drbcc->journalHash)))
+	{
+		drbcc->journalPos = addr + i;
+	}
+	else
+	{
+		// journal full, damaged or interrupted update: rewrite the table with the next update
+		drbcc->journalPos = 0;
+	}
+	TRACE(DRBCC_TR_TRANS, "partition table journal replayed up to 0x%04X", addr + i);
+	libdrbcc_got_all(drbcc);
+}
+
+void libdrbcc_readflash_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	if (drbcc->partRead == 4)
+	{
+		libdrbcc_got_journal(drbcc, addr, len, data);
+		return;
+	}
+	if (drbcc->partRead)
+	{
+		libdrbcc_got_chunk(drbcc, len, data);
+		return;
+	}
+
+	switch (drbcc->state)
+	{
+	case DRBCC_STATE_GET_FILE:
+		libdrbcc_get_file_data(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_PUT_FILE:
+		libdrbcc_put_verify_data(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_PUT_DIFF:
+		libdrbcc_put_diff_data(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_GET_LOG:
+		libdrbcc_get_log_data(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_COMPACT_FLASH:
+		libdrbcc_compact_data(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_FLASH_BACKUP:
+	case DRBCC_STATE_FLASH_RESTORE:
+		libdrbcc_image_read_cb(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_READ_INTO:
+		libdrbcc_read_into_cb(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_WRITE_SG:
+		libdrbcc_sg_read_cb(drbcc, addr, len, data);
+		break;
+	case DRBCC_STATE_FW_UPDATE:
+		libdrbcc_update_read_cb(drbcc, addr, len, data);
+		break;
+	default:
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, "No handler for read flash callback");
+		}
+		if (drbcc->session_cb)
+		{
+			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+		}
+		drbcc->session = 0;
+	}
+}
+
+void libdrbcc_logpos_cb(DRBCC_t *drbcc)
+{
+	switch(drbcc->state)
+	{
+	case DRBCC_STATE_GET_LOG:
+		libdrbcc_request_partition(drbcc);
+		break;
+	default:
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, "No handler for logpos callback");
+		}
+		if (drbcc->session_cb)
+		{
+			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+		}
+		drbcc->session = 0;
+	}
+}
+
+void libdrbcc_writeflash_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result)
+{
+	if (!result)
+	{
+		// flash content is unknown now
+		libdrbcc_invalidate_partition(drbcc);
+	}
+
+	if (drbcc->partRestore > 0)
+	{
+		// 1st table restored from backup, the table is read again afterwards
+		drbcc->partRestore--;
+		if (!result && drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, "Restoring flash partition table failed");
+		}
+		return;
+	}
+
+	switch(drbcc->state)
+	{
+	case DRBCC_STATE_PARTITION_REQ:
+		// new partition table created, nothing to do
+		break;
+	case DRBCC_STATE_GET_FILE:
+	case DRBCC_STATE_GET_LOG:
+		// nothing to do
+		break;
+	case DRBCC_STATE_DELETE_FILE:
+		if (result && addr != drbcc->partWriteAddr)
+		{
+			// wait for the last write of the table update
+			break;
+		}
+		drbcc->state = DRBCC_STATE_USER;
+		if (drbcc->error_cb)
+		{
+			if (result)
+			{
+				drbcc->error_cb(drbcc->context, "Flash file successfully deleted.");
+			}
+			else
+			{
+				drbcc->error_cb(drbcc->context, "Delete flash file failed!");
+			}
+		}
+		if (drbcc->session_cb)
+		{
+			if (result)
+			{
+				drbcc->session_cb(drbcc->context, drbcc->session, 1);
+			}
+			else
+			{
+				drbcc->session_cb(drbcc->context, drbcc->session, 0);
+			}
+		}
+		drbcc->session = 0;
+		break;
+	case DRBCC_STATE_PUT_DIFF:
+		libdrbcc_put_diff_written(drbcc, addr, len, result);
+		break;
+	case DRBCC_STATE_FLASH_BACKUP:
+		// nothing to do
+		break;
+	case DRBCC_STATE_FLASH_RESTORE:
+		libdrbcc_image_write_cb(drbcc, addr, len, result);
+		break;
+	case DRBCC_STATE_WRITE_SG:
+		libdrbcc_sg_write_cb(drbcc, addr, len, result);
+		break;
+	case DRBCC_STATE_COMPACT_FLASH:
+		if (result)
+		{
+			libdrbcc_compact_written(drbcc, addr, len);
+		}
+		else
+		{
+			// the moves still queued must not reach the flash
+			libdrbcc_drop_msg_sec(drbcc, NULL);
+			libdrbcc_end_session(drbcc, "Flash compaction failed, write error", 0);
+		}
+		break;
+	case DRBCC_STATE_PUT_FILE:
+	case DRBCC_STATE_COMMIT_FILES:
+		if (result)
+		{
+			if (!isTableAddr(addr))
+			{
+				drbcc->curFilelength += len;
+				if (drbcc->state == DRBCC_STATE_PUT_FILE)
+				{
+					libdrbcc_checkpoint_update(drbcc, drbcc->curFilelength);
+				}
+			}
+			if (drbcc->progress_cb)
+			{
+				drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
+			}
+			if (addr == drbcc->partWriteAddr && drbcc->curFilelength == drbcc->maxFilelength)
+			{
+				if (drbcc->state == DRBCC_STATE_PUT_FILE)
+				{
+					libdrbcc_checkpoint_clear(drbcc);
+				}
+				libdrbcc_end_session(drbcc, (drbcc->state == DRBCC_STATE_COMMIT_FILES) ?
+					"Flash files successfully committed" : "Put flash file successfully done", 1);
+			}
+		}
+		else
+		{
+			// drop the rest of the file data
+			libdrbcc_drop_msg_sec(drbcc, NULL);
+			libdrbcc_end_session(drbcc, "Flash file error result", 0);
+		}
+		break;
+	default:
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, "No handler for write flash callback");
+		}
+		if (drbcc->session_cb)
+		{
+			drbcc->session_cb(drbcc->context, drbcc->session, 1);
+		}
+		drbcc->session = 0;
+	}
+}
+
+DRBCC_RC_t drbcc_register_partition_cb(DRBCC_HANDLE_t h, DRBCC_PARTITION_TABLE_CB_t cb)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->partitiontable_cb = cb;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_register_progress_cb(DRBCC_HANDLE_t h, DRBCC_PROGRESS_CB_t cb)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->progress_cb = cb;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_register_getlog_cb(DRBCC_HANDLE_t h, DRBCC_GETLOG_CB_t cb)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->getlog_cb = cb;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_register_getpos_cb(DRBCC_HANDLE_t h, DRBCC_GETPOS_CB_t cb)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->getpos_cb = cb;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_register_debug_get_cb(DRBCC_HANDLE_t h, DRBCC_DEBUG_GET_CB_t cb)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->debug_get_cb = cb;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_set_alloc_policy(DRBCC_HANDLE_t h, DRBCC_ALLOC_POLICY_t policy)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->allocPolicy = policy;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_set_log_filter(DRBCC_HANDLE_t h, const DRBCC_LOG_FILTER_t *filter)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+	memset(&drbcc->logFilter, 0, sizeof(drbcc->logFilter));
+	if (filter)
+	{
+		memcpy(&drbcc->logFilter, filter, sizeof(drbcc->logFilter));
+	}
+	drbcc->logFiltered = drbcc->logFilter.events || drbcc->logFilter.from || drbcc->logFilter.to || drbcc->logFilter.minEpoch;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_set_partition_journal(DRBCC_HANDLE_t h, int on)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	drbcc->partJournal = on ? 1 : 0;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_set_partition_format(DRBCC_HANDLE_t h, int version)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	if ((version < 0) || (version > 2))
+	{
+		return DRBCC_RC_UNSPEC_ERROR;
+	}
+	drbcc->partFormat = version;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_get_partitiontable(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	drbcc->state = DRBCC_STATE_PARTITION_REQ;
+
+	// always read the table from flash, this also refreshes the cached copy
+	return libdrbcc_read_partition(drbcc);
+}
+
+DRBCC_RC_t drbcc_delete_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type)
+{
+	return drbcc_delete_file(h, session, type | 0x80000000);
+}
+
+DRBCC_RC_t drbcc_delete_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	if(index & 0x80000000)
+	{
+		drbcc->curFileType = ((index>>4) & 0xF);
+	}
+	drbcc->curFileIndex = index;
+	drbcc->state = DRBCC_STATE_DELETE_FILE;
+	return libdrbcc_request_partition(drbcc);
+}
+
+DRBCC_RC_t drbcc_get_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type, const char filename[])
+{
+	return drbcc_get_file(h, session, type | 0x80000000, filename);
+}
+
+DRBCC_RC_t drbcc_get_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, const char filename[])
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | OX_BINARY, 0666 );
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	close(fd);
+
+	strncpy(drbcc->curFilename, filename, FILENAME_MAX - 1);
+	drbcc->curFilename[FILENAME_MAX - 1] = 0;
+	drbcc->ioFd = -1;
+	drbcc->ioMem = NULL;
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	if(index & 0x80000000)
+	{
+		drbcc->curFileType = ((index>>4) & 0xF);
+	}
+	drbcc->curFileIndex = index;
+	drbcc->resume = 0;
+	drbcc->state = DRBCC_STATE_GET_FILE;
+	return libdrbcc_request_partition(drbcc);
+}
+
+DRBCC_RC_t libdrbcc_prepare_put_file(DRBCC_t *drbcc, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[], int diff)
+{
+	int fd = open(filename, O_RDONLY | OX_BINARY);
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	drbcc->maxFilelength = lseek(fd, 0, SEEK_END);
+	close(fd);
+
+	if (drbcc->maxFilelength <= 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+
+	strncpy(drbcc->curFilename, filename, FILENAME_MAX - 1);
+	drbcc->curFilename[FILENAME_MAX - 1] = 0;
+	drbcc->ioFd = -1;
+	drbcc->ioMem = NULL;
+	drbcc->curFilelength = 0;
+	drbcc->curFileIndex = index;
+	drbcc->curFileType = type;
+	drbcc->resume = 0;
+	drbcc->putDiff = diff;
+	drbcc->state = DRBCC_STATE_PUT_FILE;
+	return DRBCC_RC_NOERROR;
+}
+
+static DRBCC_RC_t libdrbcc_start_put_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[], int diff)
+{
+	DRBCC_t *drbcc = h;
+	DRBCC_RC_t rc;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	rc = libdrbcc_prepare_put_file(drbcc, index, type, filename, diff);
+	if (rc != DRBCC_RC_NOERROR)
+	{
+		return rc;
+	}
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+
+	// 1st read partition
+	return libdrbcc_request_partition(drbcc);
+}
+
+DRBCC_RC_t drbcc_put_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[])
+{
+	return libdrbcc_start_put_file(h, session, index, type, filename, 0);
+}
+
+DRBCC_RC_t drbcc_put_file_diff(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[])
+{
+	return libdrbcc_start_put_file(h, session, index, type, filename, 1);
+}
+
+static DRBCC_RC_t libdrbcc_start_get_io(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, int fd, uint8_t *buf, unsigned size)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	if ((fd < 0) && (buf == NULL))
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+
+	snprintf(drbcc->curFilename, FILENAME_MAX, buf ? "memory" : "fd %i", fd);
+	drbcc->ioFd = buf ? -1 : fd;
+	drbcc->ioMem = buf;
+	drbcc->ioSize = size;
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	if(index & 0x80000000)
+	{
+		drbcc->curFileType = ((index>>4) & 0xF);
+	}
+	drbcc->curFileIndex = index;
+	drbcc->resume = 0;
+	drbcc->state = DRBCC_STATE_GET_FILE;
+	return libdrbcc_request_partition(drbcc);
+}
+
+DRBCC_RC_t drbcc_get_file_fd(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, int fd)
+{
+	return libdrbcc_start_get_io(h, session, index, fd, NULL, 0);
+}
+
+DRBCC_RC_t drbcc_get_file_mem(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, uint8_t *buf, unsigned size)
+{
+	return libdrbcc_start_get_io(h, session, index, -1, buf, size);
+}
+
+DRBCC_RC_t drbcc_get_file_length(DRBCC_HANDLE_t h, unsigned *length)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	*length = drbcc->curFilelength;
+	return DRBCC_RC_NOERROR;
+}
+
+static DRBCC_RC_t libdrbcc_start_put_io(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, int fd, const uint8_t *buf, unsigned length)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	if (((fd < 0) && (buf == NULL)) || (length == 0))
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+
+	snprintf(drbcc->curFilename, FILENAME_MAX, buf ? "memory" : "fd %i", fd);
+	drbcc->ioFd = buf ? -1 : fd;
+	drbcc->ioMem = (uint8_t*) buf;	// not modified by put file
+	drbcc->ioSize = length;
+	drbcc->maxFilelength = length;
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	drbcc->curFilelength = 0;
+	drbcc->curFileIndex = index;
+	drbcc->curFileType = type;
+	drbcc->resume = 0;
+	drbcc->putDiff = 0;
+	drbcc->state = DRBCC_STATE_PUT_FILE;
+
+	// 1st read partition
+	return libdrbcc_request_partition(drbcc);
 }
 
-DRBCC_RC_t drbcc_register_partition_cb(DRBCC_HANDLE_t h, DRBCC_PARTITION_TABLE_CB_t cb)
+DRBCC_RC_t drbcc_put_file_fd(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, int fd, unsigned length)
 {
-	DRBCC_t *drbcc = h;
-
-	CHECK_HANDLE(drbcc);
-
-	drbcc->partitiontable_cb = cb;
-	return DRBCC_RC_NOERROR;
+	return libdrbcc_start_put_io(h, session, index, type, fd, NULL, length);
 }
 
-DRBCC_RC_t drbcc_register_progress_cb(DRBCC_HANDLE_t h, DRBCC_PROGRESS_CB_t cb)
+DRBCC_RC_t drbcc_put_file_mem(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const uint8_t *buf, unsigned length)
 {
-	DRBCC_t *drbcc = h;
-
-	CHECK_HANDLE(drbcc);
-
-	drbcc->progress_cb = cb;
-	return DRBCC_RC_NOERROR;
+	return libdrbcc_start_put_io(h, session, index, type, -1, buf, length);
 }
 
-DRBCC_RC_t drbcc_register_getlog_cb(DRBCC_HANDLE_t h, DRBCC_GETLOG_CB_t cb)
+DRBCC_RC_t drbcc_register_checkpoint(DRBCC_HANDLE_t h, DRBCC_CHECKPOINT_t *cp, const char *sidecar)
 {
 	DRBCC_t *drbcc = h;
 
 	CHECK_HANDLE(drbcc);
 
-	drbcc->getlog_cb = cb;
+	drbcc->checkpoint = cp;
+	memset(drbcc->checkpointFile, 0, sizeof(drbcc->checkpointFile));
+	if (sidecar)
+	{
+		strncpy(drbcc->checkpointFile, sidecar, FILENAME_MAX - 1);
+	}
 	return DRBCC_RC_NOERROR;
 }
 
-DRBCC_RC_t drbcc_register_getpos_cb(DRBCC_HANDLE_t h, DRBCC_GETPOS_CB_t cb)
+DRBCC_RC_t drbcc_load_checkpoint(const char *sidecar, DRBCC_CHECKPOINT_t *cp)
 {
-	DRBCC_t *drbcc = h;
+	ssize_t rd;
+	int fd = open(sidecar, O_RDONLY | OX_BINARY);
 
-	CHECK_HANDLE(drbcc);
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	rd = read(fd, cp, sizeof(DRBCC_CHECKPOINT_t));
+	close(fd);
 
-	drbcc->getpos_cb = cb;
+	if ((rd != (ssize_t)sizeof(DRBCC_CHECKPOINT_t)) || (cp->magic != DRBCC_CHECKPOINT_MAGIC))
+	{
+		return DRBCC_RC_INVALID_CHECKPOINT;
+	}
 	return DRBCC_RC_NOERROR;
 }
 
-DRBCC_RC_t drbcc_register_debug_get_cb(DRBCC_HANDLE_t h, DRBCC_DEBUG_GET_CB_t cb)
+// checkpoint matches the 1st cp->offset bytes of filename?
+static DRBCC_RC_t libdrbcc_check_checkpoint(const DRBCC_CHECKPOINT_t *cp, int direction, const char filename[])
 {
-	DRBCC_t *drbcc = h;
-
-	CHECK_HANDLE(drbcc);
+	uint16_t crc = 0xffff;
 
-	drbcc->debug_get_cb = cb;
+	if ((cp == NULL) || (cp->magic != DRBCC_CHECKPOINT_MAGIC) || (cp->direction != direction) ||
+		(cp->offset > cp->length) || (cp->length == 0))
+	{
+		return DRBCC_RC_INVALID_CHECKPOINT;
+	}
+	if (libdrbcc_file_crc(filename, 0, cp->offset, &crc))
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	if (crc != cp->crc)
+	{
+		return DRBCC_RC_INVALID_CHECKPOINT;
+	}
 	return DRBCC_RC_NOERROR;
 }
 
-DRBCC_RC_t drbcc_get_partitiontable(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session)
+DRBCC_RC_t drbcc_get_file_resume(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const DRBCC_CHECKPOINT_t *cp, const char filename[])
 {
+	DRBCC_RC_t rc;
 	DRBCC_t *drbcc = h;
 	CHECK_HANDLE(drbcc);
 
@@ -1464,20 +3659,31 @@ DRBCC_RC_t drbcc_get_partitiontable(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session)
 		return DRBCC_RC_SESSIONACTIVE;
 	}
 
+	// the local file must still contain the bytes read so far
+	rc = libdrbcc_check_checkpoint(cp, 0, filename);
+	if (rc != DRBCC_RC_NOERROR)
+	{
+		return rc;
+	}
+
+	memcpy(&drbcc->cp, cp, sizeof(drbcc->cp));
+	strncpy(drbcc->curFilename, filename, FILENAME_MAX - 1);
+	drbcc->curFilename[FILENAME_MAX - 1] = 0;
+	drbcc->ioFd = -1;
+	drbcc->ioMem = NULL;
 	drbcc->session = drbcc_session++;
 	*session = drbcc->session;
-	drbcc->state = DRBCC_STATE_PARTITION_REQ;
-
+	drbcc->curFileType = (cp->typeinfo >> 4) & 0xF;
+	drbcc->curFileIndex = cp->typeinfo | 0x80000000;
+	drbcc->resume = 1;
+	drbcc->state = DRBCC_STATE_GET_FILE;
 	return libdrbcc_request_partition(drbcc);
 }
 
-DRBCC_RC_t drbcc_delete_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type)
-{
-	return drbcc_delete_file(h, session, type | 0x80000000);
-}
-
-DRBCC_RC_t drbcc_delete_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index)
+DRBCC_RC_t drbcc_put_file_resume(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const DRBCC_CHECKPOINT_t *cp, const char filename[])
 {
+	DRBCC_RC_t rc;
+	off_t length;
 	DRBCC_t *drbcc = h;
 	CHECK_HANDLE(drbcc);
 
@@ -1491,57 +3697,146 @@ DRBCC_RC_t drbcc_delete_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ind
 		return DRBCC_RC_SESSIONACTIVE;
 	}
 
-	drbcc->session = drbcc_session++;
-	*session = drbcc->session;
-	if(index & 0x80000000)
+	int fd = open(filename, O_RDONLY | OX_BINARY);
+	if (fd < 0)
 	{
-		drbcc->curFileType = ((index>>4) & 0xF);
+		return DRBCC_RC_INVALID_FILENAME;
 	}
-	drbcc->curFileIndex = index;
-	drbcc->state = DRBCC_STATE_DELETE_FILE;
+	length = lseek(fd, 0, SEEK_END);
+	close(fd);
+
+	// same file as in the interrupted upload
+	rc = libdrbcc_check_checkpoint(cp, 1, filename);
+	if (rc != DRBCC_RC_NOERROR)
+	{
+		return rc;
+	}
+	if ((length != (off_t)cp->length) || (cp->typeinfo & 0x80))
+	{
+		return DRBCC_RC_INVALID_CHECKPOINT;
+	}
+
+	memcpy(&drbcc->cp, cp, sizeof(drbcc->cp));
+	strncpy(drbcc->curFilename, filename, FILENAME_MAX - 1);
+	drbcc->curFilename[FILENAME_MAX - 1] = 0;
+	drbcc->ioFd = -1;
+	drbcc->ioMem = NULL;
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	drbcc->curFilelength = 0;
+	drbcc->maxFilelength = cp->length;
+	drbcc->curFileIndex = cp->typeinfo & 0xF;
+	drbcc->curFileType = (cp->typeinfo >> 4) & 0x7;
+	drbcc->resume = 1;
+	drbcc->resumeVerified = 0;
+	drbcc->putDiff = 0;
+	drbcc->state = DRBCC_STATE_PUT_FILE;
+
+	// 1st read partition
 	return libdrbcc_request_partition(drbcc);
 }
 
-DRBCC_RC_t drbcc_get_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type, const char filename[])
+DRBCC_RC_t drbcc_put_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type, const char filename[])
 {
-	return drbcc_get_file(h, session, type | 0x80000000, filename);
+	return drbcc_put_file(h, session, type & 0xF, (type>>4) & 0xF, filename);
 }
 
-DRBCC_RC_t drbcc_get_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, const char filename[])
+static void libdrbcc_add_fileop(DRBCC_t *drbcc, DRBCC_FILEOP_t *op)
+{
+	DRBCC_FILEOP_t **p = &drbcc->fileOps;
+
+	// keep the order of the operations
+	while (*p)
+	{
+		p = (DRBCC_FILEOP_t **) &(*p)->next;
+	}
+	op->next = NULL;
+	*p = op;
+}
+
+DRBCC_RC_t drbcc_files_begin(DRBCC_HANDLE_t h)
 {
 	DRBCC_t *drbcc = h;
 	CHECK_HANDLE(drbcc);
 
-	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	if (drbcc->fileOpsActive)
 	{
-		return DRBCC_RC_CBREGISTERED;
+		return DRBCC_RC_WRONGSTATE;
 	}
 
-	if (drbcc->session)
+	if (drbcc->session && (drbcc->state == DRBCC_STATE_COMMIT_FILES))
 	{
 		return DRBCC_RC_SESSIONACTIVE;
 	}
 
-	int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | OX_BINARY, 0666 );
+	libdrbcc_free_fileops(drbcc);
+	drbcc->fileOpsActive = 1;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_files_put(DRBCC_HANDLE_t h, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[])
+{
+	DRBCC_FILEOP_t *op;
+	off_t length;
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (!drbcc->fileOpsActive)
+	{
+		return DRBCC_RC_WRONGSTATE;
+	}
+
+	int fd = open(filename, O_RDONLY | OX_BINARY);
 	if (fd < 0)
 	{
 		return DRBCC_RC_INVALID_FILENAME;
 	}
+	length = lseek(fd, 0, SEEK_END);
 	close(fd);
 
-	strncpy(drbcc->curFilename, filename, FILENAME_MAX);
-	drbcc->session = drbcc_session++;
-	*session = drbcc->session;
-	if(index & 0x80000000)
+	if (length <= 0)
 	{
-		drbcc->curFileType = ((index>>4) & 0xF);
+		return DRBCC_RC_INVALID_FILENAME;
 	}
-	drbcc->curFileIndex = index;
-	drbcc->state = DRBCC_STATE_GET_FILE;
-	return libdrbcc_request_partition(drbcc);
+
+	op = malloc(sizeof(DRBCC_FILEOP_t));
+	if (op == NULL)
+	{
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+	memset(op, 0, sizeof(DRBCC_FILEOP_t));
+	op->put = 1;
+	op->type = ((type & 0x07) << 4) | (index & 0x0F);
+	op->length = length;
+	strncpy(op->filename, filename, FILENAME_MAX - 1);
+	libdrbcc_add_fileop(drbcc, op);
+	return DRBCC_RC_NOERROR;
 }
 
-DRBCC_RC_t drbcc_put_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[])
+DRBCC_RC_t drbcc_files_delete(DRBCC_HANDLE_t h, int type)
+{
+	DRBCC_FILEOP_t *op;
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (!drbcc->fileOpsActive)
+	{
+		return DRBCC_RC_WRONGSTATE;
+	}
+
+	op = malloc(sizeof(DRBCC_FILEOP_t));
+	if (op == NULL)
+	{
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+	memset(op, 0, sizeof(DRBCC_FILEOP_t));
+	op->put = 0;
+	op->type = type & 0xFF;
+	libdrbcc_add_fileop(drbcc, op);
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_files_commit(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session)
 {
 	DRBCC_t *drbcc = h;
 	CHECK_HANDLE(drbcc);
@@ -1556,36 +3851,65 @@ DRBCC_RC_t drbcc_put_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index,
 		return DRBCC_RC_SESSIONACTIVE;
 	}
 
-	int fd = open(filename, O_RDONLY | OX_BINARY);
-	if (fd < 0)
+	if (!drbcc->fileOpsActive)
 	{
-		return DRBCC_RC_INVALID_FILENAME;
+		return DRBCC_RC_WRONGSTATE;
 	}
-	drbcc->maxFilelength = lseek(fd, 0, SEEK_END);
-	close(fd);
 
-	if (drbcc->maxFilelength <= 0)
+	drbcc->fileOpsActive = 0;
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	drbcc->ioFd = -1;
+	drbcc->ioMem = NULL;
+	drbcc->state = DRBCC_STATE_COMMIT_FILES;
+
+	// 1st read partition
+	return libdrbcc_request_partition(drbcc);
+}
+
+DRBCC_RC_t drbcc_files_abort(DRBCC_HANDLE_t h)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (!drbcc->fileOpsActive)
 	{
-		return DRBCC_RC_INVALID_FILENAME;
+		return DRBCC_RC_WRONGSTATE;
+	}
+
+	libdrbcc_free_fileops(drbcc);
+	drbcc->fileOpsActive = 0;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_compact_flash(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
 	}
 
-	strncpy(drbcc->curFilename, filename, FILENAME_MAX);
 	drbcc->session = drbcc_session++;
 	*session = drbcc->session;
 	drbcc->curFilelength = 0;
-	drbcc->curFileIndex = index;
-	drbcc->curFileType = type;
-	drbcc->state = DRBCC_STATE_PUT_FILE;
+	drbcc->maxFilelength = 0;
+	drbcc->compactFiles = 0;
+	drbcc->compactNext = -1;
+	gettimeofday(&drbcc->compactStart, NULL);
+	drbcc->state = DRBCC_STATE_COMPACT_FLASH;
 
 	// 1st read partition
 	return libdrbcc_request_partition(drbcc);
 }
 
-DRBCC_RC_t drbcc_put_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type, const char filename[])
-{
-	return drbcc_put_file(h, session, type & 0xF, (type>>4) & 0xF, filename);
-}
-
 DRBCC_RC_t drbcc_upload_firmware(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *filename)
 {
 	// FW image has allways index 0 to be used by XMega
@@ -1637,7 +3961,48 @@ DRBCC_RC_t drbcc_put_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, i
 	return DRBCC_RC_OUTOFMEMORY;
 }
 
-DRBCC_RC_t drbcc_get_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, int entries)
+static DRBCC_RC_t libdrbcc_request_log_pos(DRBCC_t *drbcc)
+{
+	DRBCC_MESSAGE_t *msg = malloc(sizeof(DRBCC_MESSAGE_t));
+
+	if (msg == NULL)
+	{
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+	msg->msg_len = 2;
+	msg->msg[0] = DRBCC_REQ_RINGLOG_POS;
+
+	libdrbcc_add_msg_prio(drbcc, msg);
+	return DRBCC_RC_NOERROR;
+}
+
+void libdrbcc_log_follow_poll(DRBCC_t *drbcc, const struct timeval *now)
+{
+	if (!drbcc->logFollowWait || (0 == drbcc->session))
+	{
+		return;
+	}
+	if (drbcc->logStop)
+	{
+		libdrbcc_get_log_stopped(drbcc);
+		return;
+	}
+	if (drbcc->wait_for_ack || drbcc->prioQueue || !timercmp(now, &drbcc->logFollowNext, >))
+	{
+		return;
+	}
+	drbcc->logFollowWait = 0;
+	drbcc->start = 0;
+	drbcc->logSkip = 0;
+	if (DRBCC_RC_NOERROR != libdrbcc_request_log_pos(drbcc))
+	{
+		drbcc->logFollow = 0;
+		libdrbcc_end_session(drbcc, "Log follow failed, out of memory", 0);
+	}
+}
+
+static DRBCC_RC_t libdrbcc_start_get_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, int entries,
+	DRBCC_LOG_CURSOR_t *cursor, const char *sidecar, int reverse)
 {
 	DRBCC_t *drbcc = h;
 	CHECK_HANDLE(drbcc);
@@ -1655,28 +4020,120 @@ DRBCC_RC_t drbcc_get_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, i
 	drbcc->logtype = ring;
 	drbcc->start = 0;
 	drbcc->entries = entries;
+	drbcc->logReverse = reverse;
+	drbcc->logStop = 0;
+	drbcc->logSkip = 0;
+	drbcc->logSeek = 0;
+	drbcc->logSeekSkip = 0;
+	drbcc->logCount = 0;
+	drbcc->logCursor = cursor;
+	strncpy(drbcc->logCursorFile, sidecar ? sidecar : "", FILENAME_MAX - 1);
+	drbcc->logCursorFile[FILENAME_MAX - 1] = 0;
+	drbcc->logFollow = 0;
+	drbcc->logFollowWait = 0;
+	drbcc->logFollowCb = NULL;
+	drbcc->logAggregate = NULL;
 	drbcc->state = DRBCC_STATE_GET_LOG;
 
-	if (ring)
+	if (ring && (DRBCC_RC_NOERROR != libdrbcc_request_log_pos(drbcc)))
 	{
-		DRBCC_MESSAGE_t *msg = malloc(sizeof(DRBCC_MESSAGE_t));
+		return DRBCC_RC_OUTOFMEMORY;	// 1st read partition
+	}
 
-		if (msg != NULL)
-		{
-			msg->msg_len = 2;
-			msg->msg[0] = DRBCC_REQ_RINGLOG_POS;
+	drbcc->curFileIndex = 0;
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_get_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, int entries)
+{
+	return libdrbcc_start_get_log(h, session, ring, entries, NULL, NULL, 0);
+}
+
+DRBCC_RC_t drbcc_get_log_reverse(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int entries)
+{
+	return libdrbcc_start_get_log(h, session, 1, (entries > 0) ? entries : 0, NULL, NULL, 1);
+}
+
+DRBCC_RC_t drbcc_log_seek_time(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, time_t time, int entries)
+{
+	DRBCC_t *drbcc = h;
+	DRBCC_RC_t rc = libdrbcc_start_get_log(h, session, 1, 0, NULL, NULL, 0);
+
+	if (rc == DRBCC_RC_NOERROR)
+	{
+		drbcc->logSeek = 1;
+		drbcc->logSeekTime = time;
+		drbcc->logCount = (entries > 0) ? entries : 0;
+	}
+	return rc;
+}
+
+DRBCC_RC_t drbcc_log_follow(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, DRBCC_LOG_CURSOR_t *cursor,
+	DRBCC_GETLOG_CB_t cb, unsigned int interval)
+{
+	DRBCC_t *drbcc = h;
+	DRBCC_RC_t rc = libdrbcc_start_get_log(h, session, 1, 0, &drbcc->logFollowCursor, NULL, 0);
 
-			libdrbcc_add_msg_prio(drbcc, msg);
+	if (rc == DRBCC_RC_NOERROR)
+	{
+		if (cursor)
+		{
+			memcpy(&drbcc->logFollowCursor, cursor, sizeof(DRBCC_LOG_CURSOR_t));
 		}
 		else
 		{
-			return DRBCC_RC_OUTOFMEMORY;	// 1st read partition
+			memset(&drbcc->logFollowCursor, 0, sizeof(DRBCC_LOG_CURSOR_t));
 		}
+		drbcc->logFollow = 1;
+		drbcc->logFollowCb = cb;
+		drbcc->logFollowUser = cursor;
+		drbcc->logFollowMax = interval ? interval : DRBCC_LOG_FOLLOW_INTERVAL;
+		drbcc->logFollowMs = DRBCC_LOG_FOLLOW_MIN;
 	}
+	return rc;
+}
 
-	drbcc->curFileIndex = 0;
-	drbcc->session = drbcc_session++;
-	*session = drbcc->session;
+DRBCC_RC_t drbcc_get_log_stop(DRBCC_HANDLE_t h)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->state != DRBCC_STATE_GET_LOG)
+	{
+		return DRBCC_RC_WRONGSTATE;
+	}
+	drbcc->logStop = 1;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_get_log_since(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, DRBCC_LOG_CURSOR_t *cursor, const char *sidecar)
+{
+	if (cursor == NULL)
+	{
+		return DRBCC_RC_INVALID_CHECKPOINT;
+	}
+	// entries are set from the cursor when the log area is known
+	return libdrbcc_start_get_log(h, session, 1, 0, cursor, sidecar, 0);
+}
+
+DRBCC_RC_t drbcc_load_log_cursor(const char *sidecar, DRBCC_LOG_CURSOR_t *cursor)
+{
+	ssize_t rd;
+	int fd = open(sidecar, O_RDONLY | OX_BINARY);
+
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	rd = read(fd, cursor, sizeof(DRBCC_LOG_CURSOR_t));
+	close(fd);
+
+	if ((rd != (ssize_t)sizeof(DRBCC_LOG_CURSOR_t)) || (cursor->magic != DRBCC_LOG_CURSOR_MAGIC))
+	{
+		return DRBCC_RC_INVALID_CHECKPOINT;
+	}
 	return DRBCC_RC_NOERROR;
 }
 
@@ -38,6 +38,18 @@ DRBCC_RC_t drbcc_register_getpos_cb(DRBCC_HANDLE_t h, DRBCC_GETPOS_CB_t cb);
 DRBCC_RC_t drbcc_register_debug_get_cb(DRBCC_HANDLE_t h, DRBCC_DEBUG_GET_CB_t cb);
 
 // Functions
+// placement of new files, default: DRBCC_ALLOC_BEST_FIT
+DRBCC_RC_t drbcc_set_alloc_policy(DRBCC_HANDLE_t h, DRBCC_ALLOC_POLICY_t policy);
+
+// on: write partition table changes as records to the journal in flash blocks 2-3 instead of rewriting
+// blocks 0-1 each time, older readers still see the table of the last rewrite, default: off
+DRBCC_RC_t drbcc_set_partition_journal(DRBCC_HANDLE_t h, int on);
+
+// format of partition table rewrites: 1: 20 entries, readable by older versions, 2: 64 entries with 32 bit fields,
+// 0: keep the format found in flash (default), format 2 is used anyway if entries beyond the format 1 table are in use
+// older versions misread a format 2 table and overwrite it when they change a file
+DRBCC_RC_t drbcc_set_partition_format(DRBCC_HANDLE_t h, int version);
+
 DRBCC_RC_t drbcc_get_pos(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
 
 DRBCC_RC_t drbcc_clear_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
@@ -45,6 +57,40 @@ DRBCC_RC_t drbcc_clear_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
 // get logs
 DRBCC_RC_t drbcc_get_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, int entries);
 
+// get the ring log entries appended since the last call, cursor must stay valid until the session ends,
+// it is updated and written to the sidecar file (may be NULL) when all entries are fetched,
+// call it at least once per ring cycle, a complete wrap between two calls can't be detected
+DRBCC_RC_t drbcc_get_log_since(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, DRBCC_LOG_CURSOR_t *cursor, const char *sidecar);
+
+DRBCC_RC_t drbcc_load_log_cursor(const char *sidecar, DRBCC_LOG_CURSOR_t *cursor);
+
+// get the newest ring log entries first, read backwards from the write position, entries: number of entries (0: all)
+DRBCC_RC_t drbcc_get_log_reverse(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int entries);
+
+// get the ring log entries from the first one at or after time, binary search with one read per step,
+// entries: number of entries (0: up to the newest), entries of RTC epochs before the newest are older than any time
+DRBCC_RC_t drbcc_log_seek_time(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, time_t time, int entries);
+
+// poll intervals of drbcc_log_follow in ms: after new entries and default when idle
+#define DRBCC_LOG_FOLLOW_MIN		100
+#define DRBCC_LOG_FOLLOW_INTERVAL	1000
+
+// pass the ring log entries to cb (NULL: getlog callback) as they are written until drbcc_get_log_stop,
+// the write position is polled from drbcc_trigger, every DRBCC_LOG_FOLLOW_MIN ms after new entries, the interval
+// doubles with every poll without new entries up to interval ms (0: DRBCC_LOG_FOLLOW_INTERVAL), only the
+// 128 byte chunks holding new entries are read, cursor (may be NULL: entries from now on) is updated after each poll
+DRBCC_RC_t drbcc_log_follow(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, DRBCC_LOG_CURSOR_t *cursor,
+	DRBCC_GETLOG_CB_t cb, unsigned int interval);
+
+// end a running get log session successfully after the current entry, may be called from the getlog callback,
+// the cursor of drbcc_get_log_since is not updated
+DRBCC_RC_t drbcc_get_log_stop(DRBCC_HANDLE_t h);
+
+// entries passed to the getlog callback by drbcc_get_log, drbcc_get_log_since and drbcc_get_log_reverse,
+// NULL: all entries, drbcc_get_log_reverse stops reading at the first entry older than filter->minEpoch
+// or older than filter->from in epoch filter->minEpoch
+DRBCC_RC_t drbcc_set_log_filter(DRBCC_HANDLE_t h, const DRBCC_LOG_FILTER_t *filter);
+
 // put log entry
 DRBCC_RC_t drbcc_put_log(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ring, int len, uint8_t data[]);
 
@@ -58,11 +104,42 @@ DRBCC_RC_t drbcc_get_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index,
 DRBCC_RC_t drbcc_get_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type, const char filename[]);
 
 // index: laufende 4bit Nummer bei Mehrfacheintrgen gleichen Typs
+// skipped if the file in flash has the same size and content hash (FNV-1a, stored with the partition table)
 DRBCC_RC_t drbcc_put_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[]);
 
+// like drbcc_put_file, if a file of the same type and size exists only the changed 4K blocks are rewritten in place
+DRBCC_RC_t drbcc_put_file_diff(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[]);
+
 // file type (bit 0-3 fileindex, bit 4-7 filetype)
 DRBCC_RC_t drbcc_put_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type, const char filename[]);
 
+// like drbcc_get_file (index or file type | 0x80000000), data written in order to fd (may be a pipe), fd is not closed
+DRBCC_RC_t drbcc_get_file_fd(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, int fd);
+
+// like drbcc_get_file_fd, data written to buf, the session fails if the file is larger than size
+DRBCC_RC_t drbcc_get_file_mem(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, uint8_t *buf, unsigned size);
+
+// number of bytes of the last get/put file
+DRBCC_RC_t drbcc_get_file_length(DRBCC_HANDLE_t h, unsigned *length);
+
+// like drbcc_put_file, length bytes read from fd (may be a pipe), fd is not closed
+DRBCC_RC_t drbcc_put_file_fd(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, int fd, unsigned length);
+
+// like drbcc_put_file, buf must stay valid until the session ends
+DRBCC_RC_t drbcc_put_file_mem(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int index, DRBCC_FLASHFILE_TYPES_t type, const uint8_t *buf, unsigned length);
+
+// checkpoints of drbcc_get_file / drbcc_put_file are written to cp and/or to the sidecar file (both may be NULL)
+// every 4K, the checkpoint is cleared when the transfer is complete
+DRBCC_RC_t drbcc_register_checkpoint(DRBCC_HANDLE_t h, DRBCC_CHECKPOINT_t *cp, const char *sidecar);
+
+DRBCC_RC_t drbcc_load_checkpoint(const char *sidecar, DRBCC_CHECKPOINT_t *cp);
+
+// continue an interrupted drbcc_get_file, the local file must contain the data read so far
+DRBCC_RC_t drbcc_get_file_resume(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const DRBCC_CHECKPOINT_t *cp, const char filename[]);
+
+// continue an interrupted drbcc_put_file after reading back the data written so far
+DRBCC_RC_t drbcc_put_file_resume(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const DRBCC_CHECKPOINT_t *cp, const char filename[]);
+
 // index: entry in partition table
 // 0: Ring-Log-Bereich, default-size 508 Blcke (2032 KByte, 130048 Log-Eintrge)
 // 1: persistenter Log-Bereich, default-size 64 Blcke (256 KByte, 16384 Log-Eintrge)
@@ -72,10 +149,43 @@ DRBCC_RC_t drbcc_delete_file(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int ind
 // file type (bit 0-3 fileindex, bit 4-7 filetype)
 DRBCC_RC_t drbcc_delete_file_type(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int type);
 
+// file transaction: collect put and delete operations, the partition table is written once by drbcc_files_commit()
+DRBCC_RC_t drbcc_files_begin(DRBCC_HANDLE_t h);
+
+// index: laufende 4bit Nummer bei Mehrfacheintrgen gleichen Typs
+DRBCC_RC_t drbcc_files_put(DRBCC_HANDLE_t h, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[]);
+
+// file type (bit 0-3 fileindex, bit 4-7 filetype)
+DRBCC_RC_t drbcc_files_delete(DRBCC_HANDLE_t h, int type);
+
+// all operations are planned before anything is queued, the commit fails without changing the flash if one of
+// them can not be done (table full, no space left, file changed), a read error while the files are queued drops
+// the requests queued so far, files with the same content hash as the entry in flash are not written again
+DRBCC_RC_t drbcc_files_commit(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
+
+DRBCC_RC_t drbcc_files_abort(DRBCC_HANDLE_t h);
+
+// move files down into free areas, one file per partition table update, a file overlapping its new location
+// is moved to a free area elsewhere first (it stays if there is none large enough)
+// can be restarted after a power loss, the flash is consistent after each step
+DRBCC_RC_t drbcc_compact_flash(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
+
 DRBCC_RC_t drbcc_upload_firmware(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *fname);
 
 DRBCC_RC_t drbcc_upload_bootloader(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *fname);
 
+// flags of drbcc_update_firmware
+#define DRBCC_UPDATE_RESTART_NOW	0x01	// restart immediately, default: at next host power off, done after restart accepted
+#define DRBCC_UPDATE_NO_WAIT		0x02	// done after restart accepted, don't wait for the new firmware
+
+// seconds to wait for the new firmware after the restart
+#define DRBCC_UPDATE_TIMEOUT		120
+
+// put boot loader (optional, may be NULL) and firmware, read both back and compare, invalidate the running firmware,
+// request the restart and wait for the new firmware, update_cb (may be NULL) is called at the end of every phase
+DRBCC_RC_t drbcc_update_firmware(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *firmware, const char *bootloader,
+	unsigned int flags, DRBCC_UPDATE_CB_t update_cb);
+
 DRBCC_RC_t drbcc_eject_hd(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session);
 
 DRBCC_RC_t drbcc_hd_power(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int onoff);
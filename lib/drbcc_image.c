@@ -0,0 +1,739 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation, either version 3 of the 
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "drbcc_image.h"
+#include "drbcc_ll.h"
+#include "drbcc_trace.h"
+#include "drbcc_utils.h"
+#include "drbcc_alloc.h"
+
+#if USE_OPEN_BINARY
+#define OX_BINARY O_BINARY
+#else
+#define OX_BINARY 0
+#endif
+
+#define CHUNK 128
+#define DRBCC_PROGRAM_WINDOW	64	// max. queued chunk writes of the sequential programming
+
+extern int libdrbcc_initialized;
+extern DRBCC_SESSION_t drbcc_session;
+
+static int libdrbcc_write_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len)
+	{
+		ssize_t wr = write(fd, data, len);
+		if (wr <= 0)
+		{
+			return -1;
+		}
+		data += wr;
+		len -= wr;
+	}
+	return 0;
+}
+
+static int libdrbcc_read_all(int fd, uint8_t *data, size_t len)
+{
+	while (len)
+	{
+		ssize_t rd = read(fd, data, len);
+		if (rd <= 0)
+		{
+			return -1;
+		}
+		data += rd;
+		len -= rd;
+	}
+	return 0;
+}
+
+static void libdrbcc_image_free(DRBCC_t *drbcc)
+{
+	free(drbcc->imageData);
+	free(drbcc->imageFlash);
+	drbcc->imageData = NULL;
+	drbcc->imageFlash = NULL;
+}
+
+// write one block record to the image file
+static int libdrbcc_image_record(int fd, unsigned int block, const uint8_t *data)
+{
+	uint8_t rec[2];
+
+	rec[0] = (uint8_t) (block & 0xFF);
+	rec[1] = (uint8_t) ((block >> 8) & 0xFF);
+	if (libdrbcc_write_all(fd, rec, sizeof(rec)))
+	{
+		return -1;
+	}
+	if (data && libdrbcc_write_all(fd, data, DRBCC_BLOCK_SIZE))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static int libdrbcc_image_header(int fd, unsigned int blocks)
+{
+	uint8_t header[DRBCC_IMAGE_HEADER_SIZE];
+
+	memcpy(header, DRBCC_IMAGE_MAGIC, 8);
+	header[8]  = (uint8_t) ((blocks >>  0) & 0xFF);
+	header[9]  = (uint8_t) ((blocks >>  8) & 0xFF);
+	header[10] = (uint8_t) ((blocks >> 16) & 0xFF);
+	header[11] = (uint8_t) ((blocks >> 24) & 0xFF);
+	header[12] = (uint8_t) ((DRBCC_BLOCK_SIZE >>  0) & 0xFF);
+	header[13] = (uint8_t) ((DRBCC_BLOCK_SIZE >>  8) & 0xFF);
+	header[14] = 0;
+	header[15] = 0;
+	return libdrbcc_write_all(fd, header, sizeof(header));
+}
+
+static void libdrbcc_image_done(DRBCC_t *drbcc, const char *what, unsigned long bytes)
+{
+	char s[256];
+	struct timeval now, dur;
+	unsigned long ms;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &drbcc->imageStart, &dur);
+	ms = dur.tv_sec * 1000 + dur.tv_usec / 1000;
+
+	snprintf(s, sizeof(s), "%s done, %u blocks with data, %u blocks skipped, %lu bytes in %lu.%03lu s (%lu bytes/s)",
+		what, drbcc->imageWritten, drbcc->imageSkipped, bytes, ms / 1000, ms % 1000, ms ? bytes * 1000 / ms : 0);
+	libdrbcc_image_free(drbcc);
+	libdrbcc_end_session(drbcc, s, 1);
+}
+
+static void libdrbcc_image_fail(DRBCC_t *drbcc, const char *msg)
+{
+	// nothing queued for this image operation is sent any more
+	libdrbcc_drop_msg_sec(drbcc, NULL);
+	libdrbcc_image_free(drbcc);
+	libdrbcc_end_session(drbcc, msg, 0);
+}
+
+static void libdrbcc_image_progress(DRBCC_t *drbcc)
+{
+	if (drbcc->progress_cb)
+	{
+		drbcc->progress_cb(drbcc->context, drbcc->imageBlock * DRBCC_BLOCK_SIZE, drbcc->imageBlocks * DRBCC_BLOCK_SIZE);
+	}
+}
+
+// read the next block from flash
+static void libdrbcc_image_request(DRBCC_t *drbcc)
+{
+	drbcc->imageRead = 0;
+	if (DRBCC_RC_NOERROR != libdrbcc_req_flash_read_all(drbcc, drbcc->imageBlock * DRBCC_BLOCK_SIZE, DRBCC_BLOCK_SIZE))
+	{
+		libdrbcc_image_fail(drbcc, "Out of memory during flash image operation");
+	}
+}
+
+static void libdrbcc_backup_block(DRBCC_t *drbcc)
+{
+	if (!libdrbcc_is_empty(drbcc->imageFlash, DRBCC_BLOCK_SIZE))
+	{
+		if (libdrbcc_image_record(drbcc->imageFd, drbcc->imageBlock, drbcc->imageFlash))
+		{
+			libdrbcc_image_fail(drbcc, "Writing flash image file failed");
+			return;
+		}
+		drbcc->imageWritten++;
+	}
+	else
+	{
+		drbcc->imageSkipped++;
+	}
+
+	drbcc->imageBlock++;
+	libdrbcc_image_progress(drbcc);
+
+	if (drbcc->imageBlock < drbcc->imageBlocks)
+	{
+		libdrbcc_image_request(drbcc);
+	}
+	else if (libdrbcc_image_record(drbcc->imageFd, DRBCC_IMAGE_END, NULL))
+	{
+		libdrbcc_image_fail(drbcc, "Writing flash image file failed");
+	}
+	else
+	{
+		libdrbcc_image_done(drbcc, "Flash backup", (unsigned long) drbcc->imageBlocks * DRBCC_BLOCK_SIZE);
+	}
+}
+
+// block number of the next record in the image
+static int libdrbcc_restore_record(DRBCC_t *drbcc)
+{
+	uint8_t rec[2];
+
+	if (libdrbcc_read_all(drbcc->imageFd, rec, sizeof(rec)))
+	{
+		return -1;
+	}
+	drbcc->imageNext = rec[0] | (rec[1] << 8);
+	if ((drbcc->imageNext != DRBCC_IMAGE_END) && (drbcc->imageNext >= drbcc->imageBlocks))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+// go to the next block to be written and get its data from the image
+// returns 0: block loaded, 1: all blocks processed, -1: invalid image
+static int libdrbcc_restore_load(DRBCC_t *drbcc)
+{
+	// blocks without data are processed only if they are erased, never verified
+	if ((drbcc->imageVerify || !(drbcc->imageFlags & DRBCC_RESTORE_ERASE_EMPTY)) && (drbcc->imageBlock < drbcc->imageNext))
+	{
+		unsigned int next = (drbcc->imageNext == DRBCC_IMAGE_END) ? drbcc->imageBlocks : drbcc->imageNext;
+
+		if (!drbcc->imageVerify)
+		{
+			drbcc->imageSkipped += next - drbcc->imageBlock;
+		}
+		drbcc->imageBlock = next;
+	}
+
+	if (drbcc->imageBlock >= drbcc->imageBlocks)
+	{
+		drbcc->imageBlock = drbcc->imageBlocks;
+		return 1;
+	}
+
+	if (drbcc->imageBlock == drbcc->imageNext)
+	{
+		if (libdrbcc_read_all(drbcc->imageFd, drbcc->imageData, DRBCC_BLOCK_SIZE) ||
+			libdrbcc_restore_record(drbcc))
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		memset(drbcc->imageData, 0xFF, DRBCC_BLOCK_SIZE);
+	}
+	return 0;
+}
+
+// erase the block and write the chunks with data
+static void libdrbcc_restore_write(DRBCC_t *drbcc)
+{
+	unsigned int i;
+	unsigned int addr = drbcc->imageBlock * DRBCC_BLOCK_SIZE;
+
+	libdrbcc_req_flash_erase_block(drbcc, drbcc->imageBlock);
+	for (i = 0; i < DRBCC_BLOCK_SIZE; i += CHUNK)
+	{
+		// erased flash is 0xFF
+		if (!libdrbcc_is_empty(&drbcc->imageData[i], CHUNK))
+		{
+			libdrbcc_req_flash_write(drbcc, addr + i, CHUNK, &drbcc->imageData[i]);
+			drbcc->imagePending++;
+		}
+	}
+	drbcc->imageWritten++;
+}
+
+static void libdrbcc_verify_next(DRBCC_t *drbcc);
+
+// all writes acknowledged
+static void libdrbcc_restore_finish(DRBCC_t *drbcc)
+{
+	unsigned long bytes = (unsigned long) drbcc->imageWritten * DRBCC_BLOCK_SIZE;
+
+	if ((drbcc->imageFlags & DRBCC_RESTORE_VERIFY) && !drbcc->imageVerify)
+	{
+		// 2nd pass: read back all blocks with data
+		drbcc->imageVerify = 1;
+		drbcc->imageBlock = 0;
+		drbcc->imageDone = 0;
+		if ((lseek(drbcc->imageFd, DRBCC_IMAGE_HEADER_SIZE, SEEK_SET) != DRBCC_IMAGE_HEADER_SIZE) ||
+			libdrbcc_restore_record(drbcc))
+		{
+			libdrbcc_image_fail(drbcc, "Flash verify failed, can't read image file");
+			return;
+		}
+		libdrbcc_verify_next(drbcc);
+		return;
+	}
+
+	if (drbcc->imageFlags & DRBCC_RESTORE_PROGRAM)
+	{
+		libdrbcc_image_done(drbcc, drbcc->imageVerify ? "Flash program and verify" : "Flash program", bytes);
+	}
+	else
+	{
+		libdrbcc_image_done(drbcc, drbcc->imageVerify ? "Flash restore and verify" : "Flash restore", bytes);
+	}
+}
+
+// continue with the next block having data in the image, or with the next block if empty blocks are erased
+static void libdrbcc_restore_next(DRBCC_t *drbcc)
+{
+	int rc = libdrbcc_restore_load(drbcc);
+
+	if (rc < 0)
+	{
+		libdrbcc_image_fail(drbcc, "Invalid flash image file");
+	}
+	else if (rc > 0)
+	{
+		drbcc->imageDone = 1;
+		if (drbcc->imagePending == 0)
+		{
+			libdrbcc_restore_finish(drbcc);
+		}
+	}
+	else
+	{
+		libdrbcc_image_request(drbcc);
+	}
+}
+
+static void libdrbcc_restore_block(DRBCC_t *drbcc)
+{
+	if (memcmp(drbcc->imageData, drbcc->imageFlash, DRBCC_BLOCK_SIZE) == 0)
+	{
+		drbcc->imageSkipped++;
+	}
+	else
+	{
+		libdrbcc_restore_write(drbcc);
+	}
+
+	drbcc->imageBlock++;
+	libdrbcc_image_progress(drbcc);
+	libdrbcc_restore_next(drbcc);
+}
+
+// sequential programming: erase and write the blocks in order without reading the flash,
+// at most DRBCC_PROGRAM_WINDOW writes are queued
+static void libdrbcc_program_fill(DRBCC_t *drbcc)
+{
+	int rc;
+
+	while (!drbcc->imageDone && (drbcc->imagePending < DRBCC_PROGRAM_WINDOW))
+	{
+		rc = libdrbcc_restore_load(drbcc);
+		if (rc < 0)
+		{
+			libdrbcc_image_fail(drbcc, "Invalid flash image file");
+			return;
+		}
+		if (rc > 0)
+		{
+			drbcc->imageDone = 1;
+			break;
+		}
+		libdrbcc_restore_write(drbcc);
+		drbcc->imageBlock++;
+		libdrbcc_image_progress(drbcc);
+	}
+
+	if (drbcc->imageDone && (drbcc->imagePending == 0))
+	{
+		libdrbcc_restore_finish(drbcc);
+	}
+}
+
+static void libdrbcc_verify_next(DRBCC_t *drbcc)
+{
+	int rc = libdrbcc_restore_load(drbcc);
+
+	if (rc < 0)
+	{
+		libdrbcc_image_fail(drbcc, "Invalid flash image file");
+	}
+	else if (rc > 0)
+	{
+		libdrbcc_restore_finish(drbcc);
+	}
+	else
+	{
+		libdrbcc_image_request(drbcc);
+	}
+}
+
+static void libdrbcc_verify_block(DRBCC_t *drbcc)
+{
+	if (memcmp(drbcc->imageData, drbcc->imageFlash, DRBCC_BLOCK_SIZE) != 0)
+	{
+		char s[64];
+
+		snprintf(s, sizeof(s), "Flash verify failed at block %u", drbcc->imageBlock);
+		libdrbcc_image_fail(drbcc, s);
+		return;
+	}
+
+	drbcc->imageBlock++;
+	libdrbcc_image_progress(drbcc);
+	libdrbcc_verify_next(drbcc);
+}
+
+void libdrbcc_image_read_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int offset = addr - drbcc->imageBlock * DRBCC_BLOCK_SIZE;
+
+	if ((drbcc->imageFlash == NULL) || (offset + len > DRBCC_BLOCK_SIZE))
+	{
+		return;
+	}
+	memcpy(&drbcc->imageFlash[offset], data, len);
+	drbcc->imageRead += len;
+	if (drbcc->imageRead < DRBCC_BLOCK_SIZE)
+	{
+		return;
+	}
+
+	if (drbcc->state == DRBCC_STATE_FLASH_BACKUP)
+	{
+		libdrbcc_backup_block(drbcc);
+	}
+	else if (drbcc->imageVerify)
+	{
+		libdrbcc_verify_block(drbcc);
+	}
+	else
+	{
+		libdrbcc_restore_block(drbcc);
+	}
+}
+
+void libdrbcc_image_write_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result)
+{
+	(void) len;
+	if (drbcc->imageData == NULL)
+	{
+		return;
+	}
+	if (!result)
+	{
+		TRACE_WARN("writing flash address 0x%06x failed", addr);
+		libdrbcc_image_fail(drbcc, "Flash restore failed, write error");
+		return;
+	}
+	if (drbcc->imagePending)
+	{
+		drbcc->imagePending--;
+	}
+	if (!drbcc->imageDone && (drbcc->imageFlags & DRBCC_RESTORE_PROGRAM))
+	{
+		libdrbcc_program_fill(drbcc);
+	}
+	else if (drbcc->imageDone && (drbcc->imagePending == 0))
+	{
+		libdrbcc_restore_finish(drbcc);
+	}
+}
+
+static DRBCC_RC_t libdrbcc_image_start(DRBCC_t *drbcc, DRBCC_SESSION_t *session, int fd, DRBCC_STATES_t state)
+{
+	drbcc->imageData = malloc(DRBCC_BLOCK_SIZE);
+	drbcc->imageFlash = malloc(DRBCC_BLOCK_SIZE);
+	if ((drbcc->imageData == NULL) || (drbcc->imageFlash == NULL))
+	{
+		libdrbcc_image_free(drbcc);
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+
+	drbcc->imageFd = fd;
+	drbcc->imageBlock = 0;
+	drbcc->imageWritten = 0;
+	drbcc->imageSkipped = 0;
+	drbcc->imagePending = 0;
+	drbcc->imageDone = 0;
+	drbcc->imageVerify = 0;
+	gettimeofday(&drbcc->imageStart, NULL);
+
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	drbcc->state = state;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_flash_backup(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int fd)
+{
+	unsigned int blocks;
+	DRBCC_RC_t rc;
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	blocks = libdrbcc_flash_blocks(drbcc);
+	if (libdrbcc_image_header(fd, blocks))
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+
+	rc = libdrbcc_image_start(drbcc, session, fd, DRBCC_STATE_FLASH_BACKUP);
+	if (rc == DRBCC_RC_NOERROR)
+	{
+		drbcc->imageBlocks = blocks;
+		libdrbcc_image_request(drbcc);
+	}
+	return rc;
+}
+
+DRBCC_RC_t drbcc_flash_restore(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int fd, unsigned int flags)
+{
+	uint8_t header[DRBCC_IMAGE_HEADER_SIZE];
+	unsigned int blocks;
+	DRBCC_RC_t rc;
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	if (libdrbcc_read_all(fd, header, sizeof(header)) || memcmp(header, DRBCC_IMAGE_MAGIC, 8) ||
+		((header[12] | (header[13] << 8) | (header[14] << 16) | (header[15] << 24)) != DRBCC_BLOCK_SIZE))
+	{
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+	blocks = header[8] | (header[9] << 8) | (header[10] << 16) | (header[11] << 24);
+	if ((blocks == 0) || (blocks > libdrbcc_flash_blocks(drbcc)))
+	{
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+
+	rc = libdrbcc_image_start(drbcc, session, fd, DRBCC_STATE_FLASH_RESTORE);
+	if (rc == DRBCC_RC_NOERROR)
+	{
+		drbcc->imageBlocks = blocks;
+		drbcc->imageFlags = flags;
+
+		// partition table is overwritten
+		libdrbcc_invalidate_partition(drbcc);
+
+		if (libdrbcc_restore_record(drbcc))
+		{
+			libdrbcc_image_fail(drbcc, "Invalid flash image file");
+		}
+		else if (flags & DRBCC_RESTORE_PROGRAM)
+		{
+			libdrbcc_program_fill(drbcc);
+		}
+		else
+		{
+			libdrbcc_restore_next(drbcc);
+		}
+	}
+	return rc;
+}
+
+// copy the file into the image, the blocks of the file follow in ascending order
+static DRBCC_RC_t libdrbcc_image_file(int fd, const char *filename, const DRBCC_PARTENTRY_t *entry)
+{
+	uint8_t data[DRBCC_BLOCK_SIZE];
+	unsigned int offset, len;
+	int in = open(filename, O_RDONLY | OX_BINARY);
+
+	if (in < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+
+	for (offset = 0; offset < entry->length; offset += DRBCC_BLOCK_SIZE)
+	{
+		memset(data, 0xFF, sizeof(data));
+		len = entry->length - offset;
+		if (len > sizeof(data))
+		{
+			len = sizeof(data);
+		}
+		if (libdrbcc_read_all(in, data, len))
+		{
+			close(in);
+			return DRBCC_RC_INVALID_FILENAME;
+		}
+		if (!libdrbcc_is_empty(data, sizeof(data)) &&
+			libdrbcc_image_record(fd, entry->startblock + offset / DRBCC_BLOCK_SIZE, data))
+		{
+			close(in);
+			return DRBCC_RC_SYSTEM_ERROR;
+		}
+	}
+	close(in);
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_image_build(DRBCC_HANDLE_t h, int fd, unsigned int blocks, const DRBCC_IMAGE_FILE_t files[], unsigned int count)
+{
+	DRBCC_PARTENTRY_t e[DRBCC_PART_ENTRIES];
+	int fileEntry[DRBCC_PART_ENTRIES];	// index into files[] or -1
+	uint32_t hash[DRBCC_PART_ENTRIES];
+	uint8_t data[DRBCC_BLOCK_SIZE];
+	DRBCC_ALLOC_t alloc;
+	DRBCC_RC_t rc;
+	struct stat st;
+	unsigned int i, j, n;
+	int startblock;
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	if (blocks == 0)
+	{
+		blocks = DRBCC_DEFAULT_BLOCKS;
+	}
+	if ((blocks > DRBCC_MAX_BLOCKS) || (count > DRBCC_IMAGE_MAX_FILES))
+	{
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+
+	// same layout as put file on an empty flash
+	libdrbcc_default_partition(e);
+	libdrbcc_alloc_init(&alloc, blocks);
+	libdrbcc_alloc_mark_table(&alloc, e);
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		fileEntry[i] = -1;
+		hash[i] = DRBCC_HASH_UNKNOWN;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if ((stat(files[i].filename, &st) != 0) || (st.st_size == 0) || (st.st_size > 0xFFFFFF))
+		{
+			return DRBCC_RC_INVALID_FILENAME;
+		}
+
+		// images use the format 1 table
+		for (j = 0; j < DRBCC_PART_V1_ENTRIES; j++)
+		{
+			if (e[j].type.typeinfo == 0xFF)
+			{
+				break;
+			}
+			if ((e[j].type.bits.blocktype == 0) && (e[j].type.bits.type == (files[i].type & 0x07)) &&
+				(e[j].type.bits.idx == (files[i].index & 0x0F)))
+			{
+				// file given twice
+				return DRBCC_RC_INVALID_IMAGE;
+			}
+		}
+		if (j == DRBCC_PART_V1_ENTRIES)
+		{
+			return DRBCC_RC_INVALID_IMAGE;
+		}
+
+		n = (st.st_size + DRBCC_BLOCK_SIZE - 1) / DRBCC_BLOCK_SIZE;
+		startblock = libdrbcc_alloc_find(&alloc, n, drbcc->allocPolicy);
+		if (startblock < 0)
+		{
+			return DRBCC_RC_INVALID_IMAGE;
+		}
+		libdrbcc_alloc_mark(&alloc, startblock, n);
+
+		TRACE(DRBCC_TR_TRANS, "image entry %u start block %i length %li: %s", j, startblock, (long) st.st_size, files[i].filename);
+
+		e[j].type.bits.blocktype	= 0;
+		e[j].type.bits.type			= files[i].type;
+		e[j].type.bits.idx			= files[i].index;
+		e[j].startblock				= startblock;
+		e[j].length					= st.st_size;	// size in bytes
+		fileEntry[j] = i;
+		if (libdrbcc_file_hash(files[i].filename, &hash[j]))
+		{
+			return DRBCC_RC_INVALID_FILENAME;
+		}
+	}
+
+	// both table copies
+	memset(data, 0xFF, sizeof(data));
+	libdrbcc_build_partition(e, data);
+	libdrbcc_build_hashes(hash, &data[128]);
+	if (libdrbcc_image_header(fd, blocks) || libdrbcc_image_record(fd, 0, data) || libdrbcc_image_record(fd, 1, data))
+	{
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+
+	// files in ascending flash order
+	for (n = 0; n < count; n++)
+	{
+		int next = -1;
+
+		for (j = 0; j < DRBCC_PART_ENTRIES; j++)
+		{
+			if ((fileEntry[j] >= 0) && ((next < 0) || (e[j].startblock < e[next].startblock)))
+			{
+				next = j;
+			}
+		}
+		rc = libdrbcc_image_file(fd, files[fileEntry[next]].filename, &e[next]);
+		if (rc != DRBCC_RC_NOERROR)
+		{
+			return rc;
+		}
+		fileEntry[next] = -1;
+	}
+
+	if (libdrbcc_image_record(fd, DRBCC_IMAGE_END, NULL))
+	{
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+	return DRBCC_RC_NOERROR;
+}
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+* 
+* NO CODE BELOW THIS! */
@@ -0,0 +1,81 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation, either version 3 of the 
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DRBCC_IMAGE_
+#define _DRBCC_IMAGE_
+
+#include <stdint.h>
+#include <drbcc_com.h>
+#include <drbcc.h>
+
+/* Flash image file (sparse):
+* 16 byte header:
+	o 8 byte magic "DRBCCBAK"
+	o 4 byte number of 4K blocks of the flash, LSB first
+	o 4 byte block size (4096), LSB first
+* one record per block containing data (not all bytes 0xFF), in ascending order:
+	o 2 byte block number, LSB first
+	o 4096 byte block data
+* 2 byte end marker 0xFFFF
+*/
+
+#define DRBCC_IMAGE_MAGIC		"DRBCCBAK"
+#define DRBCC_IMAGE_HEADER_SIZE	16
+#define DRBCC_IMAGE_END			0xFFFF
+
+// drbcc_flash_restore flags
+#define DRBCC_RESTORE_ERASE_EMPTY	0x01	// erase blocks without data in the image, too
+#define DRBCC_RESTORE_PROGRAM		0x02	// sequential programming, erase and write without comparing the flash content
+#define DRBCC_RESTORE_VERIFY		0x04	// read back and compare all blocks with data at the end
+
+#define DRBCC_IMAGE_MAX_FILES		18		// the log areas use 2 of the 20 partition table entries
+
+// file of drbcc_image_build
+typedef struct
+{
+	int index;						// sub-number
+	DRBCC_FLASHFILE_TYPES_t type;
+	const char *filename;			// local file
+} DRBCC_IMAGE_FILE_t;
+
+// write the whole flash to the image file fd
+DRBCC_RC_t drbcc_flash_backup(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int fd);
+
+// write the image file fd to flash, blocks with same content are skipped
+// (DRBCC_RESTORE_PROGRAM: all blocks with data are written)
+DRBCC_RC_t drbcc_flash_restore(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int fd, unsigned int flags);
+
+// build the image of a flash with blocks 4k blocks (0: 4 MByte) offline, containing
+// the partition table and the files placed like put file does on an empty flash
+// (with the allocation policy of the handle)
+DRBCC_RC_t drbcc_image_build(DRBCC_HANDLE_t h, int fd, unsigned int blocks, const DRBCC_IMAGE_FILE_t files[], unsigned int count);
+
+#endif /* _DRBCC_IMAGE_ */
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+* 
+* NO CODE BELOW THIS! */
@@ -59,6 +59,7 @@ static int trace_category = DRHIP_TCAT_0;
 int libdrbcc_initialized = 0;
 
 void libdrbcc_free_queue(DRBCC_MESSAGE_t *msg);
+void libdrbcc_free_fileops(DRBCC_t *drbcc);
 
 #define LOCKDIR "/var/lock"
 #define TIMEOUT 2
@@ -358,6 +359,8 @@ DRBCC_RC_t drbcc_open(DRBCC_HANDLE_t* h)
 
 	drbcc->last_error = DRBCC_RC_NOERROR;
 	drbcc->fd = -1;
+	drbcc->ioFd = -1;
+	drbcc->diffFd = -1;
 	drbcc->send_toggle = 0;
 	drbcc->expected_recv_toggle = 0;
 	drbcc->prioQueue = NULL;
@@ -441,6 +444,16 @@ DRBCC_RC_t drbcc_close(DRBCC_HANDLE_t h)
 
 	libdrbcc_free_queue(drbcc->secQueue);
 	libdrbcc_free_queue(drbcc->prioQueue);
+	libdrbcc_free_fileops(drbcc);
+	free(drbcc->diffBlocks);
+	if (drbcc->diffFd >= 0)
+	{
+		close(drbcc->diffFd);
+	}
+	free(drbcc->imageData);
+	free(drbcc->imageFlash);
+	free(drbcc->sgSegs);
+	free(drbcc->sgBuf);
 
 	if (drbcc->fd >= 0)
 	{
@@ -477,6 +490,8 @@ const char* drbcc_get_error_string(DRBCC_RC_t rc)
 	case DRBCC_RC_CBREGISTERED:			return "DRBCC: Callbacks registered";
 	case DRBCC_RC_INVALID_FILENAME:		return "DRBCC: Invalid filename";
 	case DRBCC_RC_SESSIONACTIVE:		return "DRBCC: Session active";
+	case DRBCC_RC_INVALID_CHECKPOINT:	return "DRBCC: Invalid checkpoint";
+	case DRBCC_RC_INVALID_IMAGE:		return "DRBCC: Invalid flash image";
 	default:							return "DRBCC: Unknown error";
 	}	
 }
@@ -227,6 +227,14 @@ typedef enum
 
 #define DRBCC_PART_MAGIC1 0xAF
 #define DRBCC_PART_MAGIC2 0xFE
+#define DRBCC_PART_ENTRIES 64		// max. number of entries in the flash partition table (format 2)
+#define DRBCC_PART_V1_ENTRIES 20	// number of entries in a format 1 table
+#define DRBCC_PART_V2_HEADER 16		// format 2: header size
+#define DRBCC_PART_V2_ENTRY 16		// format 2: size of an entry
+#define DRBCC_PART_SIZE (((DRBCC_PART_V2_HEADER + DRBCC_PART_ENTRIES * DRBCC_PART_V2_ENTRY) + 127) & ~127)	// max. size of a table copy in flash
+#define DRBCC_PART_JOURNAL 0x01		// table version flag: apply the journal records of blocks 2-3
+#define DRBCC_HASH_INIT 0x811C9DC5	// FNV-1a offset basis of the content hashes
+#define DRBCC_HASH_UNKNOWN 0xFFFFFFFF	// content hash of an entry not known, never the result of a hash
 
 #define DRBCC_START_CHAR 0xFA
 #define DRBCC_STOP_CHAR  0xFB
@@ -258,8 +266,29 @@ typedef enum
 	DRBCC_STATE_GET_FILE,		// read flash to file
 	DRBCC_STATE_PUT_FILE,		// write file to flash
 	DRBCC_STATE_GET_LOG,		// read log entries from flash
+	DRBCC_STATE_COMMIT_FILES,	// write the files of a transaction to flash
+	DRBCC_STATE_COMPACT_FLASH,	// move files to close gaps in flash
+	DRBCC_STATE_PUT_DIFF,		// write changed blocks of a file to flash
+	DRBCC_STATE_FLASH_BACKUP,	// read whole flash to image file
+	DRBCC_STATE_FLASH_RESTORE,	// write image file to flash
+	DRBCC_STATE_READ_INTO,		// read flash into caller buffer
+	DRBCC_STATE_WRITE_SG,		// write flash segments
+	DRBCC_STATE_FW_UPDATE,		// verify step of drbcc_update_firmware
 } DRBCC_STATES_t;
 
+// queued operation of a file transaction (drbcc_files_begin ... drbcc_files_commit)
+typedef struct
+{
+	void * next;					// next pointer for queuing
+	int put;						// 1=put file, 0=delete file
+	int type;						// file type (bit 0-3 fileindex, bit 4-7 filetype)
+	unsigned int length;			// file size at drbcc_files_put()
+	unsigned int startblock;		// allocated at commit
+	int entry;						// partition table index, allocated at commit
+	uint32_t hash;					// content hash, computed at commit
+	char filename[FILENAME_MAX];
+} DRBCC_FILEOP_t;
+
 #endif
 
 
@@ -290,6 +319,9 @@ typedef struct
 	uint8_t data[15];
 } log_payload_extension_t;
 
+// extension entries of the longest log entry (255 parameter bytes)
+#define DRBCC_LOG_EXT_MAX	((255 - 7 + 14) / 15)
+
 typedef union
 {
 	log_payload_first_t     first;
@@ -346,7 +378,128 @@ typedef struct
 	int logpos;
 	uint8_t logentry;
 	uint8_t logwrapflag;
+	DRBCC_LOG_CURSOR_t *logCursor;		// caller cursor of drbcc_get_log_since or NULL
+	char logCursorFile[FILENAME_MAX];	// sidecar file of the cursor or ""
+	DRBCC_LOG_CURSOR_t logCursorNext;	// cursor stored when all entries are fetched
+	DRBCC_LOG_FILTER_t logFilter;	// drbcc_set_log_filter
+	int logFiltered;			// logFilter is set
+	int logSkip;				// extension entries of a skipped entry left
+	int logReverse;				// drbcc_get_log_reverse: read backwards from the write position
+	int logSeek;				// drbcc_log_seek_time: 1: read the newest entry, 2: binary search, 0: done
+	int logSeekSkip;			// skip the entries before logSeekTime
+	time_t logSeekTime;
+	unsigned int logSeekEpoch;	// epoch of the newest entry
+	unsigned int logSeekLo;		// binary search range in chunks of 128 bytes from the oldest entry
+	unsigned int logSeekHi;
+	unsigned int logSeekChunk;	// chunk probed
+	unsigned int logSeekRead;	// chunk read, lower than logSeekChunk if the chunks read hold extension entries only
+	int logCount;				// entries left to pass to the getlog callback, 0: no limit
+	struct DRBCC_LOG_MIRROR_S *logMirror;	// drbcc_log_mirror_sync running
+	struct DRBCC_LOG_AGGREGATE_S *logAggregate;	// drbcc_log_aggregate: statistics instead of the getlog callback
+	int logStop;				// drbcc_get_log_stop called
+	int logFollow;				// drbcc_log_follow running, the session ends with drbcc_get_log_stop only
+	int logFollowWait;			// follow: waiting for the next poll of the write position
+	DRBCC_GETLOG_CB_t logFollowCb;	// follow: callback of the entries, NULL: getlog_cb
+	DRBCC_LOG_CURSOR_t logFollowCursor;	// follow: write position of the last poll
+	DRBCC_LOG_CURSOR_t *logFollowUser;	// follow: caller cursor updated after each poll or NULL
+	unsigned int logFollowMs;	// follow: current poll interval
+	unsigned int logFollowMax;	// follow: poll interval when idle
+	struct timeval logFollowNext;	// follow: time of the next poll
+	unsigned int logEnd;		// reverse: offset of the oldest entry in the log area
+	unsigned int logLimit;		// reverse: offset behind the entries not read yet
+	int logExtCount;			// reverse: extension entries not assigned to their entry yet
+	uint8_t logExt[DRBCC_LOG_EXT_MAX][16];	// reverse: these extension entries, newest first
+	int logExtPos[DRBCC_LOG_EXT_MAX];	// reverse: their positions
+	uint8_t logRevBuf[16 + DRBCC_LOG_EXT_MAX * 15];	// reverse: entry with its extensions appended
+	DRBCC_PARTENTRY_t partTable[DRBCC_PART_ENTRIES];	// cached copy of the flash partition table
+	int partValid;				// partTable matches the flash content
+	unsigned int partGeneration;	// incremented on every change of partTable
+	uint32_t partHash[DRBCC_PART_ENTRIES];	// content hashes of the partTable entries
+	int partRead;				// partition table read pending: 1=1st table, 2=backup table, 3=restored 1st table, 4=journal
+	int partRestore;			// 1st table is being restored from the backup table, number of pending writes
+	int partDamaged;			// 1st table has a CRC error, must not be replaced by a new table
+	uint8_t partBuf[DRBCC_PART_SIZE];	// table copy being read
+	unsigned int partPos;		// bytes read into partBuf
+	int partVersion;			// format of the table in flash, 0: unknown
+	int partFormat;				// format of table rewrites, see drbcc_set_partition_format
+	unsigned int partWriteAddr;	// address of the last write of the current table update
+	int partJournal;			// journaled table updates enabled, see drbcc_set_partition_journal
+	unsigned int journalEpoch;	// epoch of the table in block 0, only records of this epoch are valid
+	unsigned int journalPos;	// flash address of the next journal record, 0: table must be compacted first
+	DRBCC_PARTENTRY_t journalTable[DRBCC_PART_ENTRIES];	// table with all complete record groups replayed
+	DRBCC_PARTENTRY_t journalGroup[DRBCC_PART_ENTRIES];	// table with the current record group replayed
+	uint32_t journalHash[DRBCC_PART_ENTRIES];		// hashes of journalTable
+	uint32_t journalGroupHash[DRBCC_PART_ENTRIES];	// hashes of journalGroup
+	DRBCC_FILEOP_t *fileOps;	// operations of the current file transaction
+	int fileOpsActive;			// file transaction started, not yet committed
+	unsigned int flashBlocks;	// number of 4k flash blocks from flash id, 0: unknown
+	DRBCC_ALLOC_POLICY_t allocPolicy;
+	int compactEntry;			// partition table index of the file being moved
+	unsigned int compactSrc;	// flash address of the file
+	unsigned int compactDst;	// flash address of the new location
+	unsigned int compactLen;	// bytes to copy
+	unsigned int compactPos;	// bytes copied
+	int compactNext;			// block of the 2nd move of a file moved to an intermediate area, -1: none
+	unsigned int compactFiles;	// files moved in this session
+	struct timeval compactStart;
+	DRBCC_CHECKPOINT_t *checkpoint;		// caller memory for transfer checkpoints or NULL
+	char checkpointFile[FILENAME_MAX];	// sidecar file for transfer checkpoints or ""
+	DRBCC_CHECKPOINT_t cp;				// checkpoint of the current transfer
+	int resume;					// current get/put file continues at cp.offset
+	int resumeVerified;			// flash content of a resumed put file checked
+	uint16_t resumeCrc;
+	int putDiff;				// put file writes changed blocks only, if possible
+	uint32_t putHash;			// content hash of the file to put, DRBCC_HASH_UNKNOWN for streams
+	uint8_t *diffBlocks;		// changed blocks of the file
+	int diffFd;					// file compared with the flash content
+	int diffEntry;				// table entry rewritten by differential put
+	int diffError;
+	unsigned int diffWritten;	// number of blocks written by differential put
+	unsigned int diffSkipped;	// number of unchanged blocks
+	int imageFd;				// flash image file of backup/restore
+	unsigned int imageFlags;
+	unsigned int imageBlock;	// current 4k block
+	unsigned int imageBlocks;	// number of 4k blocks in the image
+	unsigned int imageNext;		// next block with data in the image file
+	unsigned int imageWritten;	// blocks written to file/flash
+	unsigned int imageSkipped;	// empty or unchanged blocks
+	unsigned int imagePending;	// flash writes not yet acknowledged
+	int imageDone;				// all blocks processed
+	int imageVerify;			// read back pass of the restore
+	unsigned int imageRead;		// bytes of the current block read from flash
+	uint8_t *imageData;			// block data from the image file
+	uint8_t *imageFlash;		// block data read from flash
+	struct timeval imageStart;
+	uint8_t *readBuf;			// caller buffer of drbcc_flash_read_into
+	unsigned int readStart;		// flash address of readBuf[0]
+	unsigned int readLen;
+	unsigned int readCount;		// bytes stored in readBuf
+	DRBCC_FLASH_SEGMENT_t *sgSegs;	// segments of drbcc_flash_write_sg sorted by address
+	unsigned int sgCount;
+	unsigned int sgSeg;			// first segment not completely written
+	unsigned int sgBlock;		// current 4k block
+	unsigned int sgPending;		// flash writes not yet acknowledged
+	int sgReading;				// current block is read back
+	unsigned int sgRead;		// bytes of the current block read
+	unsigned int sgErased;		// number of blocks erased
+	unsigned int sgReadBack;	// number of partially written blocks
+	uint8_t *sgBuf;				// content of the current block
+	DRBCC_UPDATE_PHASE_t updatePhase;	// phase of drbcc_update_firmware, NONE: no update running
+	unsigned int updateFlags;
+	char updateFirmware[FILENAME_MAX];
+	char updateBootloader[FILENAME_MAX];	// "": no boot loader update
+	int updateVerify;			// file being verified: 0=boot loader, 1=firmware, 2=done
+	int updateFd;				// local file being verified
+	unsigned int updateAddr;	// flash address of the file being verified
+	struct timeval updateStart;	// start of the current phase
+	struct timeval updateDeadline;	// end of waiting for the new firmware
+	struct timeval updateNext;	// next SYNC while waiting for the new firmware
+	unsigned long updateMs[DRBCC_UPDATE_PHASES];	// duration of the phases
+	DRBCC_UPDATE_CB_t update_cb;
 	char curFilename[FILENAME_MAX];
+	int ioFd;					// get/put file data from/to caller fd instead of curFilename, -1: not used
+	uint8_t *ioMem;				// get/put file data from/to caller memory instead of curFilename
+	unsigned int ioSize;		// size of ioMem
 	struct timeval ackTimeout;
 	struct timeval nextTimeout;
 	struct timeval resend;
@@ -0,0 +1,644 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "drbcc_files.h"
+#include "drbcc_log.h"
+#include "drbcc_ll.h"
+#include "drbcc_utils.h"
+
+#if USE_OPEN_BINARY
+#define OX_BINARY O_BINARY
+#else
+#define OX_BINARY 0
+#endif
+
+struct DRBCC_LOG_ARCHIVE_S
+{
+	FILE *fp;
+	DRBCC_LOG_ARCHIVE_HEADER_t header;
+	DRBCC_LOG_INDEX_t *index;
+	unsigned int indexSize;		// allocated index entries
+	int64_t maxTime;			// highest timestamp so far
+	int error;
+};
+
+static int bcd2bin(uint8_t data)
+{
+	return ((data >> 4) * 10 + (data & 0xF));
+}
+
+// seconds since 1970 of the RTC time, timegm() is not available everywhere
+static time_t libdrbcc_log_mktime(const struct tm *tm)
+{
+	static const int mdays[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+	int year = tm->tm_year + 1900;
+	long days;
+
+	if ((tm->tm_mon < 0) || (tm->tm_mon > 11))
+	{
+		return (time_t) -1;
+	}
+	days = (year - 1970) * 365L + ((year - 1969) / 4) - ((year - 1901) / 100) + ((year - 1601) / 400);
+	days += mdays[tm->tm_mon] + tm->tm_mday - 1;
+	if ((tm->tm_mon > 1) && ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0)))
+	{
+		days++;
+	}
+	return (time_t) (((days * 24 + tm->tm_hour) * 60 + tm->tm_min) * 60 + tm->tm_sec);
+}
+
+// 7 byte log timestamp: sec, min, hour, epoch, date, month, year
+static time_t libdrbcc_log_time(const uint8_t ts[], struct tm *tm)
+{
+	memset(tm, 0, sizeof(struct tm));
+	tm->tm_sec	= bcd2bin(ts[0]);
+	tm->tm_min	= bcd2bin(ts[1]);
+	tm->tm_hour	= bcd2bin(ts[2] & 0x3f);	// Bit 6 is 12/24h clock mode
+	tm->tm_mday	= bcd2bin(ts[4]);
+	tm->tm_mon	= bcd2bin(ts[5]) - 1;	// rtc 1-12, tm 0-11
+	tm->tm_year	= bcd2bin(ts[6]) + 100;	// tm is 1900
+	return libdrbcc_log_mktime(tm);
+}
+
+time_t libdrbcc_log_entry_time(const uint8_t data[])
+{
+	struct tm tm;
+
+	if ((data[0] == 0xff) || (data[0] == DRBCC_E_EXTENSION) || (data[1] == 0xff))
+	{
+		return (time_t) -1;
+	}
+	return libdrbcc_log_time(&data[1], &tm);
+}
+
+int libdrbcc_log_filter(const DRBCC_LOG_FILTER_t *filter, const uint8_t data[])
+{
+	struct tm tm;
+	time_t t;
+
+	if (filter->events && ((data[0] >= 32) || !(filter->events & DRBCC_LOG_EVENT_BIT(data[0]))))
+	{
+		return DRBCC_LOG_FILTER_SKIP;
+	}
+	if ((data[0] == DRBCC_E_EXTENSION) || (data[1] == 0xff))
+	{
+		// no timestamp
+		return (filter->from || filter->to || filter->minEpoch) ? DRBCC_LOG_FILTER_SKIP : DRBCC_LOG_FILTER_PASS;
+	}
+	if (data[4] < filter->minEpoch)
+	{
+		// the epoch only grows, older entries are of this or earlier epochs
+		return DRBCC_LOG_FILTER_STOP;
+	}
+	if (!filter->from && !filter->to)
+	{
+		return DRBCC_LOG_FILTER_PASS;
+	}
+	t = libdrbcc_log_time(&data[1], &tm);
+	if (filter->from && (t < filter->from))
+	{
+		// within an epoch the time only grows
+		return (data[4] == filter->minEpoch) ? DRBCC_LOG_FILTER_STOP : DRBCC_LOG_FILTER_SKIP;
+	}
+	if (filter->to && (t > filter->to))
+	{
+		return DRBCC_LOG_FILTER_SKIP;
+	}
+	return DRBCC_LOG_FILTER_PASS;
+}
+
+// decode the parameters of the event
+static void libdrbcc_log_decode_param(DRBCC_LOG_ENTRY_t *entry)
+{
+	const uint8_t *p = entry->param;
+	unsigned int i;
+
+	switch (entry->event)
+	{
+	case DRBCC_E_ILL_PWR_STATE:
+	case DRBCC_E_PWR_CHNG:
+		entry->u.power.state = p[0] & DRBCC_P_MAIN_STATE_MASK;
+		entry->u.power.options = p[0] & ~DRBCC_P_MAIN_STATE_MASK;
+		break;
+	case DRBCC_E_ILL_BID:
+	case DRBCC_E_PWR_LOSS:
+	case DRBCC_E_HDD_CHNG:
+	case DRBCC_E_KEY_REJECTED:
+	case DRBCC_E_COMM_TIMEOUT:
+	case DRBCC_E_FW_UPDATE:
+	case DRBCC_E_BL_UPDATE:
+	case DRBCC_E_FW_REBOOT:
+		entry->u.code = p[0];
+		break;
+	case DRBCC_E_KEY_DETECTED:
+	case DRBCC_E_KEY_COMM_ERROR:
+	case DRBCC_E_KEY_HEADER_ERROR:
+		memcpy(entry->u.key, p, sizeof(entry->u.key));
+		break;
+	case DRBCC_E_KEY_SUCCESS:
+	case DRBCC_E_UNLOCK_ERROR:
+		// p[1] is not used
+		entry->u.token.cmd = p[0];
+		memcpy(entry->u.token.code, &p[2], sizeof(entry->u.token.code));
+		entry->u.token.retries = p[6];
+		break;
+	case DRBCC_E_RTC_SET:
+		entry->u.rtc.time = libdrbcc_log_time(p, &entry->u.rtc.tm);
+		break;
+	case DRBCC_E_VOLTAGE_INFO:
+		// pairs of voltage id and value, hibyte first
+		for (i = 0; i + 3 <= entry->len; i += 3)
+		{
+			entry->u.voltage.id[entry->u.voltage.count] = p[i];
+			entry->u.voltage.value[entry->u.voltage.count] = (int16_t) ((p[i + 1] << 8) | p[i + 2]);
+			entry->u.voltage.count++;
+		}
+		break;
+	case DRBCC_E_OVERTEMP_OFF:
+	case DRBCC_E_TEMPLIMIT:
+		entry->u.temp.temp = (int8_t) p[0];
+		entry->u.temp.low = (int8_t) p[1];
+		entry->u.temp.high = (int8_t) p[2];
+		entry->u.temp.reset = (int8_t) p[3];
+		break;
+	case DRBCC_E_ACCEL_EVENT:
+		// lobyte first
+		entry->u.accel.type = p[0];
+		entry->u.accel.x = (int16_t) ((p[2] << 8) | p[1]);
+		entry->u.accel.y = (int16_t) ((p[4] << 8) | p[3]);
+		entry->u.accel.z = (int16_t) ((p[6] << 8) | p[5]);
+		break;
+	default:
+		break;
+	}
+}
+
+DRBCC_RC_t drbcc_log_decode(int pos, int len, const uint8_t data[], DRBCC_LOG_ENTRY_t *entry)
+{
+	if (len < 1)
+	{
+		return DRBCC_RC_MSG_TOO_SHORT;
+	}
+
+	memset(entry, 0, sizeof(DRBCC_LOG_ENTRY_t));
+	entry->pos = pos;
+	entry->event = data[0];
+	entry->time = (time_t) -1;
+
+	if ((data[0] == DRBCC_E_EXTENSION) || (data[0] == DRBCC_E_EMPTY))
+	{
+		// no timestamp
+		entry->len = (len > DRBCC_LOG_ENTRY_SIZE) ? DRBCC_LOG_ENTRY_SIZE - 1 : len - 1;
+		memcpy(entry->param, &data[1], entry->len);
+		return DRBCC_RC_NOERROR;
+	}
+
+	if (len < 9)
+	{
+		return DRBCC_RC_MSG_TOO_SHORT;
+	}
+	if (len < DRBCC_LOG_ENTRY_SIZE)
+	{
+		// the parameter bytes of the 1st entry are always there
+		len = DRBCC_LOG_ENTRY_SIZE;
+	}
+	if (len > 9 + DRBCC_LOG_PARAM_MAX)
+	{
+		len = 9 + DRBCC_LOG_PARAM_MAX;
+	}
+	entry->time = libdrbcc_log_time(&data[1], &entry->tm);
+	entry->epoch = data[4];
+	entry->len = ((unsigned int) len - 9 < data[8]) ? (unsigned int) len - 9 : data[8];
+	memcpy(entry->param, &data[9], len - 9);
+
+	libdrbcc_log_decode_param(entry);
+	return DRBCC_RC_NOERROR;
+}
+
+unsigned int drbcc_log_decode_all(int pos, const uint8_t data[], unsigned int count, DRBCC_LOG_ENTRY_t entries[], unsigned int max)
+{
+	uint8_t buf[9 + DRBCC_LOG_PARAM_MAX];
+	unsigned int n = 0;
+	unsigned int have = 0;		// bytes of the entry collected in buf
+	unsigned int need = 0;		// bytes of the entry incl. extensions
+	int first = 0;
+	unsigned int i;
+
+	for (i = 0; (i < count) && (n < max); i++)
+	{
+		const uint8_t *d = &data[i * DRBCC_LOG_ENTRY_SIZE];
+
+		if (d[0] == DRBCC_E_EMPTY)
+		{
+			continue;
+		}
+		if (d[0] != DRBCC_E_EXTENSION)
+		{
+			// a pending entry with missing extensions is dropped like by drbcc_get_log
+			first = pos + i;
+			have = DRBCC_LOG_ENTRY_SIZE;
+			need = d[8] + 9;
+			memcpy(buf, d, DRBCC_LOG_ENTRY_SIZE);
+			// if (d[1] == 0xff) this is a invalid entry made by AVR programmer
+			if ((d[1] == 0xff) || (need <= DRBCC_LOG_ENTRY_SIZE))
+			{
+				drbcc_log_decode(first, DRBCC_LOG_ENTRY_SIZE, buf, &entries[n++]);
+				have = 0;
+			}
+		}
+		else if (have == 0)
+		{
+			// unexpected extension
+			drbcc_log_decode(pos + i, DRBCC_LOG_ENTRY_SIZE, d, &entries[n++]);
+		}
+		else
+		{
+			unsigned int rest = need - have;
+
+			if (rest > DRBCC_LOG_ENTRY_SIZE - 1)
+			{
+				rest = DRBCC_LOG_ENTRY_SIZE - 1;
+			}
+			memcpy(&buf[have], &d[1], rest);
+			have += rest;
+			if (have == need)
+			{
+				drbcc_log_decode(first, need, buf, &entries[n++]);
+				have = 0;
+			}
+		}
+	}
+	return n;
+}
+
+DRBCC_LOG_ARCHIVE_t *drbcc_log_archive_create(const char *filename, unsigned int interval)
+{
+	DRBCC_LOG_ARCHIVE_t *archive = calloc(1, sizeof(DRBCC_LOG_ARCHIVE_t));
+
+	if (archive == NULL)
+	{
+		return NULL;
+	}
+	archive->fp = fopen(filename, "wb");
+	if (archive->fp == NULL)
+	{
+		free(archive);
+		return NULL;
+	}
+	memcpy(archive->header.magic, DRBCC_LOG_ARCHIVE_MAGIC, sizeof(archive->header.magic));
+	archive->header.version = DRBCC_LOG_ARCHIVE_VERSION;
+	archive->header.byteorder = DRBCC_LOG_ARCHIVE_BYTEORDER;
+	archive->header.recordSize = sizeof(DRBCC_LOG_RECORD_t);
+	archive->header.interval = interval ? interval : DRBCC_LOG_ARCHIVE_INTERVAL;
+	archive->maxTime = -1;
+
+	// the header is written again by drbcc_log_archive_close
+	if (1 != fwrite(&archive->header, sizeof(archive->header), 1, archive->fp))
+	{
+		archive->error = 1;
+	}
+	return archive;
+}
+
+void drbcc_log_record_encode(const DRBCC_LOG_ENTRY_t *entry, DRBCC_LOG_RECORD_t *record)
+{
+	memset(record, 0, sizeof(DRBCC_LOG_RECORD_t));
+	record->time = entry->time;
+	record->pos = entry->pos;
+	record->event = entry->event;
+	record->epoch = entry->epoch;
+	record->len = entry->len;
+	memcpy(record->param, entry->param, sizeof(record->param));
+}
+
+DRBCC_RC_t drbcc_log_archive_add(DRBCC_LOG_ARCHIVE_t *archive, const DRBCC_LOG_ENTRY_t *entry)
+{
+	DRBCC_LOG_RECORD_t record;
+
+	drbcc_log_record_encode(entry, &record);
+
+	if (record.time > archive->maxTime)
+	{
+		archive->maxTime = record.time;
+	}
+	if ((archive->header.records % archive->header.interval) == 0)
+	{
+		if (archive->header.indexEntries == archive->indexSize)
+		{
+			unsigned int size = archive->indexSize ? archive->indexSize * 2 : 64;
+			DRBCC_LOG_INDEX_t *index = realloc(archive->index, size * sizeof(DRBCC_LOG_INDEX_t));
+
+			if (index == NULL)
+			{
+				archive->error = 1;
+				return DRBCC_RC_OUTOFMEMORY;
+			}
+			archive->index = index;
+			archive->indexSize = size;
+		}
+		archive->index[archive->header.indexEntries].record = archive->header.records;
+		archive->index[archive->header.indexEntries].reserved = 0;
+		archive->header.indexEntries++;
+	}
+	// running maximum, so the index is sorted even if the RTC was set back
+	archive->index[archive->header.indexEntries - 1].time = archive->maxTime;
+
+	if (1 != fwrite(&record, sizeof(record), 1, archive->fp))
+	{
+		archive->error = 1;
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+	archive->header.records++;
+	return DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_log_archive_close(DRBCC_LOG_ARCHIVE_t *archive)
+{
+	int error = archive->error;
+
+	if (!error && archive->header.indexEntries &&
+		(archive->header.indexEntries != fwrite(archive->index, sizeof(DRBCC_LOG_INDEX_t), archive->header.indexEntries, archive->fp)))
+	{
+		error = 1;
+	}
+	if (!error && ((0 != fseek(archive->fp, 0, SEEK_SET)) ||
+		(1 != fwrite(&archive->header, sizeof(archive->header), 1, archive->fp))))
+	{
+		error = 1;
+	}
+	if (0 != fclose(archive->fp))
+	{
+		error = 1;
+	}
+	free(archive->index);
+	free(archive);
+	return error ? DRBCC_RC_SYSTEM_ERROR : DRBCC_RC_NOERROR;
+}
+
+DRBCC_RC_t drbcc_log_archive_open(const char *filename, DRBCC_LOG_ARCHIVE_VIEW_t *view)
+{
+	const DRBCC_LOG_ARCHIVE_HEADER_t *h;
+	struct stat st;
+	int fd = open(filename, O_RDONLY | OX_BINARY);
+
+	memset(view, 0, sizeof(DRBCC_LOG_ARCHIVE_VIEW_t));
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	if ((0 != fstat(fd, &st)) || (st.st_size < (off_t) sizeof(DRBCC_LOG_ARCHIVE_HEADER_t)))
+	{
+		close(fd);
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+	view->size = st.st_size;
+	view->map = mmap(NULL, view->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (view->map == MAP_FAILED)
+	{
+		view->map = NULL;
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+
+	h = view->map;
+	if (memcmp(h->magic, DRBCC_LOG_ARCHIVE_MAGIC, sizeof(h->magic)) || (h->version != DRBCC_LOG_ARCHIVE_VERSION) ||
+		(h->byteorder != DRBCC_LOG_ARCHIVE_BYTEORDER) || (h->recordSize != sizeof(DRBCC_LOG_RECORD_t)) || (h->interval == 0) ||
+		(h->indexEntries != (h->records + h->interval - 1) / h->interval) ||
+		(view->size != sizeof(*h) + (size_t) h->records * sizeof(DRBCC_LOG_RECORD_t) + (size_t) h->indexEntries * sizeof(DRBCC_LOG_INDEX_t)))
+	{
+		drbcc_log_archive_unmap(view);
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+	view->header = h;
+	view->records = (const DRBCC_LOG_RECORD_t *) (h + 1);
+	view->count = h->records;
+	view->index = (const DRBCC_LOG_INDEX_t *) (view->records + h->records);
+	return DRBCC_RC_NOERROR;
+}
+
+void drbcc_log_archive_unmap(DRBCC_LOG_ARCHIVE_VIEW_t *view)
+{
+	if (view->map)
+	{
+		munmap(view->map, view->size);
+	}
+	memset(view, 0, sizeof(DRBCC_LOG_ARCHIVE_VIEW_t));
+}
+
+unsigned int drbcc_log_archive_find(const DRBCC_LOG_ARCHIVE_VIEW_t *view, time_t time)
+{
+	unsigned int lo = 0;
+	unsigned int hi = view->header->indexEntries;
+	unsigned int i;
+
+	// first index entry with records up to time or later
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (view->index[mid].time < (int64_t) time)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	if (lo == view->header->indexEntries)
+	{
+		return view->count;
+	}
+	for (i = view->index[lo].record; i < view->count; i++)
+	{
+		if (view->records[i].time >= (int64_t) time)
+		{
+			break;
+		}
+	}
+	return i;
+}
+
+void drbcc_log_record_decode(const DRBCC_LOG_RECORD_t *record, DRBCC_LOG_ENTRY_t *entry)
+{
+	time_t t = (time_t) record->time;
+
+	memset(entry, 0, sizeof(DRBCC_LOG_ENTRY_t));
+	entry->pos = record->pos;
+	entry->event = record->event;
+	entry->time = t;
+	if (t != (time_t) -1)
+	{
+		gmtime_r(&t, &entry->tm);
+		entry->tm.tm_wday = 0;
+		entry->tm.tm_yday = 0;
+	}
+	entry->epoch = record->epoch;
+	entry->len = record->len;
+	memcpy(entry->param, record->param, sizeof(record->param));
+	libdrbcc_log_decode_param(entry);
+}
+
+void drbcc_log_aggregate_init(DRBCC_LOG_AGGREGATE_t *agg, unsigned int select)
+{
+	unsigned int i;
+
+	memset(agg, 0, sizeof(DRBCC_LOG_AGGREGATE_t));
+	agg->select = select;
+	agg->first = -1;
+	agg->last = -1;
+	for (i = 0; i < DRBCC_LOG_AGG_VOLTAGES; i++)
+	{
+		agg->voltage[i].min = INT16_MAX;
+		agg->voltage[i].max = INT16_MIN;
+	}
+	agg->temp.min = INT8_MAX;
+	agg->temp.max = INT8_MIN;
+}
+
+void drbcc_log_aggregate_add(DRBCC_LOG_AGGREGATE_t *agg, const DRBCC_LOG_ENTRY_t *entry)
+{
+	unsigned int i;
+
+	agg->entries++;
+	if (entry->time != (time_t) -1)
+	{
+		if ((agg->first == (time_t) -1) || (entry->time < agg->first))
+		{
+			agg->first = entry->time;
+		}
+		if ((agg->last == (time_t) -1) || (entry->time > agg->last))
+		{
+			agg->last = entry->time;
+		}
+		if (agg->select & DRBCC_LOG_AGG_HOURS)
+		{
+			agg->hours[entry->tm.tm_hour % 24]++;
+		}
+	}
+	if (agg->select & DRBCC_LOG_AGG_EVENTS)
+	{
+		agg->events[entry->event & 0xff]++;
+	}
+
+	switch (entry->event)
+	{
+	case DRBCC_E_PWR_LOSS:
+		if (agg->select & DRBCC_LOG_AGG_POWER)
+		{
+			agg->powerLoss[(entry->u.code < DRBCC_LOG_AGG_REASONS - 1) ? entry->u.code : DRBCC_LOG_AGG_REASONS - 1]++;
+		}
+		break;
+	case DRBCC_E_VOLTAGE_INFO:
+		if (agg->select & DRBCC_LOG_AGG_VOLTAGE)
+		{
+			for (i = 0; i < entry->u.voltage.count; i++)
+			{
+				unsigned int id = entry->u.voltage.id[i];
+				int16_t value = entry->u.voltage.value[i];
+
+				if (id >= DRBCC_LOG_AGG_VOLTAGES)
+				{
+					continue;
+				}
+				agg->voltage[id].count++;
+				if (value < agg->voltage[id].min)
+				{
+					agg->voltage[id].min = value;
+				}
+				if (value > agg->voltage[id].max)
+				{
+					agg->voltage[id].max = value;
+				}
+			}
+		}
+		break;
+	case DRBCC_E_OVERTEMP_OFF:
+	case DRBCC_E_TEMPLIMIT:
+		if (agg->select & DRBCC_LOG_AGG_TEMP)
+		{
+			agg->temp.count++;
+			if (entry->u.temp.temp < agg->temp.min)
+			{
+				agg->temp.min = entry->u.temp.temp;
+			}
+			if (entry->u.temp.temp > agg->temp.max)
+			{
+				agg->temp.max = entry->u.temp.temp;
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+DRBCC_RC_t drbcc_log_aggregate(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, DRBCC_LOG_AGGREGATE_t *agg, int entries)
+{
+	DRBCC_t *drbcc = h;
+	DRBCC_RC_t rc;
+
+	if (agg == NULL)
+	{
+		return DRBCC_RC_UNSPEC_ERROR;
+	}
+	rc = drbcc_get_log(h, session, 1, entries);
+	if (rc == DRBCC_RC_NOERROR)
+	{
+		// the entries are decoded and added by handle_logentry
+		drbcc->logAggregate = agg;
+	}
+	return rc;
+}
+
+void libdrbcc_log_aggregate_entry(DRBCC_t *drbcc, int pos, int len, const uint8_t data[])
+{
+	DRBCC_LOG_ENTRY_t entry;
+
+	if (DRBCC_RC_NOERROR == drbcc_log_decode(pos, len, data, &entry))
+	{
+		drbcc_log_aggregate_add(drbcc->logAggregate, &entry);
+	}
+}
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+*
+* NO CODE BELOW THIS! */
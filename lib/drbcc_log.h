@@ -0,0 +1,292 @@
+/* Editor hints for vim
+ * vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DRBCC_LOG_
+#define _DRBCC_LOG_
+
+#include <stdint.h>
+#include <time.h>
+#include <drbcc_com.h>
+#include <drbcc.h>
+
+/* Ring log entry (16 byte), as passed to DRBCC_GETLOG_CB_t:
+	o 1 byte event code (DRBCC_LOG_EVENT_t)
+	o 7 byte timestamp, BCD: sec, min, hour, epoch (binary), date, month, year
+	o 1 byte parameter length
+	o 7 byte parameters, longer parameters are continued in DRBCC_E_EXTENSION entries (15 byte each)
+*/
+
+#define DRBCC_LOG_ENTRY_SIZE	16
+#define DRBCC_LOG_PARAM_MAX		255
+#define DRBCC_LOG_VOLTAGES_MAX	(DRBCC_LOG_PARAM_MAX / 3)
+
+// decoded log entry
+typedef struct
+{
+	int pos;						// index of the entry in the log area
+	DRBCC_LOG_EVENT_t event;
+	time_t time;					// timestamp (RTC time), -1: no timestamp (extension or empty entry)
+	struct tm tm;					// timestamp broken down, tm_wday and tm_yday are not set
+	unsigned int epoch;				// RTC epoch, incremented when the RTC is set
+	unsigned int len;				// number of parameter bytes
+	uint8_t param[DRBCC_LOG_PARAM_MAX];
+	union
+	{
+		// DRBCC_E_ILL_PWR_STATE, DRBCC_E_PWR_CHNG
+		struct
+		{
+			uint8_t state;			// DRBCC_Power_State_t main state
+			uint8_t options;		// DRBCC_P_OPT_* bits
+		} power;
+		// DRBCC_E_ILL_BID: board id, DRBCC_E_PWR_LOSS: DRBCC_PWR_LOSS_*, DRBCC_E_HDD_CHNG: 1=inserted,
+		// DRBCC_E_KEY_REJECTED: number of tokens, DRBCC_E_COMM_TIMEOUT: DRBCC_TIMEOUT_*,
+		// DRBCC_E_FW_UPDATE, DRBCC_E_BL_UPDATE: 1=ok, DRBCC_E_FW_REBOOT: 1=with SRAM context reset
+		uint8_t code;
+		// DRBCC_E_KEY_DETECTED, DRBCC_E_KEY_COMM_ERROR: key eeprom code, DRBCC_E_KEY_HEADER_ERROR: 4 byte header data
+		uint8_t key[7];
+		// DRBCC_E_KEY_SUCCESS, DRBCC_E_UNLOCK_ERROR
+		struct
+		{
+			uint8_t cmd;			// DRBCC_KEY_CMD0_MASK_* bits or DRBCC_KEY_CMD0_TTU_EJECT
+			uint8_t code[4];
+			uint8_t retries;		// eject retries
+		} token;
+		// DRBCC_E_RTC_SET: new time
+		struct
+		{
+			time_t time;
+			struct tm tm;
+		} rtc;
+		// DRBCC_E_VOLTAGE_INFO
+		struct
+		{
+			unsigned int count;
+			uint8_t id[DRBCC_LOG_VOLTAGES_MAX];		// DRBCC_VOLTAGE_ID_t
+			int16_t value[DRBCC_LOG_VOLTAGES_MAX];	// in 10mV
+		} voltage;
+		// DRBCC_E_OVERTEMP_OFF: temp only, DRBCC_E_TEMPLIMIT
+		struct
+		{
+			int8_t temp;			// deg C
+			int8_t low;
+			int8_t high;
+			int8_t reset;
+		} temp;
+		// DRBCC_E_ACCEL_EVENT
+		struct
+		{
+			uint8_t type;			// DRBCC_Accel_Events_t
+			int16_t x;				// 1g is 256
+			int16_t y;
+			int16_t z;
+		} accel;
+	} u;
+} DRBCC_LOG_ENTRY_t;
+
+// decode one entry of len bytes (DRBCC_GETLOG_CB_t data, extensions already appended), data holds at least 16 bytes
+DRBCC_RC_t drbcc_log_decode(int pos, int len, const uint8_t data[], DRBCC_LOG_ENTRY_t *entry);
+
+// decode count raw 16 byte entries read from the log area at entry index pos, extension entries are
+// appended to their entry, empty entries are skipped, returns the number of entries stored (max. max)
+unsigned int drbcc_log_decode_all(int pos, const uint8_t data[], unsigned int count, DRBCC_LOG_ENTRY_t entries[], unsigned int max);
+
+/* Log archive file, host byte order:
+* 64 byte header (DRBCC_LOG_ARCHIVE_HEADER_t)
+* records[header.records] (DRBCC_LOG_RECORD_t, 64 byte each) in the order they were added
+* index[header.indexEntries] (DRBCC_LOG_INDEX_t), one entry per header.interval records
+*/
+
+#define DRBCC_LOG_ARCHIVE_MAGIC		"DRBCCLGA"
+#define DRBCC_LOG_ARCHIVE_VERSION	1
+#define DRBCC_LOG_ARCHIVE_BYTEORDER	0x01020304
+#define DRBCC_LOG_ARCHIVE_INTERVAL	256		// default records per index entry
+#define DRBCC_LOG_RECORD_PARAM		48		// parameter bytes stored in a record
+
+typedef struct
+{
+	char magic[8];				// DRBCC_LOG_ARCHIVE_MAGIC
+	uint32_t version;			// DRBCC_LOG_ARCHIVE_VERSION
+	uint32_t byteorder;			// DRBCC_LOG_ARCHIVE_BYTEORDER as written
+	uint32_t recordSize;		// sizeof(DRBCC_LOG_RECORD_t)
+	uint32_t interval;			// records per index entry
+	uint32_t records;
+	uint32_t indexEntries;
+	uint32_t reserved[8];
+} DRBCC_LOG_ARCHIVE_HEADER_t;
+
+typedef struct
+{
+	int64_t time;				// timestamp, -1: none
+	int32_t pos;				// index of the entry in the log area
+	uint8_t event;				// DRBCC_LOG_EVENT_t
+	uint8_t epoch;
+	uint8_t len;				// number of parameter bytes of the entry, only the first DRBCC_LOG_RECORD_PARAM are stored
+	uint8_t reserved;
+	uint8_t param[DRBCC_LOG_RECORD_PARAM];
+} DRBCC_LOG_RECORD_t;
+
+typedef struct
+{
+	int64_t time;				// highest timestamp of the records up to record
+	uint32_t record;			// index entry i: record i * interval
+	uint32_t reserved;
+} DRBCC_LOG_INDEX_t;
+
+// archive being written
+typedef struct DRBCC_LOG_ARCHIVE_S DRBCC_LOG_ARCHIVE_t;
+
+// archive mapped for reading, records can be used directly
+typedef struct
+{
+	void *map;
+	size_t size;
+	const DRBCC_LOG_ARCHIVE_HEADER_t *header;
+	const DRBCC_LOG_RECORD_t *records;
+	unsigned int count;
+	const DRBCC_LOG_INDEX_t *index;
+} DRBCC_LOG_ARCHIVE_VIEW_t;
+
+// create the archive file, interval: records per index entry (0: DRBCC_LOG_ARCHIVE_INTERVAL)
+DRBCC_LOG_ARCHIVE_t *drbcc_log_archive_create(const char *filename, unsigned int interval);
+
+// append a decoded entry
+DRBCC_RC_t drbcc_log_archive_add(DRBCC_LOG_ARCHIVE_t *archive, const DRBCC_LOG_ENTRY_t *entry);
+
+// write index and header and close the file
+DRBCC_RC_t drbcc_log_archive_close(DRBCC_LOG_ARCHIVE_t *archive);
+
+DRBCC_RC_t drbcc_log_archive_open(const char *filename, DRBCC_LOG_ARCHIVE_VIEW_t *view);
+
+void drbcc_log_archive_unmap(DRBCC_LOG_ARCHIVE_VIEW_t *view);
+
+// index of the first record with a timestamp >= time (view->count: none), binary search in the index,
+// exact if the timestamps are ascending
+unsigned int drbcc_log_archive_find(const DRBCC_LOG_ARCHIVE_VIEW_t *view, time_t time);
+
+// store the entry in a record, parameters beyond DRBCC_LOG_RECORD_PARAM are dropped
+void drbcc_log_record_encode(const DRBCC_LOG_ENTRY_t *entry, DRBCC_LOG_RECORD_t *record);
+
+// decode a record like drbcc_log_decode, parameters beyond DRBCC_LOG_RECORD_PARAM are missing
+void drbcc_log_record_decode(const DRBCC_LOG_RECORD_t *record, DRBCC_LOG_ENTRY_t *entry);
+
+/* Log mirror file, host byte order, a local copy of the ring log:
+* 64 byte header (DRBCC_LOG_MIRROR_HEADER_t)
+* records[header.capacity] (DRBCC_LOG_RECORD_t), used as ring, header.count records from header.first on
+* The file is locked with flock(), exclusive by drbcc_log_mirror_sync until the session ends, shared by queries.
+*/
+
+#define DRBCC_LOG_MIRROR_MAGIC		"DRBCCLGM"
+#define DRBCC_LOG_MIRROR_VERSION	1
+
+typedef struct
+{
+	char magic[8];				// DRBCC_LOG_MIRROR_MAGIC
+	uint32_t version;			// DRBCC_LOG_MIRROR_VERSION
+	uint32_t byteorder;			// DRBCC_LOG_ARCHIVE_BYTEORDER as written
+	uint32_t recordSize;		// sizeof(DRBCC_LOG_RECORD_t)
+	uint32_t capacity;			// entries of the ring log area
+	uint32_t count;				// records stored
+	uint32_t first;				// oldest record
+	DRBCC_LOG_CURSOR_t cursor;	// ring log position of the last sync
+	uint32_t reserved[4];
+} DRBCC_LOG_MIRROR_HEADER_t;
+
+// return 0 to stop the query
+typedef int (*DRBCC_LOG_QUERY_CB_t)(void *context, const DRBCC_LOG_ENTRY_t *entry);
+
+// append the ring log entries added since the last sync to the mirror file, the file is created if missing,
+// the mirror is reset if the ring log was cleared or overwritten in between, the log filter is not used,
+// DRBCC_RC_SESSIONACTIVE: the mirror is synced by another process
+DRBCC_RC_t drbcc_log_mirror_sync(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *filename);
+
+// pass the entries of the mirror file matching filter (may be NULL) to cb, oldest first,
+// the first entry of filter->minEpoch is found by binary search, waits for a running sync of another process
+DRBCC_RC_t drbcc_log_mirror_query(const char *filename, const DRBCC_LOG_FILTER_t *filter, DRBCC_LOG_QUERY_CB_t cb, void *context);
+
+// statistics of drbcc_log_aggregate, select bits
+#define DRBCC_LOG_AGG_EVENTS	0x01	// entries per event code
+#define DRBCC_LOG_AGG_POWER		0x02	// DRBCC_E_PWR_LOSS per reason
+#define DRBCC_LOG_AGG_VOLTAGE	0x04	// min/max of each voltage of DRBCC_E_VOLTAGE_INFO
+#define DRBCC_LOG_AGG_TEMP		0x08	// DRBCC_E_OVERTEMP_OFF and DRBCC_E_TEMPLIMIT temperatures
+#define DRBCC_LOG_AGG_HOURS		0x10	// entries per hour of the day
+#define DRBCC_LOG_AGG_ALL		0x1f
+
+#define DRBCC_LOG_AGG_REASONS	9		// DRBCC_Power_Loss_t values and one for unknown reasons
+#define DRBCC_LOG_AGG_VOLTAGES	16		// DRBCC_VOLTAGE_ID_t values, higher ids are not counted
+
+typedef struct DRBCC_LOG_AGGREGATE_S
+{
+	unsigned int select;			// DRBCC_LOG_AGG_* bits
+	unsigned long entries;			// entries added
+	time_t first;					// lowest and highest timestamp, -1: none
+	time_t last;
+	unsigned long events[256];		// per DRBCC_LOG_EVENT_t, e.g. key errors
+	unsigned long powerLoss[DRBCC_LOG_AGG_REASONS];	// per DRBCC_Power_Loss_t, last: unknown reasons
+	struct
+	{
+		unsigned long count;		// values seen
+		int16_t min;				// in 10mV
+		int16_t max;
+	} voltage[DRBCC_LOG_AGG_VOLTAGES];	// per DRBCC_VOLTAGE_ID_t
+	struct
+	{
+		unsigned long count;		// DRBCC_E_OVERTEMP_OFF and DRBCC_E_TEMPLIMIT entries
+		int8_t min;					// deg C
+		int8_t max;
+	} temp;
+	unsigned long hours[24];		// entries with timestamp per hour (RTC time)
+} DRBCC_LOG_AGGREGATE_t;
+
+// clear the statistics, select: DRBCC_LOG_AGG_* bits of the statistics to collect
+void drbcc_log_aggregate_init(DRBCC_LOG_AGGREGATE_t *agg, unsigned int select);
+
+// add a decoded entry, e.g. from drbcc_log_record_decode or a DRBCC_LOG_QUERY_CB_t
+void drbcc_log_aggregate_add(DRBCC_LOG_AGGREGATE_t *agg, const DRBCC_LOG_ENTRY_t *entry);
+
+// get log like drbcc_get_log (ring log, entries: see there) and add the entries passing the log filter to agg
+// instead of passing them to the getlog callback, agg must stay valid until the session ends, it is not cleared
+DRBCC_RC_t drbcc_log_aggregate(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, DRBCC_LOG_AGGREGATE_t *agg, int entries);
+
+// offline decoding of ring log dumps, the chunks of DRBCC_LOG_DUMP_CHUNK blocks are decoded by worker threads
+#define DRBCC_LOG_DUMP_CHUNK		16
+#define DRBCC_LOG_DUMP_THREADS_MAX	64
+
+// decode a raw ring log area (size: multiple of 4K blocks) and pass the entries to cb in log order, oldest first,
+// the oldest entry is the one behind the empty block ahead of the write position, pos is the index in the area,
+// threads: number of decoder threads, 0: one per CPU
+DRBCC_RC_t drbcc_log_decode_dump(const uint8_t data[], size_t size, unsigned int threads, DRBCC_LOG_QUERY_CB_t cb, void *context);
+
+// decode the ring log of a dump file like drbcc_log_decode_dump, the file is the ring log area read with rflash,
+// the whole flash read with rflash or a drbcc_flash_backup image, the area is taken from the partition table in
+// block 0 of the latter two
+DRBCC_RC_t drbcc_log_decode_file(const char *filename, unsigned int threads, DRBCC_LOG_QUERY_CB_t cb, void *context);
+
+#endif /* _DRBCC_LOG_ */
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+*
+* NO CODE BELOW THIS! */
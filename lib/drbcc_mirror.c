@@ -0,0 +1,358 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "drbcc_files.h"
+#include "drbcc_log.h"
+#include "drbcc_ll.h"
+#include "drbcc_trace.h"
+#include "drbcc_utils.h"
+
+#if USE_OPEN_BINARY
+#define OX_BINARY O_BINARY
+#else
+#define OX_BINARY 0
+#endif
+
+extern int libdrbcc_initialized;
+
+struct DRBCC_LOG_MIRROR_S
+{
+	int fd;
+	DRBCC_LOG_MIRROR_HEADER_t header;
+	DRBCC_LOG_CURSOR_t cursor;		// passed to drbcc_get_log_since
+	DRBCC_LOG_RECORD_t last;		// newest record of the last sync
+	int verify;						// the fetch starts with last
+	const char *error;
+};
+
+static int libdrbcc_log_mirror_valid(const DRBCC_LOG_MIRROR_HEADER_t *h)
+{
+	return (0 == memcmp(h->magic, DRBCC_LOG_MIRROR_MAGIC, sizeof(h->magic))) && (h->version == DRBCC_LOG_MIRROR_VERSION) &&
+		(h->byteorder == DRBCC_LOG_ARCHIVE_BYTEORDER) && (h->recordSize == sizeof(DRBCC_LOG_RECORD_t)) &&
+		(h->count <= h->capacity) && ((h->first < h->capacity) || (h->capacity == 0));
+}
+
+static off_t libdrbcc_log_mirror_offset(unsigned int index)
+{
+	return (off_t) sizeof(DRBCC_LOG_MIRROR_HEADER_t) + (off_t) index * sizeof(DRBCC_LOG_RECORD_t);
+}
+
+// drop all records, capacity: entries of the ring log area
+static void libdrbcc_log_mirror_reset(struct DRBCC_LOG_MIRROR_S *mirror, unsigned int capacity)
+{
+	TRACE(DRBCC_TR_TRANS, "log mirror reset, %u entries", capacity);
+	mirror->header.capacity = capacity;
+	mirror->header.count = 0;
+	mirror->header.first = 0;
+	if (0 != ftruncate(mirror->fd, libdrbcc_log_mirror_offset(capacity)))
+	{
+		mirror->error = "Log mirror sync failed, can't resize the mirror file";
+	}
+}
+
+void libdrbcc_log_mirror_entry(DRBCC_t *drbcc, int pos, int len, uint8_t data[])
+{
+	struct DRBCC_LOG_MIRROR_S *mirror = drbcc->logMirror;
+	DRBCC_LOG_MIRROR_HEADER_t *h = &mirror->header;
+	DRBCC_LOG_ENTRY_t entry;
+	DRBCC_LOG_RECORD_t record;
+	unsigned int index;
+
+	if (mirror->error)
+	{
+		return;
+	}
+	drbcc_log_decode(pos, len, data, &entry);
+	drbcc_log_record_encode(&entry, &record);
+
+	if (mirror->verify)
+	{
+		mirror->verify = 0;
+		if (drbcc->start == (unsigned int) mirror->last.pos)
+		{
+			if (0 == memcmp(&record, &mirror->last, sizeof(record)))
+			{
+				// stored by the last sync
+				return;
+			}
+			// cleared or overwritten since the last sync, the entries in front of this one are unknown
+			libdrbcc_log_mirror_reset(mirror, drbcc->maxFilelength / 16);
+			mirror->error = "Log mirror out of sync, mirror reset";
+			drbcc->logStop = 1;
+			return;
+		}
+		// the log was cleared or wrapped past the last sync, all entries are fetched
+		libdrbcc_log_mirror_reset(mirror, drbcc->maxFilelength / 16);
+	}
+	if (h->capacity != drbcc->maxFilelength / 16)
+	{
+		libdrbcc_log_mirror_reset(mirror, drbcc->maxFilelength / 16);
+	}
+	if ((h->capacity == 0) || mirror->error)
+	{
+		drbcc->logStop = 1;
+		return;
+	}
+
+	index = (h->first + h->count) % h->capacity;
+	if (sizeof(record) != pwrite(mirror->fd, &record, sizeof(record), libdrbcc_log_mirror_offset(index)))
+	{
+		mirror->error = "Log mirror sync failed, can't write the mirror file";
+		drbcc->logStop = 1;
+		return;
+	}
+	if (h->count < h->capacity)
+	{
+		h->count++;
+	}
+	else
+	{
+		// the oldest record was overwritten
+		h->first = (h->first + 1) % h->capacity;
+	}
+}
+
+int libdrbcc_log_mirror_end(DRBCC_t *drbcc, int success)
+{
+	struct DRBCC_LOG_MIRROR_S *mirror = drbcc->logMirror;
+
+	drbcc->logMirror = NULL;
+	if (mirror->error)
+	{
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, (char*) mirror->error);
+		}
+		// fetch all entries next time
+		memset(&mirror->header.cursor, 0, sizeof(mirror->header.cursor));
+		success = 0;
+	}
+	else if (success)
+	{
+		memcpy(&mirror->header.cursor, &mirror->cursor, sizeof(mirror->header.cursor));
+	}
+	// a failed sync continues at the newest record stored
+
+	if ((0 != fsync(mirror->fd)) ||
+		(sizeof(mirror->header) != pwrite(mirror->fd, &mirror->header, sizeof(mirror->header), 0)) ||
+		(0 != fsync(mirror->fd)))
+	{
+		if (drbcc->error_cb)
+		{
+			drbcc->error_cb(drbcc->context, "Log mirror sync failed, can't write the mirror file");
+		}
+		success = 0;
+	}
+	close(mirror->fd);	// unlocks the file
+	free(mirror);
+	return success;
+}
+
+DRBCC_RC_t drbcc_log_mirror_sync(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *filename)
+{
+	DRBCC_t *drbcc = h;
+	struct DRBCC_LOG_MIRROR_S *mirror;
+	DRBCC_RC_t rc;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->session || drbcc->logMirror)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+	mirror = calloc(1, sizeof(struct DRBCC_LOG_MIRROR_S));
+	if (mirror == NULL)
+	{
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+	mirror->fd = open(filename, O_RDWR | O_CREAT | OX_BINARY, 0666);
+	if (mirror->fd < 0)
+	{
+		free(mirror);
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	if (0 != flock(mirror->fd, LOCK_EX | LOCK_NB))
+	{
+		close(mirror->fd);
+		free(mirror);
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	if ((sizeof(mirror->header) != pread(mirror->fd, &mirror->header, sizeof(mirror->header), 0)) ||
+		!libdrbcc_log_mirror_valid(&mirror->header))
+	{
+		// new mirror, sized when the log area is known
+		memset(&mirror->header, 0, sizeof(mirror->header));
+		memcpy(mirror->header.magic, DRBCC_LOG_MIRROR_MAGIC, sizeof(mirror->header.magic));
+		mirror->header.version = DRBCC_LOG_MIRROR_VERSION;
+		mirror->header.byteorder = DRBCC_LOG_ARCHIVE_BYTEORDER;
+		mirror->header.recordSize = sizeof(DRBCC_LOG_RECORD_t);
+	}
+
+	memcpy(&mirror->cursor, &mirror->header.cursor, sizeof(mirror->cursor));
+	if ((mirror->header.count > 0) && (mirror->cursor.magic == DRBCC_LOG_CURSOR_MAGIC))
+	{
+		unsigned int index = (mirror->header.first + mirror->header.count - 1) % mirror->header.capacity;
+
+		if (sizeof(mirror->last) == pread(mirror->fd, &mirror->last, sizeof(mirror->last), libdrbcc_log_mirror_offset(index)))
+		{
+			// fetch again from the newest record on, it must be unchanged
+			mirror->cursor.pos = mirror->last.pos;
+			mirror->verify = 1;
+		}
+		else
+		{
+			mirror->cursor.magic = 0;
+		}
+	}
+
+	drbcc->logMirror = mirror;
+	rc = drbcc_get_log_since(h, session, &mirror->cursor, NULL);
+	if (rc != DRBCC_RC_NOERROR)
+	{
+		drbcc->logMirror = NULL;
+		close(mirror->fd);
+		free(mirror);
+	}
+	return rc;
+}
+
+// query: record of index i from the oldest on
+static const DRBCC_LOG_RECORD_t *libdrbcc_log_mirror_record(const DRBCC_LOG_MIRROR_HEADER_t *h, unsigned int i)
+{
+	return (const DRBCC_LOG_RECORD_t *) (h + 1) + (h->first + i) % h->capacity;
+}
+
+// query: 1 if the record is older than the first one that can match the filter, only the epoch is
+// compared: the time is -1 for entries without timestamp and goes back if the RTC is set back
+static int libdrbcc_log_mirror_before(const DRBCC_LOG_RECORD_t *record, const DRBCC_LOG_FILTER_t *filter)
+{
+	return record->epoch < filter->minEpoch;
+}
+
+DRBCC_RC_t drbcc_log_mirror_query(const char *filename, const DRBCC_LOG_FILTER_t *filter, DRBCC_LOG_QUERY_CB_t cb, void *context)
+{
+	DRBCC_LOG_FILTER_t all;
+	const DRBCC_LOG_MIRROR_HEADER_t *h;
+	DRBCC_LOG_ENTRY_t entry;
+	struct stat st;
+	void *map;
+	unsigned int lo = 0;
+	unsigned int hi;
+	unsigned int i;
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+	int fd = open(filename, O_RDONLY | OX_BINARY);
+
+	if (fd < 0)
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+	if (filter == NULL)
+	{
+		memset(&all, 0, sizeof(all));
+		filter = &all;
+	}
+	if ((0 != flock(fd, LOCK_SH)) || (0 != fstat(fd, &st)))
+	{
+		close(fd);
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+	if (st.st_size < (off_t) sizeof(DRBCC_LOG_MIRROR_HEADER_t))
+	{
+		close(fd);
+		return DRBCC_RC_INVALID_IMAGE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		close(fd);
+		return DRBCC_RC_SYSTEM_ERROR;
+	}
+
+	h = map;
+	if (!libdrbcc_log_mirror_valid(h) || (st.st_size < libdrbcc_log_mirror_offset(h->capacity)))
+	{
+		rc = DRBCC_RC_INVALID_IMAGE;
+	}
+	else
+	{
+		// first record of epoch filter->minEpoch, the records are in log order, the time range is checked below
+		hi = h->count;
+		while (lo < hi)
+		{
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if (libdrbcc_log_mirror_before(libdrbcc_log_mirror_record(h, mid), filter))
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		for (i = lo; i < h->count; i++)
+		{
+			const DRBCC_LOG_RECORD_t *record = libdrbcc_log_mirror_record(h, i);
+
+			if ((filter->events && ((record->event >= 32) || !(filter->events & DRBCC_LOG_EVENT_BIT(record->event)))) ||
+				(record->epoch < filter->minEpoch) ||
+				((filter->from || filter->to) && (record->time == -1)) ||
+				(filter->from && (record->time < (int64_t) filter->from)) ||
+				(filter->to && (record->time > (int64_t) filter->to)))
+			{
+				continue;
+			}
+			drbcc_log_record_decode(record, &entry);
+			if (!cb(context, &entry))
+			{
+				break;
+			}
+		}
+	}
+	munmap(map, st.st_size);
+	close(fd);
+	return rc;
+}
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+*
+* NO CODE BELOW THIS! */
@@ -0,0 +1,421 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include "drbcc_files.h"
+#include "drbcc_ll.h"
+#include "drbcc_trace.h"
+#include "drbcc_utils.h"
+
+#if USE_OPEN_BINARY
+#define OX_BINARY O_BINARY
+#else
+#define OX_BINARY 0
+#endif
+
+#define CHUNK 128
+
+extern int libdrbcc_initialized;
+extern DRBCC_SESSION_t drbcc_session;
+
+void libdrbcc_free_queue(DRBCC_MESSAGE_t *msg);
+
+static const char *phaseName[DRBCC_UPDATE_PHASES] =
+{
+	"none", "boot loader upload", "firmware upload", "verify", "invalidate", "restart", "wait for update", "resync"
+};
+
+static unsigned long libdrbcc_update_ms(const struct timeval *from)
+{
+	struct timeval now, dur;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, from, &dur);
+	return dur.tv_sec * 1000 + dur.tv_usec / 1000;
+}
+
+static void libdrbcc_update_close(DRBCC_t *drbcc)
+{
+	if (drbcc->updateFd != -1)
+	{
+		close(drbcc->updateFd);
+		drbcc->updateFd = -1;
+	}
+}
+
+static void libdrbcc_update_fail(DRBCC_t *drbcc, const char *msg)
+{
+	char s[256];
+	int verify = (drbcc->updatePhase == DRBCC_UPDATE_PHASE_VERIFY);
+
+	TRACE_WARN("firmware update failed in phase %s: %s", phaseName[drbcc->updatePhase], msg);
+	snprintf(s, sizeof(s), "Firmware update failed, %s", msg);
+	if (verify)
+	{
+		// drop the reads not sent yet, the read in flight is answered later
+		libdrbcc_free_queue(drbcc->secQueue);
+		drbcc->secQueue = NULL;
+	}
+	libdrbcc_update_close(drbcc);
+	drbcc->updatePhase = DRBCC_UPDATE_PHASE_NONE;
+	libdrbcc_end_session(drbcc, s, 0);
+	if (verify && (drbcc->state == DRBCC_STATE_USER))
+	{
+		// no new request from the session callback, the late answer goes to libdrbcc_update_read_cb
+		drbcc->state = DRBCC_STATE_FW_UPDATE;
+	}
+}
+
+// end the current phase and report its duration
+static void libdrbcc_update_phase(DRBCC_t *drbcc, DRBCC_UPDATE_PHASE_t next)
+{
+	unsigned long ms = libdrbcc_update_ms(&drbcc->updateStart);
+	DRBCC_UPDATE_PHASE_t phase = drbcc->updatePhase;
+
+	TRACE(DRBCC_TR_TRANS, "firmware update phase %s done in %lu ms", phaseName[phase], ms);
+	drbcc->updateMs[phase] = ms;
+	if (drbcc->update_cb)
+	{
+		drbcc->update_cb(drbcc->context, phase, ms);
+	}
+	drbcc->updatePhase = next;
+	gettimeofday(&drbcc->updateStart, NULL);
+}
+
+static void libdrbcc_update_done(DRBCC_t *drbcc)
+{
+	char s[256];
+	const unsigned long *ms = drbcc->updateMs;
+
+	snprintf(s, sizeof(s), "Firmware update done, upload %lu.%03lu s, verify %lu.%03lu s, invalidate %lu.%03lu s, "
+		"restart %lu.%03lu s, reconnect %lu.%03lu s",
+		(ms[DRBCC_UPDATE_PHASE_BOOTLOADER] + ms[DRBCC_UPDATE_PHASE_UPLOAD]) / 1000,
+		(ms[DRBCC_UPDATE_PHASE_BOOTLOADER] + ms[DRBCC_UPDATE_PHASE_UPLOAD]) % 1000,
+		ms[DRBCC_UPDATE_PHASE_VERIFY] / 1000, ms[DRBCC_UPDATE_PHASE_VERIFY] % 1000,
+		ms[DRBCC_UPDATE_PHASE_INVALIDATE] / 1000, ms[DRBCC_UPDATE_PHASE_INVALIDATE] % 1000,
+		ms[DRBCC_UPDATE_PHASE_RESTART] / 1000, ms[DRBCC_UPDATE_PHASE_RESTART] % 1000,
+		(ms[DRBCC_UPDATE_PHASE_WAIT] + ms[DRBCC_UPDATE_PHASE_RESYNC]) / 1000,
+		(ms[DRBCC_UPDATE_PHASE_WAIT] + ms[DRBCC_UPDATE_PHASE_RESYNC]) % 1000);
+	libdrbcc_update_close(drbcc);
+	drbcc->updatePhase = DRBCC_UPDATE_PHASE_NONE;
+	libdrbcc_end_session(drbcc, s, 1);
+}
+
+// queue a request without parameters or with one parameter byte
+static int libdrbcc_update_request(DRBCC_t *drbcc, uint8_t id, int param)
+{
+	DRBCC_MESSAGE_t *msg = malloc(sizeof(DRBCC_MESSAGE_t));
+
+	if (msg == NULL)
+	{
+		libdrbcc_update_fail(drbcc, "out of memory");
+		return -1;
+	}
+	msg->msg_len = 1;
+	msg->msg[0] = id;
+	if (param >= 0)
+	{
+		msg->msg[msg->msg_len++] = (uint8_t) param;
+	}
+	libdrbcc_add_msg_prio(drbcc, msg);
+	return 0;
+}
+
+// file uploaded in the current phase, NULL: phase skipped
+static const char *libdrbcc_update_file(DRBCC_t *drbcc, DRBCC_FLASHFILE_TYPES_t *type)
+{
+	if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_BOOTLOADER)
+	{
+		*type = DRBCC_FLASHFILE_T_BOOTLOADER;
+		return drbcc->updateBootloader[0] ? drbcc->updateBootloader : NULL;
+	}
+	*type = DRBCC_FLASHFILE_T_FW_IMAGE;
+	return drbcc->updateFirmware;
+}
+
+// put the boot loader or firmware file with index 0 (used by the XMega)
+static void libdrbcc_update_upload(DRBCC_t *drbcc)
+{
+	DRBCC_FLASHFILE_TYPES_t type;
+	const char *filename = libdrbcc_update_file(drbcc, &type);
+
+	if (filename == NULL)
+	{
+		// no boot loader
+		drbcc->updatePhase = DRBCC_UPDATE_PHASE_UPLOAD;
+		filename = libdrbcc_update_file(drbcc, &type);
+	}
+	if (DRBCC_RC_NOERROR != libdrbcc_prepare_put_file(drbcc, 0, type, filename, 0))
+	{
+		libdrbcc_update_fail(drbcc, "can't read the file to upload");
+		return;
+	}
+	libdrbcc_request_partition(drbcc);
+}
+
+// read back the next uploaded file, the comparison follows in libdrbcc_update_read_cb
+static void libdrbcc_update_verify(DRBCC_t *drbcc)
+{
+	if (drbcc->updateVerify == 0 && drbcc->updateBootloader[0] == 0)
+	{
+		drbcc->updateVerify = 1;
+	}
+	if (drbcc->updateVerify > 1)
+	{
+		libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_INVALIDATE);
+		libdrbcc_update_request(drbcc, DRBCC_REQ_FW_INVALIDATE, -1);
+		return;
+	}
+	drbcc->state = DRBCC_STATE_FW_UPDATE;
+	libdrbcc_request_partition(drbcc);
+}
+
+void libdrbcc_update_partition(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[])
+{
+	DRBCC_FLASHFILE_TYPES_t type = drbcc->updateVerify ? DRBCC_FLASHFILE_T_FW_IMAGE : DRBCC_FLASHFILE_T_BOOTLOADER;
+	const char *filename = drbcc->updateVerify ? drbcc->updateFirmware : drbcc->updateBootloader;
+	int i;
+
+	for (i = 0; i < DRBCC_PART_ENTRIES; i++)
+	{
+		if ((e[i].type.bits.blocktype == 0) && (e[i].type.bits.type == type) && (e[i].type.bits.idx == 0))
+		{
+			break;
+		}
+	}
+	if (i == DRBCC_PART_ENTRIES)
+	{
+		libdrbcc_update_fail(drbcc, "uploaded file not found in the partition table");
+		return;
+	}
+
+	drbcc->updateFd = open(filename, O_RDONLY | OX_BINARY);
+	if ((drbcc->updateFd == -1) || (lseek(drbcc->updateFd, 0, SEEK_END) != (off_t) e[i].length) ||
+		(lseek(drbcc->updateFd, 0, SEEK_SET) != 0))
+	{
+		libdrbcc_update_fail(drbcc, "size of the uploaded file differs");
+		return;
+	}
+
+	TRACE(DRBCC_TR_TRANS, "verify %s at block %u length %u", filename, e[i].startblock, e[i].length);
+	drbcc->updateAddr = e[i].startblock * 0x1000;
+	drbcc->curFilelength = 0;
+	drbcc->maxFilelength = e[i].length;
+
+	// all reads are queued at once, the answers arrive in order
+	if (DRBCC_RC_NOERROR != libdrbcc_req_flash_read_all(drbcc, drbcc->updateAddr, e[i].length))
+	{
+		libdrbcc_update_fail(drbcc, "out of memory");
+	}
+}
+
+void libdrbcc_update_read_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	uint8_t buf[CHUNK];
+	char s[128];
+
+	if ((drbcc->updatePhase != DRBCC_UPDATE_PHASE_VERIFY) || (drbcc->updateFd == -1))
+	{
+		// answers of a failed verify
+		return;
+	}
+	if ((addr != drbcc->updateAddr + drbcc->curFilelength) || (len > sizeof(buf)) ||
+		((ssize_t) len != read(drbcc->updateFd, buf, len)) || memcmp(buf, data, len))
+	{
+		snprintf(s, sizeof(s), "flash content differs at offset %u", drbcc->curFilelength);
+		libdrbcc_update_fail(drbcc, s);
+		return;
+	}
+
+	drbcc->curFilelength += len;
+	if (drbcc->progress_cb)
+	{
+		drbcc->progress_cb(drbcc->context, drbcc->curFilelength, drbcc->maxFilelength);
+	}
+	if (drbcc->curFilelength < drbcc->maxFilelength)
+	{
+		return;
+	}
+
+	libdrbcc_update_close(drbcc);
+	drbcc->updateVerify++;
+	libdrbcc_update_verify(drbcc);
+}
+
+// session of the upload phases ended or verify failed, see libdrbcc_end_session
+void libdrbcc_update_next(DRBCC_t *drbcc)
+{
+	drbcc->state = DRBCC_STATE_FW_UPDATE;
+	if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_BOOTLOADER)
+	{
+		libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_UPLOAD);
+		libdrbcc_update_upload(drbcc);
+	}
+	else if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_UPLOAD)
+	{
+		// errors of the upload are detected by the verify
+		libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_VERIFY);
+		drbcc->updateVerify = 0;
+		libdrbcc_update_verify(drbcc);
+	}
+	else
+	{
+		libdrbcc_update_fail(drbcc, "unexpected end of session");
+	}
+}
+
+void libdrbcc_update_event(DRBCC_t *drbcc, uint8_t id)
+{
+	struct timeval now;
+
+	switch (id)
+	{
+	case DRBCC_IND_FW_INVALIDATED:
+		if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_INVALIDATE)
+		{
+			libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_RESTART);
+			// the boot loader changes the flash content
+			libdrbcc_invalidate_partition(drbcc);
+			libdrbcc_update_request(drbcc, DRBCC_REQ_BCTRL_RESTART, (drbcc->updateFlags & DRBCC_UPDATE_RESTART_NOW) ? 1 : 0);
+		}
+		break;
+	case DRBCC_IND_BCTRL_RESTART_ACCEPTED:
+		if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_RESTART)
+		{
+			libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_WAIT);
+			if (!(drbcc->updateFlags & DRBCC_UPDATE_RESTART_NOW) || (drbcc->updateFlags & DRBCC_UPDATE_NO_WAIT))
+			{
+				// the boot loader updates the firmware at the next restart
+				libdrbcc_update_done(drbcc);
+				return;
+			}
+			gettimeofday(&now, NULL);
+			drbcc->updateDeadline = now;
+			drbcc->updateDeadline.tv_sec += DRBCC_UPDATE_TIMEOUT;
+		}
+		break;
+	case DRBCC_IND_FW_UPDATE_STARTED:
+		if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_WAIT)
+		{
+			// poll with SYNC until the new firmware answers, see libdrbcc_update_poll
+			libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_RESYNC);
+			drbcc->updateNext = drbcc->updateStart;
+		}
+		break;
+	case DRBCC_SYNC:
+		if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_RESYNC)
+		{
+			libdrbcc_update_phase(drbcc, DRBCC_UPDATE_PHASE_NONE);
+			libdrbcc_update_done(drbcc);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void libdrbcc_update_poll(DRBCC_t *drbcc, const struct timeval *now)
+{
+	if ((drbcc->updatePhase != DRBCC_UPDATE_PHASE_WAIT) && (drbcc->updatePhase != DRBCC_UPDATE_PHASE_RESYNC))
+	{
+		return;
+	}
+	if (timercmp(now, &drbcc->updateDeadline, >))
+	{
+		libdrbcc_update_fail(drbcc, (drbcc->updatePhase == DRBCC_UPDATE_PHASE_WAIT) ?
+			"boot loader did not start the update" : "board controller does not answer after the update");
+		return;
+	}
+	if ((drbcc->updatePhase == DRBCC_UPDATE_PHASE_RESYNC) && !drbcc->wait_for_ack && !drbcc->prioQueue &&
+		timercmp(now, &drbcc->updateNext, >))
+	{
+		drbcc->updateNext = *now;
+		drbcc->updateNext.tv_sec += 1;
+		libdrbcc_update_request(drbcc, DRBCC_SYNC, -1);
+	}
+}
+
+int libdrbcc_update_error(DRBCC_t *drbcc, const char *msg)
+{
+	if (drbcc->updatePhase == DRBCC_UPDATE_PHASE_NONE)
+	{
+		return 0;
+	}
+	if ((drbcc->updatePhase == DRBCC_UPDATE_PHASE_WAIT) || (drbcc->updatePhase == DRBCC_UPDATE_PHASE_RESYNC))
+	{
+		// board controller is restarting, libdrbcc_update_poll keeps trying until the deadline
+		TRACE(DRBCC_TR_TRANS, "firmware update ignores %s while waiting for the new firmware", msg);
+		return 1;
+	}
+	libdrbcc_update_fail(drbcc, msg);
+	return 1;
+}
+
+DRBCC_RC_t drbcc_update_firmware(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const char *firmware, const char *bootloader,
+	unsigned int flags, DRBCC_UPDATE_CB_t update_cb)
+{
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	if ((firmware == NULL) || (access(firmware, R_OK) != 0) || (bootloader && (access(bootloader, R_OK) != 0)))
+	{
+		return DRBCC_RC_INVALID_FILENAME;
+	}
+
+	strncpy(drbcc->updateFirmware, firmware, FILENAME_MAX - 1);
+	drbcc->updateFirmware[FILENAME_MAX - 1] = 0;
+	strncpy(drbcc->updateBootloader, bootloader ? bootloader : "", FILENAME_MAX - 1);
+	drbcc->updateBootloader[FILENAME_MAX - 1] = 0;
+	drbcc->updateFlags = flags;
+	drbcc->update_cb = update_cb;
+	drbcc->updateFd = -1;
+	memset(drbcc->updateMs, 0, sizeof(drbcc->updateMs));
+	gettimeofday(&drbcc->updateStart, NULL);
+	drbcc->updatePhase = DRBCC_UPDATE_PHASE_BOOTLOADER;
+	drbcc->state = DRBCC_STATE_FW_UPDATE;
+
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+
+	libdrbcc_update_upload(drbcc);
+	return DRBCC_RC_NOERROR;
+}
@@ -698,6 +698,50 @@ DRBCC_RC_t libdrbcc_req_flash_read(DRBCC_t *drbcc, unsigned addr, unsigned len)
 	return DRBCC_RC_NOERROR;
 }
 
+// all bytes 0xFF (erased flash)
+int libdrbcc_is_empty(const uint8_t *data, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (data[i] != 0xFF)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// queue the read requests for all chunks at once, the answers arrive without waiting for the caller
+DRBCC_RC_t libdrbcc_req_flash_read_all(DRBCC_t *drbcc, unsigned addr, unsigned len)
+{
+	while (len)
+	{
+		unsigned size = (len < CHUNK) ? len : CHUNK;
+
+		DRBCC_MESSAGE_t *msg = malloc(sizeof(DRBCC_MESSAGE_t));
+
+		if (msg == NULL)
+		{
+			return DRBCC_RC_OUTOFMEMORY;
+		}
+		msg->msg_len = 5;
+		msg->msg[0] = DRBCC_REQ_EXTFLASH_READ;
+		msg->msg[1] = (uint8_t) ((addr >> 16) & 0xFF);
+		msg->msg[2] = (uint8_t) ((addr >>  8) & 0xFF);
+		msg->msg[3] = (uint8_t) ((addr >>  0) & 0xFF);
+		msg->msg[4] = (uint8_t) size;
+
+		libdrbcc_add_msg_sec(drbcc, msg);
+		addr += size;
+		len -= size;
+	}
+	drbcc->flashAddr = addr;
+	drbcc->flashLen = 0;
+	return DRBCC_RC_NOERROR;
+}
+
 DRBCC_RC_t drbcc_req_flash_read(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsigned addr, unsigned len)
 {
 	DRBCC_t *drbcc = h;
@@ -719,6 +763,75 @@ DRBCC_RC_t drbcc_req_flash_read(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsi
 	return libdrbcc_req_flash_read(h, addr, len);
 }
 
+DRBCC_RC_t drbcc_flash_read_into(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, unsigned addr, unsigned len, uint8_t *buf)
+{
+	DRBCC_RC_t rc;
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+	if ((buf == NULL) || (len == 0))
+	{
+		return DRBCC_RC_UNSPEC_ERROR;
+	}
+
+	drbcc->readBuf = buf;
+	drbcc->readStart = addr;
+	drbcc->readLen = len;
+	drbcc->readCount = 0;
+
+	rc = libdrbcc_req_flash_read(drbcc, addr, len);
+	if (rc == DRBCC_RC_NOERROR)
+	{
+		drbcc->session = drbcc_session++;
+		*session = drbcc->session;
+		drbcc->state = DRBCC_STATE_READ_INTO;
+	}
+	return rc;
+}
+
+DRBCC_RC_t drbcc_flash_read_count(DRBCC_HANDLE_t h, unsigned *count)
+{
+	DRBCC_t *drbcc = h;
+
+	CHECK_HANDLE(drbcc);
+
+	*count = drbcc->readCount;
+	return DRBCC_RC_NOERROR;
+}
+
+// copy the payload of the read indication into the caller buffer, request the next chunk
+void libdrbcc_read_into_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int offset = addr - drbcc->readStart;
+
+	if ((offset != drbcc->readCount) || (offset + len > drbcc->readLen))
+	{
+		TRACE_WARN("unexpected flash read answer addr 0x%06x len %u", addr, len);
+		drbcc->readBuf = NULL;
+		libdrbcc_end_session(drbcc, "Flash read into buffer failed, unexpected address", 0);
+		return;
+	}
+
+	memcpy(&drbcc->readBuf[offset], data, len);
+	drbcc->readCount += len;
+
+	if (drbcc->flashLen == 0)
+	{
+		drbcc->readBuf = NULL;
+		libdrbcc_end_session(drbcc, NULL, 1);
+	}
+	else if (DRBCC_RC_NOERROR != libdrbcc_req_flash_read(drbcc, drbcc->flashAddr, drbcc->flashLen))
+	{
+		drbcc->readBuf = NULL;
+		libdrbcc_end_session(drbcc, "Out of memory during flash read", 0);
+	}
+}
+
 DRBCC_RC_t libdrbcc_flash_write(DRBCC_t *drbcc)
 {
 	unsigned int i;
@@ -845,6 +958,12 @@ DRBCC_RC_t drbcc_req_flash_write(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, uns
 		*session = drbcc->session;
 	}
 
+	if (addr < DRBCC_LOG_FIRSTBLOCK * 0x1000)
+	{
+		// partition table area touched
+		libdrbcc_invalidate_partition(drbcc);
+	}
+
 	return libdrbcc_req_flash_write(drbcc, addr, len, data);
 }
 
@@ -883,6 +1002,12 @@ DRBCC_RC_t drbcc_req_flash_erase_block(DRBCC_HANDLE_t h, DRBCC_SESSION_t *sessio
 		*session = drbcc->session;
 	}
 
+	if (blocknum < DRBCC_LOG_FIRSTBLOCK)
+	{
+		// partition table area touched
+		libdrbcc_invalidate_partition(drbcc);
+	}
+
 	return libdrbcc_req_flash_erase_block(drbcc, blocknum);
 }
 
@@ -938,6 +1063,9 @@ DRBCC_RC_t drbcc_restart_bctrl(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, int w
 		msg->msg[0] = DRBCC_REQ_BCTRL_RESTART;
 		msg->msg[1] = (uint8_t) when;
 
+		// the boot loader may change the flash content (firmware update)
+		libdrbcc_invalidate_partition(drbcc);
+
 		libdrbcc_add_msg_prio(drbcc, msg);
 		if((0 != session) && drbcc->session_cb)
 		{
@@ -25,14 +25,72 @@
 
 DRBCC_RC_t libdrbcc_req_flash_read(DRBCC_t *drbcc, unsigned addr, unsigned len);
 
+int libdrbcc_is_empty(const uint8_t *data, unsigned int len);
+
+DRBCC_RC_t libdrbcc_req_flash_read_all(DRBCC_t *drbcc, unsigned addr, unsigned len);
+
 DRBCC_RC_t libdrbcc_flash_write(DRBCC_t *drbcc);
 
 uint16_t libdrbcc_crc_ccitt_update(uint16_t crc, uint8_t data);
 
+// FNV-1a, start with DRBCC_HASH_INIT
+uint32_t libdrbcc_fnv1a_update(uint32_t hash, const uint8_t *data, unsigned int len);
+
+// content hash of a whole local file, 0: ok
+int libdrbcc_file_hash(const char *filename, uint32_t *hash);
+
 DRBCC_RC_t libdrbcc_req_flash_erase_block(DRBCC_t *drbcc, unsigned blocknum);
 
 DRBCC_RC_t libdrbcc_req_flash_write(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data);
 
+void libdrbcc_invalidate_partition(DRBCC_t *drbcc);
+
+// table with the log areas only
+void libdrbcc_default_partition(DRBCC_PARTENTRY_t e[]);
+
+// flash layout of the table, used for both copies
+void libdrbcc_build_partition(const DRBCC_PARTENTRY_t e[], uint8_t data[128]);
+
+// flash layout of the content hashes, stored behind the table in both copies
+void libdrbcc_build_hashes(const uint32_t hash[], uint8_t data[128]);
+
+DRBCC_RC_t libdrbcc_read_partition(DRBCC_t *drbcc);
+
+// ring log area of the raw partition table data (block 0 of a flash image), 0: no valid table, default area
+int libdrbcc_log_area(const uint8_t data[], unsigned int len, unsigned int *startblock, unsigned int *blocks);
+
+DRBCC_RC_t libdrbcc_request_partition(DRBCC_t *drbcc);
+
+void libdrbcc_end_session(DRBCC_t *drbcc, const char *msg, int success);
+
+// open the file to put and set up the transfer, the caller starts it with libdrbcc_request_partition
+DRBCC_RC_t libdrbcc_prepare_put_file(DRBCC_t *drbcc, int index, DRBCC_FLASHFILE_TYPES_t type, const char filename[], int diff);
+
+void libdrbcc_update_next(DRBCC_t *drbcc);
+
+void libdrbcc_update_partition(DRBCC_t *drbcc, DRBCC_PARTENTRY_t e[]);
+
+void libdrbcc_update_read_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data);
+
+void libdrbcc_update_event(DRBCC_t *drbcc, uint8_t id);
+
+void libdrbcc_update_poll(DRBCC_t *drbcc, const struct timeval *now);
+
+void libdrbcc_log_follow_poll(DRBCC_t *drbcc, const struct timeval *now);
+
+// communication error during drbcc_update_firmware, 0: no update running
+int libdrbcc_update_error(DRBCC_t *drbcc, const char *msg);
+
+void libdrbcc_read_into_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data);
+
+void libdrbcc_sg_read_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data);
+
+void libdrbcc_sg_write_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result);
+
+void libdrbcc_image_read_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data);
+
+void libdrbcc_image_write_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result);
+
 void libdrbcc_logpos_cb(DRBCC_t *drbcc);
 
 void libdrbcc_readflash_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data);
@@ -43,6 +101,29 @@ void libdrbcc_add_msg_sec(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg);
 
 void libdrbcc_add_msg_prio(DRBCC_t *drbcc, DRBCC_MESSAGE_t *msg);
 
+DRBCC_MESSAGE_t *libdrbcc_last_msg_sec(DRBCC_t *drbcc);
+
+void libdrbcc_drop_msg_sec(DRBCC_t *drbcc, DRBCC_MESSAGE_t *mark);
+
+#define DRBCC_LOG_FILTER_PASS	0
+#define DRBCC_LOG_FILTER_SKIP	1
+#define DRBCC_LOG_FILTER_STOP	2	// skip, all older entries are skipped too
+
+// check the 16 byte log entry data against the filter, entries without timestamp are skipped by time and epoch limits
+int libdrbcc_log_filter(const DRBCC_LOG_FILTER_t *filter, const uint8_t data[]);
+
+// timestamp of the 16 byte log entry data, -1: no timestamp
+time_t libdrbcc_log_entry_time(const uint8_t data[]);
+
+// drbcc_log_mirror_sync: store an entry fetched
+void libdrbcc_log_mirror_entry(DRBCC_t *drbcc, int pos, int len, uint8_t data[]);
+
+// drbcc_log_mirror_sync: write the mirror header and unlock the file, returns success
+int libdrbcc_log_mirror_end(DRBCC_t *drbcc, int success);
+
+// drbcc_log_aggregate: decode an entry fetched and add it to the statistics
+void libdrbcc_log_aggregate_entry(DRBCC_t *drbcc, int pos, int len, const uint8_t data[]);
+
 #endif /* _DRBCC_UTILS_H_ */
 
 /* Editor hints for emacs
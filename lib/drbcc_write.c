@@ -0,0 +1,320 @@
+/* Editor hints for vim
+* vim:set ts=4 sw=4 noexpandtab:  */
+
+/*
+ * Copyright (C) 2013 DResearch Fahrzeugelektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as 
+ * published by the Free Software Foundation, either version 3 of the 
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "drbcc.h"
+#include "drbcc_ll.h"
+#include "drbcc_trace.h"
+#include "drbcc_utils.h"
+#include "drbcc_alloc.h"
+
+#define CHUNK 128
+#define DRBCC_WRITE_WINDOW	64	// max. queued chunk writes
+
+extern int libdrbcc_initialized;
+extern DRBCC_SESSION_t drbcc_session;
+
+static int libdrbcc_sg_compare(const void *a, const void *b)
+{
+	const DRBCC_FLASH_SEGMENT_t *sa = a;
+	const DRBCC_FLASH_SEGMENT_t *sb = b;
+
+	return (sa->addr > sb->addr) - (sa->addr < sb->addr);
+}
+
+static void libdrbcc_sg_end(DRBCC_t *drbcc, const char *msg, int success)
+{
+	free(drbcc->sgSegs);
+	drbcc->sgSegs = NULL;
+	free(drbcc->sgBuf);
+	drbcc->sgBuf = NULL;
+	if (!success)
+	{
+		// the queued erases and chunk writes must not reach the flash
+		libdrbcc_drop_msg_sec(drbcc, NULL);
+	}
+	libdrbcc_end_session(drbcc, msg, success);
+}
+
+// number of bytes of the current block covered by segments
+static unsigned int libdrbcc_sg_covered(DRBCC_t *drbcc)
+{
+	unsigned int i;
+	unsigned int covered = 0;
+	unsigned int start = drbcc->sgBlock * DRBCC_BLOCK_SIZE;
+	unsigned int end = start + DRBCC_BLOCK_SIZE;
+
+	for (i = drbcc->sgSeg; (i < drbcc->sgCount) && (drbcc->sgSegs[i].addr < end); i++)
+	{
+		unsigned int from = (drbcc->sgSegs[i].addr > start) ? drbcc->sgSegs[i].addr : start;
+		unsigned int to = drbcc->sgSegs[i].addr + drbcc->sgSegs[i].len;
+
+		if (to > end)
+		{
+			to = end;
+		}
+		if (to > from)
+		{
+			covered += to - from;
+		}
+	}
+	return covered;
+}
+
+// merge the segments into the block data, returns 1 if bits have to change from 0 to 1
+static int libdrbcc_sg_merge(DRBCC_t *drbcc, uint32_t *changed)
+{
+	unsigned int i, pos;
+	int erase = 0;
+	unsigned int start = drbcc->sgBlock * DRBCC_BLOCK_SIZE;
+	unsigned int end = start + DRBCC_BLOCK_SIZE;
+
+	*changed = 0;
+	for (i = drbcc->sgSeg; (i < drbcc->sgCount) && (drbcc->sgSegs[i].addr < end); i++)
+	{
+		const DRBCC_FLASH_SEGMENT_t *seg = &drbcc->sgSegs[i];
+		unsigned int from = (seg->addr > start) ? seg->addr : start;
+		unsigned int to = ((seg->addr + seg->len) < end) ? seg->addr + seg->len : end;
+
+		for (pos = from; pos < to; pos++)
+		{
+			uint8_t old = drbcc->sgBuf[pos - start];
+			uint8_t new = seg->data[pos - seg->addr];
+
+			if (old != new)
+			{
+				if ((old & new) != new)
+				{
+					erase = 1;
+				}
+				*changed |= 1u << ((pos - start) / CHUNK);
+				drbcc->sgBuf[pos - start] = new;
+			}
+		}
+	}
+	return erase;
+}
+
+// erase if needed and queue the writes of the current block, sgBuf holds the new block content
+static void libdrbcc_sg_write(DRBCC_t *drbcc, int erase, uint32_t changed)
+{
+	unsigned int i;
+	unsigned int addr = drbcc->sgBlock * DRBCC_BLOCK_SIZE;
+
+	if (erase)
+	{
+		libdrbcc_req_flash_erase_block(drbcc, drbcc->sgBlock);
+		drbcc->sgErased++;
+	}
+	for (i = 0; i < DRBCC_BLOCK_SIZE / CHUNK; i++)
+	{
+		// erased flash is 0xFF, otherwise only changed chunks are written
+		if (erase ? !libdrbcc_is_empty(&drbcc->sgBuf[i * CHUNK], CHUNK) : (changed & (1u << i)))
+		{
+			libdrbcc_req_flash_write(drbcc, addr + i * CHUNK, CHUNK, &drbcc->sgBuf[i * CHUNK]);
+			drbcc->sgPending++;
+		}
+	}
+
+	// segments ending in this block are done
+	while ((drbcc->sgSeg < drbcc->sgCount) &&
+		(drbcc->sgSegs[drbcc->sgSeg].addr + drbcc->sgSegs[drbcc->sgSeg].len <= addr + DRBCC_BLOCK_SIZE))
+	{
+		drbcc->sgSeg++;
+	}
+	drbcc->sgBlock++;
+}
+
+// process the blocks in address order until a read back is needed or enough writes are queued
+static void libdrbcc_sg_next(DRBCC_t *drbcc)
+{
+	char s[128];
+	uint32_t changed;
+
+	while (!drbcc->sgReading && (drbcc->sgPending < DRBCC_WRITE_WINDOW) && (drbcc->sgSeg < drbcc->sgCount))
+	{
+		unsigned int first = drbcc->sgSegs[drbcc->sgSeg].addr / DRBCC_BLOCK_SIZE;
+
+		if (drbcc->sgBlock < first)
+		{
+			drbcc->sgBlock = first;
+		}
+
+		if (libdrbcc_sg_covered(drbcc) < DRBCC_BLOCK_SIZE)
+		{
+			// partially written block: read, merge and rewrite
+			drbcc->sgReading = 1;
+			drbcc->sgRead = 0;
+			drbcc->sgReadBack++;
+			if (DRBCC_RC_NOERROR != libdrbcc_req_flash_read_all(drbcc, drbcc->sgBlock * DRBCC_BLOCK_SIZE, DRBCC_BLOCK_SIZE))
+			{
+				libdrbcc_sg_end(drbcc, "Out of memory during flash write", 0);
+			}
+			return;
+		}
+
+		memset(drbcc->sgBuf, 0xFF, DRBCC_BLOCK_SIZE);
+		libdrbcc_sg_merge(drbcc, &changed);
+		libdrbcc_sg_write(drbcc, 1, changed);
+	}
+
+	if ((drbcc->sgSeg >= drbcc->sgCount) && (drbcc->sgPending == 0))
+	{
+		snprintf(s, sizeof(s), "Flash write done, %u segments, %u blocks erased, %u blocks read back",
+			drbcc->sgCount, drbcc->sgErased, drbcc->sgReadBack);
+		libdrbcc_sg_end(drbcc, s, 1);
+	}
+}
+
+void libdrbcc_sg_read_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t* data)
+{
+	unsigned int offset = addr - drbcc->sgBlock * DRBCC_BLOCK_SIZE;
+	uint32_t changed;
+	int erase;
+
+	if (!drbcc->sgReading || (offset + len > DRBCC_BLOCK_SIZE))
+	{
+		return;
+	}
+	memcpy(&drbcc->sgBuf[offset], data, len);
+	drbcc->sgRead += len;
+	if (drbcc->sgRead < DRBCC_BLOCK_SIZE)
+	{
+		return;
+	}
+
+	drbcc->sgReading = 0;
+	erase = libdrbcc_sg_merge(drbcc, &changed);
+	libdrbcc_sg_write(drbcc, erase, changed);
+	libdrbcc_sg_next(drbcc);
+}
+
+void libdrbcc_sg_write_cb(DRBCC_t *drbcc, unsigned addr, unsigned len, uint8_t result)
+{
+	(void) len;
+	if (drbcc->sgSegs == NULL)
+	{
+		return;
+	}
+	if (!result)
+	{
+		TRACE_WARN("writing flash address 0x%06x failed", addr);
+		libdrbcc_sg_end(drbcc, "Flash write failed, write error", 0);
+		return;
+	}
+	if (drbcc->sgPending)
+	{
+		drbcc->sgPending--;
+	}
+	libdrbcc_sg_next(drbcc);
+}
+
+DRBCC_RC_t drbcc_flash_write_sg(DRBCC_HANDLE_t h, DRBCC_SESSION_t *session, const DRBCC_FLASH_SEGMENT_t segs[], unsigned count)
+{
+	unsigned int i;
+	unsigned int size;
+	DRBCC_t *drbcc = h;
+	CHECK_HANDLE(drbcc);
+
+	if (drbcc->read_flash_cb || drbcc->erase_flash_cb || drbcc->write_flash_cb)
+	{
+		return DRBCC_RC_CBREGISTERED;
+	}
+
+	if (drbcc->session)
+	{
+		return DRBCC_RC_SESSIONACTIVE;
+	}
+
+	if ((segs == NULL) || (count == 0))
+	{
+		return DRBCC_RC_UNSPEC_ERROR;
+	}
+
+	drbcc->sgSegs = malloc(count * sizeof(DRBCC_FLASH_SEGMENT_t));
+	drbcc->sgBuf = malloc(DRBCC_BLOCK_SIZE);
+	if ((drbcc->sgSegs == NULL) || (drbcc->sgBuf == NULL))
+	{
+		free(drbcc->sgSegs);
+		drbcc->sgSegs = NULL;
+		free(drbcc->sgBuf);
+		drbcc->sgBuf = NULL;
+		return DRBCC_RC_OUTOFMEMORY;
+	}
+	memcpy(drbcc->sgSegs, segs, count * sizeof(DRBCC_FLASH_SEGMENT_t));
+	qsort(drbcc->sgSegs, count, sizeof(DRBCC_FLASH_SEGMENT_t), libdrbcc_sg_compare);
+
+	// segments inside the flash, not overlapping
+	size = libdrbcc_flash_blocks(drbcc) * DRBCC_BLOCK_SIZE;
+	for (i = 0; i < count; i++)
+	{
+		const DRBCC_FLASH_SEGMENT_t *seg = &drbcc->sgSegs[i];
+
+		if ((seg->data == NULL) || (seg->len == 0) || (seg->addr >= size) || (seg->len > size - seg->addr) ||
+			((i + 1 < count) && (seg->addr + seg->len > drbcc->sgSegs[i + 1].addr)))
+		{
+			free(drbcc->sgSegs);
+			drbcc->sgSegs = NULL;
+			free(drbcc->sgBuf);
+			drbcc->sgBuf = NULL;
+			return DRBCC_RC_UNSPEC_ERROR;
+		}
+	}
+
+	drbcc->sgCount = count;
+	drbcc->sgSeg = 0;
+	drbcc->sgBlock = 0;
+	drbcc->sgPending = 0;
+	drbcc->sgReading = 0;
+	drbcc->sgErased = 0;
+	drbcc->sgReadBack = 0;
+
+	if (drbcc->sgSegs[0].addr < DRBCC_LOG_FIRSTBLOCK * DRBCC_BLOCK_SIZE)
+	{
+		// partition table or its journal is overwritten
+		libdrbcc_invalidate_partition(drbcc);
+	}
+
+	drbcc->session = drbcc_session++;
+	*session = drbcc->session;
+	drbcc->state = DRBCC_STATE_WRITE_SG;
+	libdrbcc_sg_next(drbcc);
+	return DRBCC_RC_NOERROR;
+}
+
+/* Editor hints for emacs
+*
+* Local Variables:
+* mode:c
+* c-basic-offset:4
+* indent-tabs-mode:t
+* tab-width:4
+* End:
+* 
+* NO CODE BELOW THIS! */
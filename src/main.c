@@ -19,6 +19,7 @@
  */
 
 
+#define _GNU_SOURCE /* glibc2 needs this for strptime and timegm */
 #include "dvmon.h"
 
 #if HAVE_CONFIG_H
@@ -33,9 +34,9 @@
 #include <libgen.h>
 #include <termios.h>
 #include <unistd.h>
-#define _XOPEN_SOURCE /* glibc2 needs this */
 #include <time.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <stdint.h>
@@ -46,6 +47,8 @@
 
 #include <drbcc.h>
 #include <drbcc_files.h>
+#include <drbcc_image.h>
+#include <drbcc_log.h>
 
 #ifdef HAVE_LIBDRTRACE
 #include <drhiptrace.h>
@@ -78,19 +81,50 @@ typedef enum {
 	cmdid_getstatus,
 	cmdid_flashid,
 	cmdid_wflash,
+	cmdid_wsegments,
 	cmdid_rflash,
+	cmdid_rbuffer,
 	cmdid_eflash,
 	cmdid_gfile,
 	cmdid_gfiletype,
 	cmdid_pfile,
 	cmdid_pfiletype,
+	cmdid_pdiff,
+	cmdid_gstream,
+	cmdid_pstream,
 	cmdid_dfile,
 	cmdid_dfiletype,
+	cmdid_tbegin,
+	cmdid_tput,
+	cmdid_tdelete,
+	cmdid_tcommit,
+	cmdid_tabort,
+	cmdid_compact,
+	cmdid_journal,
+	cmdid_ptformat,
+	cmdid_ckpt,
+	cmdid_ckresume,
+	cmdid_fbackup,
+	cmdid_frestore,
+	cmdid_fprogram,
+	cmdid_mkimage,
 	cmdid_blupl,
 	cmdid_fwupl,
+	cmdid_fwupd,
 	cmdid_blupd,
 	cmdid_fwinv,
 	cmdid_restart,
+	cmdid_getlogsince,
+	cmdid_getlogrev,
+	cmdid_logfilter,
+	cmdid_logstat,
+	cmdid_logseek,
+	cmdid_logarchive,
+	cmdid_logfollow,
+	cmdid_logfind,
+	cmdid_logmirror,
+	cmdid_logquery,
+	cmdid_logdump,
 	cmdid_getlog,
 	cmdid_putlog,
 	cmdid_getpos,
@@ -130,19 +164,56 @@ const cmd_t s_cmds[] =
 	{ cmdid_getiddata,	"getid",				sizeof("getid")-1,		"get id data" },
 	{ cmdid_flashid,	"flashid",				sizeof("fla")-1,		"request FLASHID info" },
 	{ cmdid_rflash,		"rflash A,L[,F]",		sizeof("rfl")-1,		"read L bytes from flash address A into file F or hexdump to stdout" },
+	{ cmdid_rbuffer,	"rbuffer A,L[,F]",		sizeof("rb")-1,			"like rflash, but read into one buffer and output it at the end" },
 	{ cmdid_wflash,		"wflash A,L,F",			sizeof("wfl")-1,		"write L bytes from file F into flash address A" },
+	{ cmdid_wsegments,	"wsegments A,F ...",	sizeof("ws")-1,			"write files F to flash addresses A, erasing only the blocks needed and keeping the rest of partially written blocks" },
 	{ cmdid_eflash,		"eflash N",				sizeof("efl")-1,		"erase 4k flash block N (range depends on flash type)" },
 	{ cmdid_gfile,		"getfile E,F",			sizeof("getfi")-1,		"write data from index E to local file F" },
 	{ cmdid_gfiletype,	"gfiletype X,F",		sizeof("gfilet")-1,		"write data from file X(0xTI, type T with sub-number I) to local file F" },
 	{ cmdid_pfile,		"putfile I,T,F",		sizeof("putfi")-1,		"write data from local file F as type T with sub-number I" },
 	{ cmdid_pfiletype,	"pfiletype X,F",		sizeof("pfilet")-1,		"write data from local file F as file X(0xTI, type T with sub-number I)" },
+	{ cmdid_pdiff,		"pdiff I,T,F",			sizeof("pd")-1,			"like putfile, but rewrite only changed blocks of a file with the same size" },
+	{ cmdid_gstream,	"gstream X,F",			sizeof("gst")-1,		"like gfiletype, but write the data in order to F opened once (e.g. a pipe)" },
+	{ cmdid_pstream,	"pstream I,T,L,F",		sizeof("ps")-1,			"like putfile, but write L bytes read in order from F opened once (e.g. a pipe)" },
 	{ cmdid_dfile,		"delfile E",			sizeof("delfi")-1,		"delete file at index E" },
 	{ cmdid_dfiletype,	"dfiletype X",			sizeof("dfilet")-1,		"delete file X(0xTI, type T with sub-number I)" },
+	{ cmdid_tbegin,		"tbegin",				sizeof("tb")-1,			"begin a file transaction" },
+	{ cmdid_tput,		"tput I,T,F",			sizeof("tp")-1,			"add write of local file F as type T with sub-number I to the file transaction" },
+	{ cmdid_tdelete,	"tdelete X",			sizeof("td")-1,			"add delete of file X(0xTI, type T with sub-number I) to the file transaction" },
+	{ cmdid_tcommit,	"tcommit",				sizeof("tc")-1,			"write all files of the file transaction and update the partition table once" },
+	{ cmdid_tabort,		"tabort",				sizeof("ta")-1,			"discard the file transaction" },
+	{ cmdid_compact,	"compact",				sizeof("comp")-1,		"move files in flash to close gaps between them" },
+	{ cmdid_journal,	"journal I",			sizeof("jo")-1,			"journal partition table updates in flash blocks 2-3 I (0|1)" },
+	{ cmdid_ptformat,	"ptformat V",			sizeof("pt")-1,			"write the partition table in format V (1: 20 entries, 2: 64 entries, 0: keep)" },
+	{ cmdid_ckpt,		"ckpt [C]",				sizeof("ckp")-1,		"write checkpoints of getfile/putfile to file C, no C: off" },
+	{ cmdid_ckresume,	"ckresume C,F",			sizeof("ckr")-1,		"continue the getfile/putfile of checkpoint file C with local file F" },
+	{ cmdid_fbackup,	"fbackup F",			sizeof("fb")-1,			"write the whole flash to sparse image file F" },
+	{ cmdid_frestore,	"frestore F[,E]",		sizeof("fr")-1,			"write sparse image file F to flash, changed blocks only, E (0|1) erase blocks empty in F (default 0)" },
+	{ cmdid_fprogram,	"fprogram F[,E]",		sizeof("fp")-1,			"program image file F sequentially without comparing and verify it, E like frestore" },
+	{ cmdid_mkimage,	"mkimage F[,N] I,T,G ...",	sizeof("mk")-1,		"build image file F of a flash with N 4k blocks (default 1024) from local files G as type T with sub-number I" },
 	{ cmdid_blupl,		"blupload F",			sizeof("blupl")-1,		"upload new bootloader from file F" },
 	{ cmdid_fwupl,		"fwupload F",			sizeof("fwupl")-1,		"upload new firmware from file F" },
 	{ cmdid_blupd,		"blupdate",				sizeof("blupd")-1,		"update bootloader" },
+	{ cmdid_fwupd,		"fwupdate R,F[,B]",		sizeof("fwupd")-1,		"upload firmware F (and bootloader B), verify, invalidate and restart,\n"
+									"\t\t\tR (0|1) restart immediately and wait for the new firmware (default: restart when host power is off)" },
 	{ cmdid_fwinv,		"fwinv",				sizeof("fwi")-1,		"invalidate firmware" },
 	{ cmdid_restart,	"restart",				sizeof("re")-1,			"restart board controller when host power is off" },
+	{ cmdid_getlogsince,	"getlogsince C[,R[,F]]",	sizeof("getlogs")-1,	"get ring log entries appended since the last call with cursor file C, R and F like getlog" },
+	{ cmdid_getlogrev,	"getlogrev [N[,R[,F]]]",	sizeof("getlogr")-1,	"get the last N (default: all) ring log entries, newest first, R and F like getlog" },
+	{ cmdid_logfilter,	"logfilter [M[,F,T[,E]]]",	sizeof("logfil")-1,	"pass only log entries with events in bit mask M (0: all) from time F to T (seconds since 1970, 0: no limit)\n"
+									"\t\t\tof RTC epoch E and later to getlog, getlogsince and getlogrev, no arguments: all entries" },
+	{ cmdid_logstat,	"logstat [N[,S]]",		sizeof("logst")-1,		"print statistics of the ring log entries passing logfilter, N like getlog I (default: all),\n"
+									"\t\t\tS bit mask of the statistics (1: events, 2: power loss, 4: voltages, 8: temperatures, 16: hours, default: all)" },
+	{ cmdid_logseek,	"logseek N,T",			sizeof("logs")-1,		"get N (0: all) ring log entries from time T (YYYY-MM-DD HH:MM:SS) on, found by binary search" },
+	{ cmdid_logarchive,	"logarchive F[,N[,D]]",	sizeof("loga")-1,		"write all ring log entries to binary archive file F with an index entry every N records (default 256),\n"
+									"\t\t\tfrom the ring log dump D (see logdump) instead of the board controller if given" },
+	{ cmdid_logfollow,	"logfollow [I[,R[,F]]]",	sizeof("logfo")-1,	"get ring log entries as they are written until interrupted, polling at least every I ms\n"
+									"\t\t\t(default 1000), R and F like getlog" },
+	{ cmdid_logfind,	"logfind F,N[,T]",		sizeof("logf")-1,		"print N (0: all) entries of archive file F from time T (YYYY-MM-DD HH:MM:SS, default: first entry)" },
+	{ cmdid_logmirror,	"logmirror F",			sizeof("logm")-1,		"append the ring log entries added since the last call to mirror file F" },
+	{ cmdid_logquery,	"logquery F[,M[,F,T[,E]]]",	sizeof("logq")-1,	"print the entries of mirror file F, M, F, T and E like logfilter" },
+	{ cmdid_logdump,	"logdump F[,T]",		sizeof("logd")-1,		"decode the ring log dump F (rflash of the log area or whole flash, flash backup image)\n"
+									"\t\t\tT: decoder threads (default: one per CPU)" },
 	{ cmdid_getlog,		"getlog [[I][,R[,F]]]",	sizeof("getl")-1,		"get flash log\n"
 									"\t\t\tI>=0: from log entry I to last\n"
 									"\t\t\t I<0: last I entries\n"
@@ -203,6 +274,10 @@ typedef struct
 	int raw; // 0=no additional raw output, 1=additional raw output
 } context_t;
 static context_t s_context;
+static DRBCC_LOG_CURSOR_t s_logcursor;
+static DRBCC_LOG_ARCHIVE_t *s_archive = NULL;	// archive of logarchive
+static DRBCC_LOG_AGGREGATE_t s_aggregate;			// statistics of logstat
+static int s_aggregating = 0;
 
 typedef struct
 {
@@ -216,6 +291,12 @@ typedef struct
 static DRBCC_thread_context_t s_drbcc_thread_context = { 0, 0, 0, 0, 0, 0 };
 
 static tracelevel_t s_tracelevel = 0;
+
+static int s_imagefd = -1;	// file of fbackup/frestore/gstream/pstream
+static uint8_t *s_readbuf = NULL;	// buffer of rbuffer
+#define MAX_SEGMENTS 16
+static DRBCC_FLASH_SEGMENT_t s_segs[MAX_SEGMENTS];	// data of wsegments
+static unsigned int s_segcount = 0;
  
 tracelevel_t tracelevel()
 {
@@ -352,6 +433,8 @@ static void error_cb(void *context, char* msg)
 	fprintf(stderr, "error_cb: %s\n", msg);
 }
 
+static void flash_read_cb(void *context, unsigned addr, unsigned len, uint8_t* data);
+static void print_log_aggregate(FILE *fp, const DRBCC_LOG_AGGREGATE_t *agg);
 
 static void session_cb(void *context, DRBCC_SESSION_t session, int SUCCEEDED)
 {
@@ -364,6 +447,39 @@ static void session_cb(void *context, DRBCC_SESSION_t session, int SUCCEEDED)
 	{
 		TRACE(TL_DEBUG, "session_cb: %i failed", session);
 	}
+	if (s_imagefd >= 0)
+	{
+		close(s_imagefd);
+		s_imagefd = -1;
+	}
+	while (s_segcount)
+	{
+		free((uint8_t*)s_segs[--s_segcount].data);
+	}
+	if (s_archive)
+	{
+		if (DRBCC_RC_NOERROR != drbcc_log_archive_close(s_archive))
+		{
+			TRACE(TL_INFO, "write log archive failed");
+		}
+		s_archive = NULL;
+	}
+	if (s_aggregating)
+	{
+		if (SUCCEEDED)
+		{
+			print_log_aggregate(stdout, &s_aggregate);
+		}
+		s_aggregating = 0;
+	}
+	if (s_readbuf)
+	{
+		unsigned count = 0;
+		drbcc_flash_read_count(s_drbcc_thread_context.h, &count);
+		flash_read_cb(&s_context, s_context.readoffset, count, s_readbuf);
+		free(s_readbuf);
+		s_readbuf = NULL;
+	}
 	session_stop(&s_drbcc_thread_context);
 }
 
@@ -441,129 +557,210 @@ static void rtc_cb(void *context, const struct tm* utctime, int epoch)
 	}
 }
 
-static void getlog_cb(void *context, int pos, int len, uint8_t data[])
+// names of DRBCC_VOLTAGE_ID_t in log output
+static const char *s_voltage_names[] =
 {
-	context_t* c = (context_t*)context;
-	FILE *fp;
-	int filecloseflag = 0;
+	"PFLT", "PCAP", "PCAM", "VKEY", "SCAP", "12V", "5V", "VDD", "1V8", "1V2", "1V0", "3V3D", "1V5", "TERM", "VBAT"
+};
 
-	if (c->flashread_filename[0] != '\0')
+// short names of DRBCC_Power_Loss_t in logstat output
+static const char *s_power_loss_names[DRBCC_LOG_AGG_REASONS] =
+{
+	"VKEY_TOOLOW", "VKEY_EJCT_LOW", "VKEY_LOCK", "VKEY_RUN", "HOST", "MAIN", "PREALERT", "SUPERCAP", "unknown"
+};
+
+static void print_log_aggregate(FILE *fp, const DRBCC_LOG_AGGREGATE_t *agg)
+{
+	unsigned int i;
+	struct tm tm;
+	char from[32] = "-";
+	char to[32] = "-";
+
+	if (agg->first != (time_t) -1)
 	{
-		// write output to file
-		fp = fopen(c->flashread_filename, "a");
-		if (fp != NULL)
+		strftime(from, sizeof(from), "%Y-%m-%d %H:%M:%S", gmtime_r(&agg->first, &tm));
+		strftime(to, sizeof(to), "%Y-%m-%d %H:%M:%S", gmtime_r(&agg->last, &tm));
+	}
+	fprintf(fp, "entries: %lu from %s to %s\n", agg->entries, from, to);
+	for (i = 0; i < sizeof(agg->events) / sizeof(agg->events[0]); i++)
+	{
+		if (agg->events[i])
 		{
-			filecloseflag = 1; // we need to close fd at end of callback
-/*
-			if (-1 == lseek(fp, 0, SEEK_END))
-			{
-				TRACE(TL_INFO, "lseek to END in file %s failed", c->flashread_filename);
-				fclose(fp);
-				fp = stdout; // use stdout instead for output
-			}
-			else
-			{
-				TRACE(TL_INFO, "lseek to END in file %s succeeded", c->flashread_filename);
-				filecloseflag = 1; // we need to close fd at end of callback
-			}
-*/
+			fprintf(fp, "event 0x%02X: %lu\n", i, agg->events[i]);
+		}
+	}
+	for (i = 0; i < DRBCC_LOG_AGG_REASONS; i++)
+	{
+		if (agg->powerLoss[i])
+		{
+			fprintf(fp, "power loss %s: %lu\n", s_power_loss_names[i], agg->powerLoss[i]);
+		}
+	}
+	for (i = 0; i < DRBCC_LOG_AGG_VOLTAGES; i++)
+	{
+		if (agg->voltage[i].count == 0)
+		{
+			continue;
+		}
+		if (i < sizeof(s_voltage_names) / sizeof(s_voltage_names[0]))
+		{
+			fprintf(fp, "voltage %s: ", s_voltage_names[i]);
 		}
 		else
 		{
-			TRACE(TL_INFO, "open file %s for writing flash content failed", c->flashread_filename);
-			fp = stdout; // use stdout instead for output
+			fprintf(fp, "voltage 0x%02X: ", i);
 		}
+		fprintf(fp, "%lu values, min %d.%02d V, max %d.%02d V\n", agg->voltage[i].count,
+			agg->voltage[i].min / 100, abs(agg->voltage[i].min % 100), agg->voltage[i].max / 100, abs(agg->voltage[i].max % 100));
 	}
-	else
+	if (agg->temp.count)
 	{
-		fp = stdout;
+		fprintf(fp, "temperature events: %lu, min %d C, max %d C\n", agg->temp.count, agg->temp.min, agg->temp.max);
 	}
-
-	// hexdump to stdout or file
-	int i;
-//		char timestr[256];
-//		memset(timestr, 0, sizeof(timestr));
-//		strftime(timestr, sizeof(timestr)-1, "%Y-%m-%d %H:%M:%S", utctime);
-	fprintf(fp, "log %6d: ", pos);
-
-	if ((data[0] != DRBCC_E_EXTENSION) && (data[0] != DRBCC_E_EMPTY)) // no timestamp for extension data and empty entries
+	if (agg->select & DRBCC_LOG_AGG_HOURS)
 	{
-		fprintf(fp, "20%02X-%02X-%02X %02X:%02X:%02X (epoch %u): ", data[7], data[6], data[5], data[3], data[2], data[1], data[4]);
+		fprintf(fp, "entries per hour:");
+		for (i = 0; i < 24; i++)
+		{
+			fprintf(fp, " %lu", agg->hours[i]);
+		}
+		fprintf(fp, "\n");
 	}
+}
 
-	switch(data[0])
+static void print_power_state(FILE *fp, const DRBCC_LOG_ENTRY_t *e, const char *key, const char *dcdc, const char *lock)
+{
+	switch (e->u.power.state)
 	{
-		case DRBCC_E_EXTENSION: // indicates that this log entry is a data extension of a previous log entry, it contains no timestamp
-			fprintf(fp, "Extension data");
+		case DRBCC_P_UNKNOWN: // power state unknown (just initialized after reset)
+			fprintf(fp, "UNKNOWN");
 			break;
 
-		case DRBCC_E_RAMLOG_OVERRUN: //  overrun occured in RAM logging
-			fprintf(fp, "Ramlog overrun");
+		case DRBCC_P_LITHIUM_POWER: // neither standby nor key power present (lithium powered)
+			fprintf(fp, "LI_BATT");
 			break;
 
-		case DRBCC_E_ILL_BID: // illegal board revision ID detected
-			fprintf(fp, "Illegal board ID: 0x%02X", data[9]);
+		case DRBCC_P_KEY_POWER: // VKey activated, VKey-Bypass-FET closed (/VKEY_FET)
+			fprintf(fp, "KEY_PWR");
 			break;
 
-		case DRBCC_E_ILL_PWR_STATE: // illegal power state
-			fprintf(fp, "Illegal power state: ");
-			switch (data[9] & DRBCC_P_MAIN_STATE_MASK)
-			{
-				case DRBCC_P_UNKNOWN: // power state unknown (just initialized after reset)
-					fprintf(fp, "UNKNOWN");
-					break;
+		case DRBCC_P_STANDBY_POWER: // StandBy voltage present, standby-bypass-FET closed (/STBY_FET)
+			fprintf(fp, "STANDBY");
+			break;
 
-				case DRBCC_P_LITHIUM_POWER: // neither standby nor key power present (lithium powered)
-					fprintf(fp, "LI_BATT");
-					break;
+		case DRBCC_P_HOST_POWERED: // host application powered (PWR_EN)
+			fprintf(fp, "HOST_ON");
+			break;
 
-				case DRBCC_P_KEY_POWER: // VKey activated, VKey-Bypass-FET closed (/VKEY_FET)
-					fprintf(fp, "KEY_PWR");
-					break;
+		default:
+			fprintf(fp, "unknown (%d)", e->u.power.state);
+			break;
+	}
 
-				case DRBCC_P_STANDBY_POWER: // StandBy voltage present, standby-bypass-FET closed (/STBY_FET)
-					fprintf(fp, "STANDBY");
-					break;
+	if (e->u.power.options & DRBCC_P_OPT_KEY_POWER_ENABLED) // VKey activated (VKEY_PWR_EN)
+	{
+		fprintf(fp, "%s", key);
+	}
 
-				case DRBCC_P_HOST_POWERED: // host application powered (PWR_EN)
-					fprintf(fp, "HOST_ON");
-					break;
+	if (e->u.power.options & DRBCC_P_OPT_EXTENDED_PWR) // additional chips activated (/3V3S_EN)
+	{
+		fprintf(fp, "|EXT_PWR");
+	}
 
-				default:
-					fprintf(fp, "unknown (%d)", data[9] & DRBCC_P_MAIN_STATE_MASK);
-					break;
-			}
+	if (e->u.power.options & DRBCC_P_OPT_DCDC_PWR) // Recom DC-DC converter activated (/DCDC_EN)
+	{
+		fprintf(fp, "%s", dcdc);
+	}
 
-			if (data[9] & DRBCC_P_OPT_KEY_POWER_ENABLED) // VKey activated (VKEY_PWR_EN)
-			{
-				fprintf(fp, "|KEY_BAT");
-			}
+	if (e->u.power.options & DRBCC_P_OPT_HDD_PWR) // HDD activated (HDD_PWR_EN)
+	{
+		fprintf(fp, "|HDD_PWR");
+	}
 
-			if (data[9] & DRBCC_P_OPT_EXTENDED_PWR) // additional chips activated (/3V3S_EN)
-			{
-				fprintf(fp, "|EXT_PWR");
-			}
+	if (e->u.power.options & DRBCC_P_OPT_LOCK_CHG) // enable the HDD lock charger (also necessary for P_KEY_POWER and P_OPT_KEY_POWER_ENABLED)
+	{
+		fprintf(fp, "%s", lock);
+	}
+}
 
-			if (data[9] & DRBCC_P_OPT_DCDC_PWR) // Recom DC-DC converter activated (/DCDC_EN)
-			{
-				fprintf(fp, "|DCDC_ON");
-			}
+static void print_token(FILE *fp, const DRBCC_LOG_ENTRY_t *e, const char *ttu, const char *key)
+{
+	if (DRBCC_KEY_CMD0_TTU_EJECT == e->u.token.cmd)
+	{
+		fprintf(fp, "%s, retries: %d", ttu, e->u.token.retries);
+	}
+	else
+	{
+		fprintf(fp, "%s, Token bits:", key);
+		if (e->u.token.cmd & DRBCC_KEY_CMD0_MASK_EJECT)   fprintf(fp, " EJECT");
+		if (e->u.token.cmd & DRBCC_KEY_CMD0_MASK_CLEAR)   fprintf(fp, " CLEAR");
+		if (e->u.token.cmd & DRBCC_KEY_CMD0_MASK_ADAPT)   fprintf(fp, " ADAPT");
+		if (e->u.token.cmd & DRBCC_KEY_CMD0_MASK_NOCOMP)  fprintf(fp, " NOCOMP");
+		if (e->u.token.cmd & DRBCC_KEY_CMD0_MASK_EXPDATE) fprintf(fp, " EXPIRES");
+		fprintf(fp, " Code: %02X%02X%02X-%02X, retries: %d", e->u.token.code[0], e->u.token.code[1], e->u.token.code[2],
+		        e->u.token.code[3], e->u.token.retries);
+	}
+}
 
-			if (data[9] & DRBCC_P_OPT_HDD_PWR) // HDD activated (HDD_PWR_EN)
-			{
-				fprintf(fp, "|HDD_PWR");
-			}
+// timestamp of a raw log entry in valid BCD digits with 24h clock
+static int log_time_is_bcd(const uint8_t data[])
+{
+	static const uint8_t max[7] = { 0x59, 0x59, 0x23, 0xFF, 0x31, 0x12, 0x99 };	// sec, min, hour, epoch, date, month, year
+	int i;
 
-			if (data[9] & DRBCC_P_OPT_LOCK_CHG) // enable the HDD lock charger (also necessary for P_KEY_POWER and P_OPT_KEY_POWER_ENABLED)
-			{
-				fprintf(fp, "|MAG_CHG");
-			}
+	for (i = 0; i < 7; i++)
+	{
+		if ((i != 3) && (((data[1 + i] & 0x0F) > 9) || (data[1 + i] > max[i])))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// raw: the entry as read from flash or NULL, its timestamp is printed as stored if it is no valid BCD time
+static void print_log_entry(FILE *fp, const DRBCC_LOG_ENTRY_t *e, const uint8_t *raw)
+{
+	int i;
+
+	fprintf(fp, "log %6d: ", e->pos);
 
+	if ((e->event != DRBCC_E_EXTENSION) && (e->event != DRBCC_E_EMPTY)) // no timestamp for extension data and empty entries
+	{
+		if (raw && !log_time_is_bcd(raw))
+		{
+			// e.g. invalid entries made by AVR programmer, 12h clock mode
+			fprintf(fp, "20%02X-%02X-%02X %02X:%02X:%02X (epoch %u): ", raw[7], raw[6], raw[5], raw[3], raw[2], raw[1], raw[4]);
+		}
+		else
+		{
+			fprintf(fp, "%04d-%02d-%02d %02d:%02d:%02d (epoch %u): ", e->tm.tm_year + 1900, e->tm.tm_mon + 1, e->tm.tm_mday,
+			        e->tm.tm_hour, e->tm.tm_min, e->tm.tm_sec, e->epoch);
+		}
+	}
+
+	switch(e->event)
+	{
+		case DRBCC_E_EXTENSION: // indicates that this log entry is a data extension of a previous log entry, it contains no timestamp
+			fprintf(fp, "Extension data");
+			break;
+
+		case DRBCC_E_RAMLOG_OVERRUN: //  overrun occured in RAM logging
+			fprintf(fp, "Ramlog overrun");
+			break;
+
+		case DRBCC_E_ILL_BID: // illegal board revision ID detected
+			fprintf(fp, "Illegal board ID: 0x%02X", e->u.code);
+			break;
+
+		case DRBCC_E_ILL_PWR_STATE: // illegal power state
+			fprintf(fp, "Illegal power state: ");
+			print_power_state(fp, e, "|KEY_BAT", "|DCDC_ON", "|MAG_CHG");
 			break;
 
 		case DRBCC_E_PWR_LOSS: // power loss
 			fprintf(fp, "Power loss, reason: ");
-			switch(data[9])
+			switch(e->u.code)
 			{
 				case DRBCC_PWR_LOSS_VKEY_TOOLOW:
 				case DRBCC_PWR_LOSS_VKEY_EJCT_LOW:
@@ -589,7 +786,7 @@ static void getlog_cb(void *context, int pos, int len, uint8_t data[])
 					break;
 
 				default:
-					fprintf(fp, "unknown (0x%02X) ", data[9]);
+					fprintf(fp, "unknown (0x%02X) ", e->u.code);
 					break;
 			}
 			break;
@@ -600,58 +797,7 @@ static void getlog_cb(void *context, int pos, int len, uint8_t data[])
 
 		case DRBCC_E_PWR_CHNG: // power state changed
 			fprintf(fp, "Power state: ");
-			switch (data[9] & DRBCC_P_MAIN_STATE_MASK)
-			{
-				case DRBCC_P_UNKNOWN: // power state unknown (just initialized after reset)
-					fprintf(fp, "UNKNOWN");
-					break;
-
-				case DRBCC_P_LITHIUM_POWER: // neither standby nor key power present (lithium powered)
-					fprintf(fp, "LI_BATT");
-					break;
-
-				case DRBCC_P_KEY_POWER: // VKey activated, VKey-Bypass-FET closed (/VKEY_FET)
-					fprintf(fp, "KEY_PWR");
-					break;
-
-				case DRBCC_P_STANDBY_POWER: // StandBy voltage present, standby-bypass-FET closed (/STBY_FET)
-					fprintf(fp, "STANDBY");
-					break;
-
-				case DRBCC_P_HOST_POWERED: // host application powered (PWR_EN)
-					fprintf(fp, "HOST_ON");
-					break;
-
-				default:
-					fprintf(fp, "unknown (%d)", data[9] & DRBCC_P_MAIN_STATE_MASK);
-					break;
-			}
-
-			if (data[9] & DRBCC_P_OPT_KEY_POWER_ENABLED) // VKey activated (VKEY_PWR_EN)
-			{
-				fprintf(fp, "|KEY_BATT");
-			}
-
-			if (data[9] & DRBCC_P_OPT_EXTENDED_PWR) // additional chips activated (/3V3S_EN)
-			{
-				fprintf(fp, "|EXT_PWR");
-			}
-
-			if (data[9] & DRBCC_P_OPT_DCDC_PWR) // Recom DC-DC converter activated (/DCDC_EN)
-			{
-				fprintf(fp, "|DCDC_PWR");
-			}
-
-			if (data[9] & DRBCC_P_OPT_HDD_PWR) // HDD activated (HDD_PWR_EN)
-			{
-				fprintf(fp, "|HDD_PWR");
-			}
-
-			if (data[9] & DRBCC_P_OPT_LOCK_CHG) // enable the HDD lock charger (also necessary for P_KEY_POWER and P_OPT_KEY_POWER_ENABLED)
-			{
-				fprintf(fp, "|LOCK_CHG");
-			}
-
+			print_power_state(fp, e, "|KEY_BATT", "|DCDC_PWR", "|LOCK_CHG");
 			break;
 
 		case DRBCC_E_ILL_INT: // unknown interrupt occured (woke us from power down)
@@ -659,73 +805,48 @@ static void getlog_cb(void *context, int pos, int len, uint8_t data[])
 			break;
 
 		case DRBCC_E_HDD_CHNG: // state of HDD sensor changed
-			fprintf(fp, "HDD %s", (data[9] != 0) ? "inserted" : "removed ");
+			fprintf(fp, "HDD %s", (e->u.code != 0) ? "inserted" : "removed ");
 			break;
 
 		case DRBCC_E_KEY_DETECTED: // key was detected, param: key eeprom code (7 byte)
 			fprintf(fp, "HD-Key detected, ID: ");
-			for (i = 9; i < 16; i++)
+			for (i = 0; i < 7; i++)
 			{
-				fprintf(fp, "%02X ", data[i]);
+				fprintf(fp, "%02X ", e->u.key[i]);
 			}
 			break;
 
 		case DRBCC_E_KEY_REJECTED: // key was rejected, no applicable token was found, param: number of tokens (1 byte)
-			fprintf(fp, "HD-Key rejected, %d token parsed", data[9]);
+			fprintf(fp, "HD-Key rejected, %d token parsed", e->u.code);
 			break;
 
 		case DRBCC_E_KEY_SUCCESS: // key was successfully processed, param: begin of token (6 byte) + number of eject retries (1 byte)
-			if (DRBCC_KEY_CMD0_TTU_EJECT == data[9])
-			{
-				fprintf(fp, "TTU HD eject success, retries: %d", data[15]);
-			}
-			else
-			{
-				fprintf(fp, "HD-Key success, Token bits:");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_EJECT)   fprintf(fp, " EJECT");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_CLEAR)   fprintf(fp, " CLEAR");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_ADAPT)   fprintf(fp, " ADAPT");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_NOCOMP)  fprintf(fp, " NOCOMP");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_EXPDATE) fprintf(fp, " EXPIRES");
-				fprintf(fp, " Code: %02X%02X%02X-%02X, retries: %d", data[11], data[12], data[13], data[14], data[15]);
-			}
+			print_token(fp, e, "TTU HD eject success", "HD-Key success");
 			break;
 
 		case DRBCC_E_UNLOCK_ERROR: // hdd unlock failed, param: begin of token (6 byte) + number of eject retries (1 byte)
-			if (DRBCC_KEY_CMD0_TTU_EJECT == data[9])
-			{
-				fprintf(fp, "TTU HD eject failed, retries: %d", data[15]);
-			}
-			else
-			{
-				fprintf(fp, "HD-Key unlock failed, Token bits:");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_EJECT)   fprintf(fp, " EJECT");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_CLEAR)   fprintf(fp, " CLEAR");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_ADAPT)   fprintf(fp, " ADAPT");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_NOCOMP)  fprintf(fp, " NOCOMP");
-				if (data[9] & DRBCC_KEY_CMD0_MASK_EXPDATE) fprintf(fp, " EXPIRES");
-				fprintf(fp, " Code: %02X%02X%02X-%02X, retries: %d", data[11], data[12], data[13], data[14], data[15]);
-			}
+			print_token(fp, e, "TTU HD eject failed", "HD-Key unlock failed");
 			break;
 
 		case DRBCC_E_KEY_COMM_ERROR: // key handling failed: invalid key eeprom code,  param: key eeprom code (7 byte)
 			fprintf(fp, "HD-Key communication error, ID: ");
-			for (i = 9; i < 16; i++)
+			for (i = 0; i < 7; i++)
 			{
-				fprintf(fp, "%02X ", data[i]);
+				fprintf(fp, "%02X ", e->u.key[i]);
 			}
 			break;
 
 		case DRBCC_E_KEY_HEADER_ERROR: // key handling failed: error in key header data, param: begin of key header data (4 byte)
-			fprintf(fp, "HD-Key header error, header data: 0x%02X 0x%02X 0x%02X 0x%02X ", data[9], data[10], data[11], data[12]);
+			fprintf(fp, "HD-Key header error, header data: 0x%02X 0x%02X 0x%02X 0x%02X ", e->u.key[0], e->u.key[1], e->u.key[2], e->u.key[3]);
 			break;
 
 		case DRBCC_E_RTC_SET: // RTC willbe set to new time (caused epoch change); timestamp is old time, param: new time
-			fprintf(fp, "RTC set to 20%02X-%02X-%02X %02X:%02X:%02X", data[15], data[14], data[13], data[11], data[10], data[9]);
+			fprintf(fp, "RTC set to %04d-%02d-%02d %02d:%02d:%02d", e->u.rtc.tm.tm_year + 1900, e->u.rtc.tm.tm_mon + 1, e->u.rtc.tm.tm_mday,
+			        e->u.rtc.tm.tm_hour, e->u.rtc.tm.tm_min, e->u.rtc.tm.tm_sec);
 			break;
 
 		case DRBCC_E_COMM_TIMEOUT: // HOST Communication Heartbeat timeout
-			switch (data[9])
+			switch (e->u.code)
 			{
 				case DRBCC_TIMEOUT_FIRST_MESSAGE:
 					fprintf(fp, "HOST First message timeout");
@@ -740,94 +861,29 @@ static void getlog_cb(void *context, int pos, int len, uint8_t data[])
 					break;
 
 				default:
-					fprintf(fp, "HOST Communication timeout 0x%02X", data[9]);
+					fprintf(fp, "HOST Communication timeout 0x%02X", e->u.code);
 					break;
 			}
 			break;
 
 		case DRBCC_E_VOLTAGE_INFO: // List of internal voltage values; param: one or more pairs of voltage ID (1 byte enum) and value in 10mV (2 byte int signed)
 			{
-				unsigned int len = data[8];
-				unsigned int pos = 9;
-				uint16_t h;
-				int16_t x;
+				unsigned int n;
 				float v;
 
 				fprintf(fp, "Voltage data: ");
-				while (len >= 3)
+				for (n = 0; n < e->u.voltage.count; n++)
 				{
-					switch (data[pos])
+					if (e->u.voltage.id[n] < sizeof(s_voltage_names) / sizeof(s_voltage_names[0]))
 					{
-						case DRBCC_VID_POWER_FILTER: // power filter input voltage
-							fprintf(fp, "PFLT=");
-							break;
-
-						case DRBCC_VID_POWER_CAP: // power capacitor input voltage
-							fprintf(fp, "PCAP=");
-							break;
-
-						case DRBCC_VID_PWR_CAM: // camera power terminal voltage
-							fprintf(fp, "PCAM=");
-							break;
-
-						case DRBCC_VID_VKEY: // vkey step up supply voltage
-							fprintf(fp, "VKEY=");
-							break;
-
-						case DRBCC_VID_SUPERCAP: // HDD supply supercap voltage
-							fprintf(fp, "SCAP=");
-							break;
-
-						case DRBCC_VID_12V: // 12V camera power supply voltage
-							fprintf(fp, "12V=");
-							break;
-
-						case DRBCC_VID_5V: // 5V supply voltage
-							fprintf(fp, "5V=");
-							break;
-
-						case DRBCC_VID_VDD: // switched 3.3V supply voltage
-							fprintf(fp, "VDD=");
-							break;
-
-						case DRBCC_VID_1V8: // 1.8V supply voltage
-							fprintf(fp, "1V8=");
-							break;
-
-						case DRBCC_VID_1V2: // 1.2V supply voltage
-							fprintf(fp, "1V2=");
-							break;
-
-						case DRBCC_VID_1V: // 1.0V supply voltage
-							fprintf(fp, "1V0=");
-							break;
-
-						case DRBCC_VID_3V3D: // 3.3V BCTRL supply voltage
-							fprintf(fp, "3V3D=");
-							break;
-
-						case DRBCC_VID_1V5: // 1.5V supply voltage (new with hidav)
-							fprintf(fp, "1V5=");
-							break;
-
-						case DRBCC_VID_TERM: // DRAM term power voltage (new with hidav)
-							fprintf(fp, "TERM=");
-							break;
-
-						case DRBCC_VID_VBAT: // Li-Batt Voltage (remembered value from when last running on battery)
-							fprintf(fp, "VBAT=");
-							break;
-
-						default: // unknown voltage ID
-							fprintf(fp, "VID%d=", data[pos]);
-							break;
+						fprintf(fp, "%s=", s_voltage_names[e->u.voltage.id[n]]);
+					}
+					else // unknown voltage ID
+					{
+						fprintf(fp, "VID%d=", e->u.voltage.id[n]);
 					}
-					h = 256 * data[pos+1] + data[pos+2];
-					x = (int16_t)h;
-					v = x;
+					v = e->u.voltage.value[n];
 					fprintf(fp, "%.2fV ", v/100);
-					pos += 3;
-					len -= 3;
 				}
 			}
 			break;
@@ -841,56 +897,107 @@ static void getlog_cb(void *context, int pos, int len, uint8_t data[])
 			break;
 
 		case DRBCC_E_FW_UPDATE: // firmware update performed , Param: result: 0=error 1=ok
-			fprintf(fp, "BCTRL firmware update %s", (data[9] != 0) ? "successful":"failed");
+			fprintf(fp, "BCTRL firmware update %s", (e->u.code != 0) ? "successful":"failed");
 			break;
 
 		case DRBCC_E_BL_UPDATE: // bootloader update performed, Param: result: 0=error 1=ok
-			fprintf(fp, "BCTRL bootloader update %s", (data[9] != 0) ? "successful":"failed");
+			fprintf(fp, "BCTRL bootloader update %s", (e->u.code != 0) ? "successful":"failed");
 			break;
 
 		case DRBCC_E_FW_REBOOT: // firmware reboot (e.g. in order to do a fw update) initiated, Param: 1= with 0=without SRAM context reset
-			fprintf(fp, "Forced firmware reboot %s SRAM context reset", (data[9] != 0) ? "with":"without");
+			fprintf(fp, "Forced firmware reboot %s SRAM context reset", (e->u.code != 0) ? "with":"without");
 			break;
 
 		case DRBCC_E_OVERTEMP_OFF: // emergency turn off: hard high temperature limit exceeded, Param: temp (int8)
-			fprintf(fp, "Overtemperature turn off at %d deg C", (int8_t)data[9]);
+			fprintf(fp, "Overtemperature turn off at %d deg C", e->u.temp.temp);
 			break;
 
 		case DRBCC_E_TEMPLIMIT: // could not turn on because of temp outside safe limits, Param: temp , lower limit, upper limit, reset limit (alle int8)
 			fprintf(fp, "Could not turn on: temp %d deg C not between %d and %d, reset below %d",
-			        (int8_t)data[9], (int8_t)data[10], (int8_t)data[11], (int8_t)data[12]);
+			        e->u.temp.temp, e->u.temp.low, e->u.temp.high, e->u.temp.reset);
 			break;
 
 		case DRBCC_E_ACCEL_EVENT:      // acceleration sensor event, Params: Event type (byte), accel data (6 byte: xx, yy, zz)
 			{
-				uint16_t h;
 				int16_t x,y,z;
 				float fx, fy, fz;
 				float accel;
 
-				h = data[11] * 256 + data[10];
-				x = (int16_t)h; fx = x; fx *= 1000; fx /= 256; x = (int16_t)fx;
-				h = data[13] * 256 + data[12];
-				y = (int16_t)h; fy = y; fy *= 1000; fy /= 256; y = (int16_t)fy;
-				h = data[15] * 256 + data[14];
-				z = (int16_t)h; fz = z; fz *= 1000; fz /= 256; z = (int16_t)fz;
+				x = e->u.accel.x; fx = x; fx *= 1000; fx /= 256; x = (int16_t)fx;
+				y = e->u.accel.y; fy = y; fy *= 1000; fy /= 256; y = (int16_t)fy;
+				z = e->u.accel.z; fz = z; fz *= 1000; fz /= 256; z = (int16_t)fz;
 
 				accel = sqrt(fx*fx + fy*fy + fz*fz)/1000;
 
 				fprintf(fp, "Accel event type %d: %s, %.2fg, (xyz: %d,%d,%d mg)",
-				        data[9], (data[9] == DRBCC_ACCEL_EVENT_THRESHOLD_HIGH) ? "THRESHOLD_HIGH" : "UNKNOWN",
+				        e->u.accel.type, (e->u.accel.type == DRBCC_ACCEL_EVENT_THRESHOLD_HIGH) ? "THRESHOLD_HIGH" : "UNKNOWN",
 				        accel, x, y, z);
 			}
 			break;
 
-		case 0xff:
+		case DRBCC_E_EMPTY:
 			fprintf(fp, "EMPTY LOGENTRY");
 			break;
 
 		default:
-			fprintf(fp, "UNKNOWN LOGENTRY 0x%02X", data[0]);
+			fprintf(fp, "UNKNOWN LOGENTRY 0x%02X", e->event);
 			break;
 	}
+}
+
+static void getlog_cb(void *context, int pos, int len, uint8_t data[])
+{
+	context_t* c = (context_t*)context;
+	FILE *fp;
+	int filecloseflag = 0;
+	int i;
+	DRBCC_LOG_ENTRY_t e;
+
+	drbcc_log_decode(pos, len, data, &e);
+	if (s_archive != NULL)
+	{
+		// logarchive: no text output
+		if (DRBCC_RC_NOERROR != drbcc_log_archive_add(s_archive, &e))
+		{
+			TRACE(TL_INFO, "write to log archive failed at entry %d", pos);
+		}
+		return;
+	}
+
+	if (c->flashread_filename[0] != '\0')
+	{
+		// write output to file
+		fp = fopen(c->flashread_filename, "a");
+		if (fp != NULL)
+		{
+			filecloseflag = 1; // we need to close fd at end of callback
+/*
+			if (-1 == lseek(fp, 0, SEEK_END))
+			{
+				TRACE(TL_INFO, "lseek to END in file %s failed", c->flashread_filename);
+				fclose(fp);
+				fp = stdout; // use stdout instead for output
+			}
+			else
+			{
+				TRACE(TL_INFO, "lseek to END in file %s succeeded", c->flashread_filename);
+				filecloseflag = 1; // we need to close fd at end of callback
+			}
+*/
+		}
+		else
+		{
+			TRACE(TL_INFO, "open file %s for writing flash content failed", c->flashread_filename);
+			fp = stdout; // use stdout instead for output
+		}
+	}
+	else
+	{
+		fp = stdout;
+	}
+
+	// hexdump to stdout or file
+	print_log_entry(fp, &e, data);
 
 	// raw data dump
 	if (c->raw != 0)
@@ -1074,9 +1181,29 @@ static void progress_cb(void *context, int cur, int max)
 	fprintf(stdout, "progress_cb: current=%i of %i\n", cur, max);
 }
 
-static int get_command(DRBCC_thread_context_t *drbcc_thread, const char **line, cmdid_t* cmd)
+static void update_cb(void *context, DRBCC_UPDATE_PHASE_t phase, unsigned long ms)
+{
+	UNUSED(context);
+	fprintf(stdout, "update_cb: phase=%i done in %lu ms\n", phase, ms);
+}
+
+static cmdid_t find_command(const char *line)
+{
+	unsigned i = 0;
+
+	while(s_cmds[i].id != cmdid_unknown)
+	{
+		if(0 == strncasecmp(line, s_cmds[i].cmdtext, s_cmds[i].matchlen))
+		{
+			return s_cmds[i].id;
+		}
+		i++;
+	}
+	return cmdid_unknown;
+}
+
+static int get_command(DRBCC_thread_context_t *drbcc_thread, const char **line, cmdid_t* cmd)
 {
-	unsigned i = 0;
 
 	if(0 == drbcc_thread->current_line)
 	{
@@ -1100,15 +1227,7 @@ static int get_command(DRBCC_thread_context_t *drbcc_thread, const char **line,
 		drbcc_thread->line_valid = 0;
 		*line = drbcc_thread->current_line;
 		TRACE(TL_DEBUG, "get_command() got cmd: %s.", *line);
-		while(s_cmds[i].id != cmdid_unknown)
-		{
-			if(0 == strncasecmp(*line, s_cmds[i].cmdtext, s_cmds[i].matchlen))
-			{
-				*cmd = s_cmds[i].id;
-				break;
-			}
-			i++;
-		}
+		*cmd = find_command(*line);
 		return 1;
 	}
 	return 0;
@@ -1211,225 +1330,943 @@ static void process_cmd_getiddata(DRBCC_HANDLE_t h, DRBCC_thread_context_t * drb
 	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
 }
 
-static void process_cmd_setrtc(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread,  const char* line)
+static void process_cmd_setrtc(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread,  const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+	char* timestr = NULL;
+	struct tm t;
+
+	timestr = strchr(line, ' ');
+	if(timestr)
+	{
+		time_t bigbang = 0; // defaults
+		gmtime_r(&bigbang, &t);
+		strptime(timestr + 1, "%Y-%m-%d %H:%M:%S", &t);
+	}
+	else
+	{
+		time_t now = time(NULL);
+		gmtime_r(&now, &t);
+	}
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_set_rtc, (h, &session,  &t));
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static void process_cmd_rflash(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int addr = (unsigned int)-1;
+	unsigned int len = 0;
+	s_context.flashread_filename[0] = '\0';
+	gettimeofday(&(s_context.tm_flashread_request), NULL);
+
+	if(2 >  sscanf(line, "%*s%i,%i,%s", &addr, &len, s_context.flashread_filename))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		register_flash_cbs(h);
+		s_context.readoffset = addr;
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_req_flash_read, (h, &session, addr, len));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_rbuffer(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int addr = (unsigned int)-1;
+	unsigned int len = 0;
+	s_context.flashread_filename[0] = '\0';
+	gettimeofday(&(s_context.tm_flashread_request), NULL);
+
+	if(2 >  sscanf(line, "%*s%i,%i,%s", &addr, &len, s_context.flashread_filename) || len == 0)
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else if(NULL == (s_readbuf = (uint8_t*)malloc(len)))
+	{
+		TRACE(TL_INFO, "out of memory");
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		s_context.readoffset = addr;
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_flash_read_into, (h, &session, addr, len, s_readbuf));
+		if(rc != DRBCC_RC_NOERROR)
+		{
+			free(s_readbuf);
+			s_readbuf = NULL;
+			session_stop(drbcc_thread);
+		}
+	}
+}
+
+static void process_cmd_wflash(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int addr = (unsigned int)-1;
+	ssize_t len = 0;
+	char file[FILENAME_MAX] = "";
+	sscanf(line, "%*s%i,%zi,%s", &addr, &len, file);
+	if(3 != sscanf(line, "%*s%i,%zi,%s", &addr, &len, file))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		uint8_t* buf = (uint8_t*)malloc(len);
+		if(buf)
+		{
+			int fd = open(file, O_RDONLY | OX_BINARY);
+			memset(buf, 0xFF, len);
+			if(fd != -1)
+			{
+				if(len == read(fd, buf, len))
+				{
+					register_flash_cbs(h);
+					session_start(drbcc_thread);
+					CHECKCALL(TL_DEBUG, rc, drbcc_req_flash_write, (h, &session, addr, len, buf));
+					if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+				}
+				else
+				{
+					TRACE(TL_INFO, "reading flash data from file %s failed", file);
+					drbcc_sema_release(drbcc_thread->sema);
+				}
+				close(fd);
+			}
+			else
+			{
+				TRACE(TL_INFO, "open file %s for reading flash content failed", file);
+				drbcc_sema_release(drbcc_thread->sema);
+			}
+			free(buf);
+		}
+	}
+}
+
+static void process_cmd_wsegments(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char buf[1024];
+	char file[FILENAME_MAX];
+	unsigned int addr;
+	char *arg, *save;
+	int ok = 1;
+
+	strncpy(buf, line, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	strtok_r(buf, " ", &save);
+	while(ok && (arg = strtok_r(NULL, " ", &save)) != NULL)
+	{
+		struct stat st;
+		uint8_t *data = NULL;
+		int fd = -1;
+
+		if(s_segcount >= MAX_SEGMENTS || 2 != sscanf(arg, "%i,%s", &addr, file))
+		{
+			TRACE(TL_INFO, "command syntax problem: %s", arg);
+			ok = 0;
+		}
+		else if(0 > (fd = open(file, O_RDONLY | OX_BINARY)) || 0 != fstat(fd, &st) || st.st_size == 0 ||
+			NULL == (data = (uint8_t*)malloc(st.st_size)) || st.st_size != read(fd, data, st.st_size))
+		{
+			TRACE(TL_INFO, "reading flash data from file %s failed", file);
+			free(data);
+			ok = 0;
+		}
+		else
+		{
+			s_segs[s_segcount].addr = addr;
+			s_segs[s_segcount].data = data;
+			s_segs[s_segcount].len = st.st_size;
+			s_segcount++;
+		}
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+	}
+
+	if(ok && s_segcount)
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_flash_write_sg, (h, &session, s_segs, s_segcount));
+		if(rc == DRBCC_RC_NOERROR)
+		{
+			return;
+		}
+		session_stop(drbcc_thread);
+	}
+	else
+	{
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	while(s_segcount)
+	{
+		free((uint8_t*)s_segs[--s_segcount].data);
+	}
+}
+
+static void process_cmd_eflash(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int block = (unsigned int)-1;
+	if(1 != sscanf(line, "%*s%i", &block))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		register_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_req_flash_erase_block, (h, &session, block));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_gfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int index = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(2 != sscanf(line, "%*s%u,%s", &index, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_get_file, (h, &session, index, path));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_gfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int index = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(2 != sscanf(line, "%*s%i,%s", &index, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_get_file_type, (h, &session, index, path));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_glog(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+	int entries = 1000000; // default all
+
+	s_context.raw = 0; // default: no raw output
+	s_context.flashread_filename[0] = '\0'; // default: output to stdout
+
+	if(0 == sscanf(line, "%*s %d,%d,%s", &entries, &s_context.raw, s_context.flashread_filename))
+	{
+		sscanf(line, "%*s ,%d,%s", &s_context.raw, s_context.flashread_filename);
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	//CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 1, &start, &end));	// ring log with start stop time
+	//CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 0, NULL, NULL));	// persistent log
+	CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 1, entries));	// ring log
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static void process_cmd_glogsince(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char ckpt[FILENAME_MAX] = "";
+	s_context.raw = 0; // default: no raw output
+	s_context.flashread_filename[0] = '\0'; // default: output to stdout
+
+	if(1 > sscanf(line, "%*s %[^,],%d,%s", ckpt, &s_context.raw, s_context.flashread_filename))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	if(DRBCC_RC_NOERROR != drbcc_load_log_cursor(ckpt, &s_logcursor))
+	{
+		// no cursor yet: all entries
+		memset(&s_logcursor, 0, sizeof(s_logcursor));
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_get_log_since, (h, &session, &s_logcursor, ckpt));
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static void process_cmd_glogrev(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+	int entries = 0; // default all
+
+	s_context.raw = 0; // default: no raw output
+	s_context.flashread_filename[0] = '\0'; // default: output to stdout
+
+	if(0 == sscanf(line, "%*s %d,%d,%s", &entries, &s_context.raw, s_context.flashread_filename))
+	{
+		sscanf(line, "%*s ,%d,%s", &s_context.raw, s_context.flashread_filename);
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_get_log_reverse, (h, &session, entries));
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static void process_cmd_logfollow(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+	unsigned int interval = 0; // default DRBCC_LOG_FOLLOW_INTERVAL
+
+	s_context.raw = 0; // default: no raw output
+	s_context.flashread_filename[0] = '\0'; // default: output to stdout
+
+	if(0 == sscanf(line, "%*s %u,%d,%s", &interval, &s_context.raw, s_context.flashread_filename))
+	{
+		sscanf(line, "%*s ,%d,%s", &s_context.raw, s_context.flashread_filename);
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_follow, (h, &session, NULL, NULL, interval));	// entries from now on to getlog_cb
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static void process_cmd_logstat(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+	int entries = 1000000; // default all
+	unsigned int select = DRBCC_LOG_AGG_ALL;
+
+	if(0 == sscanf(line, "%*s %d,%i", &entries, &select))
+	{
+		sscanf(line, "%*s ,%i", &select);
+	}
+	drbcc_log_aggregate_init(&s_aggregate, select);
+	s_aggregating = 1;
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_aggregate, (h, &session, &s_aggregate, entries));
+	if(rc != DRBCC_RC_NOERROR)
+	{
+		s_aggregating = 0;
+		session_stop(drbcc_thread);
+	}
+}
+
+static void process_cmd_logseek(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char timestr[64] = "";
+	int entries = 0;
+	struct tm t;
+
+	s_context.raw = 0; // no raw output
+	s_context.flashread_filename[0] = '\0'; // output to stdout
+
+	memset(&t, 0, sizeof(t));
+	if((2 != sscanf(line, "%*s %d,%63[^\n]", &entries, timestr)) || (NULL == strptime(timestr, "%Y-%m-%d %H:%M:%S", &t)))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_seek_time, (h, &session, timegm(&t), entries));	// log timestamps are RTC times without time zone
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static int logarchive_cb(void *context, const DRBCC_LOG_ENTRY_t *entry)
+{
+	if (DRBCC_RC_NOERROR != drbcc_log_archive_add((DRBCC_LOG_ARCHIVE_t *)context, entry))
+	{
+		TRACE(TL_INFO, "write to log archive failed at entry %d", entry->pos);
+		return 0;
+	}
+	return 1;
+}
+
+// h is not used with a dump file
+static void process_cmd_logarchive(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char path[FILENAME_MAX] = "";
+	char dump[FILENAME_MAX] = "";
+	unsigned int interval = 0;
+
+	if(1 > sscanf(line, "%*s %[^,],%u,%s", path, &interval, dump))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	if(NULL == (s_archive = drbcc_log_archive_create(path, interval)))
+	{
+		TRACE(TL_INFO, "can't open %s", path);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	if(dump[0] != '\0')
+	{
+		// no board controller needed
+		CHECKCALL(TL_DEBUG, rc, drbcc_log_decode_file, (dump, 0, logarchive_cb, s_archive));
+		if(DRBCC_RC_NOERROR != drbcc_log_archive_close(s_archive))
+		{
+			TRACE(TL_INFO, "write log archive failed");
+		}
+		s_archive = NULL;
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 1, 0));	// all ring log entries
+	if(rc != DRBCC_RC_NOERROR)
+	{
+		drbcc_log_archive_close(s_archive);
+		s_archive = NULL;
+		session_stop(drbcc_thread);
+	}
+}
+
+static void process_cmd_logfind(DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char path[FILENAME_MAX] = "";
+	char timestr[64] = "";
+	unsigned int count = 0;
+	unsigned int i, n;
+	time_t from = 0;
+	DRBCC_LOG_ARCHIVE_VIEW_t view;
+	DRBCC_LOG_ENTRY_t e;
+
+	if(2 > sscanf(line, "%*s %[^,],%u,%63[^\n]", path, &count, timestr))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	if(timestr[0] != '\0')
+	{
+		struct tm t;
+
+		memset(&t, 0, sizeof(t));
+		if(NULL == strptime(timestr, "%Y-%m-%d %H:%M:%S", &t))
+		{
+			TRACE(TL_INFO, "command syntax problem: %s", timestr);
+			drbcc_sema_release(drbcc_thread->sema);
+			return;
+		}
+		from = timegm(&t);	// log timestamps are RTC times without time zone
+	}
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_archive_open, (path, &view));
+	if(rc == DRBCC_RC_NOERROR)
+	{
+		i = (timestr[0] != '\0') ? drbcc_log_archive_find(&view, from) : 0;
+		for(n = 0; (i < view.count) && ((count == 0) || (n < count)); i++, n++)
+		{
+			drbcc_log_record_decode(&view.records[i], &e);
+			print_log_entry(stdout, &e, NULL);
+			fprintf(stdout, "\n");
+		}
+		drbcc_log_archive_unmap(&view);
+	}
+	drbcc_sema_release(drbcc_thread->sema);
+}
+
+static void process_cmd_logmirror(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char path[FILENAME_MAX] = "";
+	if(1 != sscanf(line, "%*s%s", path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	unregister_flash_cbs(h);
+	session_start(drbcc_thread);
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_mirror_sync, (h, &session, path));
+	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+}
+
+static int logquery_cb(void *context, const DRBCC_LOG_ENTRY_t *entry)
+{
+	print_log_entry((FILE *)context, entry, NULL);
+	fprintf((FILE *)context, "\n");
+	return 1;
+}
+
+static void process_cmd_logquery(DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char path[FILENAME_MAX] = "";
+	DRBCC_LOG_FILTER_t filter;
+	unsigned int events = 0;
+	long from = 0;
+	long to = 0;
+	int n;
+
+	memset(&filter, 0, sizeof(filter));
+	n = sscanf(line, "%*s %[^,],%i,%ld,%ld,%u", path, &events, &from, &to, &filter.minEpoch);
+	if((n < 1) || (n == 3))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	filter.events = events;
+	filter.from = from;
+	filter.to = to;
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_mirror_query, (path, &filter, logquery_cb, stdout));
+	drbcc_sema_release(drbcc_thread->sema);
+}
+
+static void process_cmd_logdump(DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	char path[FILENAME_MAX] = "";
+	unsigned int threads = 0;
+
+	if(1 > sscanf(line, "%*s %[^,],%u", path, &threads))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	CHECKCALL(TL_DEBUG, rc, drbcc_log_decode_file, (path, threads, logquery_cb, stdout));
+	drbcc_sema_release(drbcc_thread->sema);
+}
+
+static void process_cmd_pdiff(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int index = (unsigned int)-1;
+	unsigned int type = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(3 != sscanf(line, "%*s%u,%u,%s", &index, &type, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_put_file_diff, (h, &session, index, type, path));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_gstream(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int type = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(2 != sscanf(line, "%*s%i,%s", &type, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else if(0 > (s_imagefd = open(path, O_WRONLY | O_CREAT | O_TRUNC | OX_BINARY, 0666)))
+	{
+		TRACE(TL_INFO, "can't open %s", path);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_get_file_fd, (h, &session, type | 0x80000000, s_imagefd));
+		if(rc != DRBCC_RC_NOERROR)
+		{
+			close(s_imagefd);
+			s_imagefd = -1;
+			session_stop(drbcc_thread);
+		}
+	}
+}
+
+static void process_cmd_pstream(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int index = (unsigned int)-1;
+	unsigned int type = (unsigned int)-1;
+	unsigned int length = 0;
+	char path[FILENAME_MAX] = "";
+	if(4 != sscanf(line, "%*s%u,%u,%u,%s", &index, &type, &length, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else if(0 > (s_imagefd = open(path, O_RDONLY | OX_BINARY)))
+	{
+		TRACE(TL_INFO, "can't open %s", path);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_put_file_fd, (h, &session, index, type, s_imagefd, length));
+		if(rc != DRBCC_RC_NOERROR)
+		{
+			close(s_imagefd);
+			s_imagefd = -1;
+			session_stop(drbcc_thread);
+		}
+	}
+}
+static void process_cmd_pfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int index = (unsigned int)-1;
+	unsigned int type = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(3 != sscanf(line, "%*s%u,%u,%s", &index, &type, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_put_file, (h, &session, index, type, path));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_pfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int type = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(2 != sscanf(line, "%*s%i,%s", &type, path))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_put_file_type, (h, &session, type, path));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_dfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	unsigned int index = (unsigned int)-1;
+	if(1 != sscanf(line, "%*s%u", &index))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_delete_file, (h, &session, index));
+		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	}
+}
+
+static void process_cmd_tput(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
-	char* timestr = NULL;
-	struct tm t;
 
-	timestr = strchr(line, ' ');
-	if(timestr)
+	unsigned int index = (unsigned int)-1;
+	unsigned int type = (unsigned int)-1;
+	char path[FILENAME_MAX] = "";
+	if(3 != sscanf(line, "%*s%u,%u,%s", &index, &type, path))
 	{
-		time_t bigbang = 0; // defaults
-		gmtime_r(&bigbang, &t);
-		strptime(timestr + 1, "%Y-%m-%d %H:%M:%S", &t);
+		TRACE(TL_INFO, "command syntax problem: %s", line);
 	}
 	else
 	{
-		time_t now = time(NULL);
-		gmtime_r(&now, &t);
+		CHECKCALL(TL_DEBUG, rc, drbcc_files_put, (h, index, type, path));
 	}
-	session_start(drbcc_thread);
-	CHECKCALL(TL_DEBUG, rc, drbcc_set_rtc, (h, &session,  &t));
-	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+	drbcc_sema_release(drbcc_thread->sema);
 }
-
-static void process_cmd_rflash(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_tdelete(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int addr = (unsigned int)-1;
-	unsigned int len = 0;
-	s_context.flashread_filename[0] = '\0';
-	gettimeofday(&(s_context.tm_flashread_request), NULL);
-
-	if(2 >  sscanf(line, "%*s%i,%i,%s", &addr, &len, s_context.flashread_filename))
+	unsigned int index = (unsigned int)-1;
+	if(1 != sscanf(line, "%*s%i", &index))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
-		drbcc_sema_release(drbcc_thread->sema);
 	}
 	else
 	{
-		register_flash_cbs(h);
-		s_context.readoffset = addr;
-		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_req_flash_read, (h, &session, addr, len));
-		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+		CHECKCALL(TL_DEBUG, rc, drbcc_files_delete, (h, index));
 	}
+	drbcc_sema_release(drbcc_thread->sema);
 }
-
-static void process_cmd_wflash(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_journal(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int addr = (unsigned int)-1;
-	ssize_t len = 0;
-	char file[FILENAME_MAX] = "";
-	sscanf(line, "%*s%i,%zi,%s", &addr, &len, file);
-	if(3 != sscanf(line, "%*s%i,%zi,%s", &addr, &len, file))
+	int on = 0;
+	if(1 != sscanf(line, "%*s%i", &on))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
-		drbcc_sema_release(drbcc_thread->sema);
 	}
 	else
 	{
-		uint8_t* buf = (uint8_t*)malloc(len);
-		if(buf)
-		{
-			int fd = open(file, O_RDONLY | OX_BINARY);
-			memset(buf, 0xFF, len);
-			if(fd != -1)
-			{
-				if(len == read(fd, buf, len))
-				{
-					register_flash_cbs(h);
-					session_start(drbcc_thread);
-					CHECKCALL(TL_DEBUG, rc, drbcc_req_flash_write, (h, &session, addr, len, buf));
-					if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
-				}
-				else
-				{
-					TRACE(TL_INFO, "reading flash data from file %s failed", file);
-					drbcc_sema_release(drbcc_thread->sema);
-				}
-				close(fd);
-			}
-			else
-			{
-				TRACE(TL_INFO, "open file %s for reading flash content failed", file);
-				drbcc_sema_release(drbcc_thread->sema);
-			}
-			free(buf);
-		}
+		CHECKCALL(TL_DEBUG, rc, drbcc_set_partition_journal, (h, on));
 	}
+	drbcc_sema_release(drbcc_thread->sema);
 }
-
-static void process_cmd_eflash(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_logfilter(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int block = (unsigned int)-1;
-	if(1 != sscanf(line, "%*s%i", &block))
+	DRBCC_LOG_FILTER_t filter;
+	unsigned int events = 0;
+	long from = 0;
+	long to = 0;
+
+	memset(&filter, 0, sizeof(filter));
+	if(2 == sscanf(line, "%*s%i,%ld", &events, &from))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	sscanf(line, "%*s%i,%ld,%ld,%u", &events, &from, &to, &filter.minEpoch);
+	filter.events = events;
+	filter.from = from;
+	filter.to = to;
+	CHECKCALL(TL_DEBUG, rc, drbcc_set_log_filter, (h, &filter));
+	drbcc_sema_release(drbcc_thread->sema);
+}
+static void process_cmd_ptformat(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+{
+	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
+
+	int version = 0;
+	if(1 != sscanf(line, "%*s%i", &version))
+	{
+		TRACE(TL_INFO, "command syntax problem: %s", line);
 	}
 	else
 	{
-		register_flash_cbs(h);
-		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_req_flash_erase_block, (h, &session, block));
-		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+		CHECKCALL(TL_DEBUG, rc, drbcc_set_partition_format, (h, version));
 	}
+	drbcc_sema_release(drbcc_thread->sema);
 }
-
-static void process_cmd_gfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_ckpt(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int index = (unsigned int)-1;
 	char path[FILENAME_MAX] = "";
-	if(2 != sscanf(line, "%*s%u,%s", &index, path))
+	if(1 != sscanf(line, "%*s%s", path))
 	{
-		TRACE(TL_INFO, "command syntax problem: %s", line);
-		drbcc_sema_release(drbcc_thread->sema);
+		CHECKCALL(TL_DEBUG, rc, drbcc_register_checkpoint, (h, NULL, NULL));
 	}
 	else
 	{
-		unregister_flash_cbs(h);
-		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_get_file, (h, &session, index, path));
-		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+		CHECKCALL(TL_DEBUG, rc, drbcc_register_checkpoint, (h, NULL, path));
 	}
+	drbcc_sema_release(drbcc_thread->sema);
 }
-
-static void process_cmd_gfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_ckresume(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int index = (unsigned int)-1;
+	DRBCC_CHECKPOINT_t cp;
+	char ckpt[FILENAME_MAX] = "";
 	char path[FILENAME_MAX] = "";
-	if(2 != sscanf(line, "%*s%i,%s", &index, path))
+	if(2 != sscanf(line, "%*s %[^,],%s", ckpt, path))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
 	}
+	else if(DRBCC_RC_NOERROR != (rc = drbcc_load_checkpoint(ckpt, &cp)))
+	{
+		TRACE(TL_INFO, "invalid checkpoint file %s: %s", ckpt, drbcc_get_error_string(rc));
+		drbcc_sema_release(drbcc_thread->sema);
+	}
 	else
 	{
 		unregister_flash_cbs(h);
 		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_get_file_type, (h, &session, index, path));
+		if(cp.direction)
+		{
+			CHECKCALL(TL_DEBUG, rc, drbcc_put_file_resume, (h, &session, &cp, path));
+		}
+		else
+		{
+			CHECKCALL(TL_DEBUG, rc, drbcc_get_file_resume, (h, &session, &cp, path));
+		}
 		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
 	}
 }
 
-static void process_cmd_glog(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_fbackup(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
-	int entries = 1000000; // default all
 
-	s_context.raw = 0; // default: no raw output
-	s_context.flashread_filename[0] = '\0'; // default: output to stdout
-
-	if(0 == sscanf(line, "%*s %d,%d,%s", &entries, &s_context.raw, s_context.flashread_filename))
+	char path[FILENAME_MAX] = "";
+	if(1 != sscanf(line, "%*s %s", path))
 	{
-		sscanf(line, "%*s ,%d,%s", &s_context.raw, s_context.flashread_filename);
+		TRACE(TL_INFO, "command syntax problem: %s", line);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else if(0 > (s_imagefd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)))
+	{
+		TRACE(TL_INFO, "can't open %s", path);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
+	else
+	{
+		unregister_flash_cbs(h);
+		session_start(drbcc_thread);
+		CHECKCALL(TL_DEBUG, rc, drbcc_flash_backup, (h, &session, s_imagefd));
+		if(rc != DRBCC_RC_NOERROR)
+		{
+			close(s_imagefd);
+			s_imagefd = -1;
+			session_stop(drbcc_thread);
+		}
 	}
-	unregister_flash_cbs(h);
-	session_start(drbcc_thread);
-	//CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 1, &start, &end));	// ring log with start stop time
-	//CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 0, NULL, NULL));	// persistent log
-	CHECKCALL(TL_DEBUG, rc, drbcc_get_log, (h, &session, 1, entries));	// ring log
-	if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
 }
 
-static void process_cmd_pfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_frestore(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line, unsigned int flags)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int index = (unsigned int)-1;
-	unsigned int type = (unsigned int)-1;
+	int erase = 0;
 	char path[FILENAME_MAX] = "";
-	if(3 != sscanf(line, "%*s%u,%u,%s", &index, &type, path))
+	if(1 > sscanf(line, "%*s %[^,],%d", path, &erase))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
 	}
+	else if(0 > (s_imagefd = open(path, O_RDONLY)))
+	{
+		TRACE(TL_INFO, "can't open %s", path);
+		drbcc_sema_release(drbcc_thread->sema);
+	}
 	else
 	{
 		unregister_flash_cbs(h);
 		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_put_file, (h, &session, index, type, path));
-		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+		CHECKCALL(TL_DEBUG, rc, drbcc_flash_restore, (h, &session, s_imagefd, flags | (erase ? DRBCC_RESTORE_ERASE_EMPTY : 0)));
+		if(rc != DRBCC_RC_NOERROR)
+		{
+			close(s_imagefd);
+			s_imagefd = -1;
+			session_stop(drbcc_thread);
+		}
 	}
 }
 
-static void process_cmd_pfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_mkimage(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int type = (unsigned int)-1;
+	DRBCC_IMAGE_FILE_t files[DRBCC_IMAGE_MAX_FILES];
+	char paths[DRBCC_IMAGE_MAX_FILES][FILENAME_MAX];
+	char buf[1024];
 	char path[FILENAME_MAX] = "";
-	if(2 != sscanf(line, "%*s%i,%s", &type, path))
+	unsigned int blocks = 0;
+	unsigned int count = 0;
+	unsigned int index, type;
+	char *arg, *save;
+	int fd;
+
+	strncpy(buf, line, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	strtok_r(buf, " ", &save);
+	arg = strtok_r(NULL, " ", &save);
+	if(!arg || 1 > sscanf(arg, "%[^,],%u", path, &blocks))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
+		return;
+	}
+	while((arg = strtok_r(NULL, " ", &save)) != NULL)
+	{
+		if(count >= DRBCC_IMAGE_MAX_FILES || 3 != sscanf(arg, "%u,%u,%s", &index, &type, paths[count]))
+		{
+			TRACE(TL_INFO, "command syntax problem: %s", arg);
+			drbcc_sema_release(drbcc_thread->sema);
+			return;
+		}
+		files[count].index = index;
+		files[count].type = type;
+		files[count].filename = paths[count];
+		count++;
+	}
+
+	if(0 > (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)))
+	{
+		TRACE(TL_INFO, "can't open %s", path);
 	}
 	else
 	{
-		unregister_flash_cbs(h);
-		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_put_file_type, (h, &session, type, path));
-		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+		CHECKCALL(TL_DEBUG, rc, drbcc_image_build, (h, fd, blocks, files, count));
+		close(fd);
+		if(rc == DRBCC_RC_NOERROR)
+		{
+			fprintf(stdout, "image %s with %u files written\n", path, count);
+		}
 	}
+	drbcc_sema_release(drbcc_thread->sema);
 }
-
-static void process_cmd_dfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_dfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
 	unsigned int index = (unsigned int)-1;
-	if(1 != sscanf(line, "%*s%u", &index))
+	if(1 != sscanf(line, "%*s%i", &index))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
@@ -1438,17 +2275,17 @@ static void process_cmd_dfile(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_th
 	{
 		unregister_flash_cbs(h);
 		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_delete_file, (h, &session, index));
+		CHECKCALL(TL_DEBUG, rc, drbcc_delete_file_type, (h, &session, index));
 		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
 	}
 }
 
-static void process_cmd_dfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_fwupl(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
-	unsigned int index = (unsigned int)-1;
-	if(1 != sscanf(line, "%*s%i", &index))
+	char fwpath[FILENAME_MAX] = "";
+	if(1 != sscanf(line, "%*s%s", fwpath))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
@@ -1457,17 +2294,19 @@ static void process_cmd_dfiletype(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbc
 	{
 		unregister_flash_cbs(h);
 		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_delete_file_type, (h, &session, index));
+		CHECKCALL(TL_DEBUG, rc, drbcc_upload_firmware, (h, &session, fwpath));
 		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
 	}
 }
 
-static void process_cmd_fwupl(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
+static void process_cmd_fwupd(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread, const char* line)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
 
+	int now = 0;
 	char fwpath[FILENAME_MAX] = "";
-	if(1 != sscanf(line, "%*s%s", fwpath))
+	char blpath[FILENAME_MAX] = "";
+	if((2 > sscanf(line, "%*s %d,%[^,],%s", &now, fwpath, blpath)) || (now < 0) || (now > 1))
 	{
 		TRACE(TL_INFO, "command syntax problem: %s", line);
 		drbcc_sema_release(drbcc_thread->sema);
@@ -1476,7 +2315,8 @@ static void process_cmd_fwupl(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_th
 	{
 		unregister_flash_cbs(h);
 		session_start(drbcc_thread);
-		CHECKCALL(TL_DEBUG, rc, drbcc_upload_firmware, (h, &session, fwpath));
+		CHECKCALL(TL_DEBUG, rc, drbcc_update_firmware, (h, &session, fwpath, blpath[0] ? blpath : NULL,
+			now ? DRBCC_UPDATE_RESTART_NOW : 0, update_cb));
 		if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
 	}
 }
@@ -1658,6 +2498,12 @@ static void process_input(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread
 			case cmdid_rflash:
 				process_cmd_rflash(h, drbcc_thread, line);
 				break;
+			case cmdid_rbuffer:
+				process_cmd_rbuffer(h, drbcc_thread, line);
+				break;
+			case cmdid_wsegments:
+				process_cmd_wsegments(h, drbcc_thread, line);
+				break;
 			case cmdid_wflash:
 				process_cmd_wflash(h, drbcc_thread, line);
 				break;
@@ -1676,18 +2522,83 @@ static void process_input(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread
 			case cmdid_pfiletype:
 				process_cmd_pfiletype(h, drbcc_thread, line);
 				break;
+			case cmdid_pdiff:
+				process_cmd_pdiff(h, drbcc_thread, line);
+				break;
+			case cmdid_gstream:
+				process_cmd_gstream(h, drbcc_thread, line);
+				break;
+			case cmdid_pstream:
+				process_cmd_pstream(h, drbcc_thread, line);
+				break;
 			case cmdid_dfile:
 				process_cmd_dfile(h, drbcc_thread, line);
 				break;
 			case cmdid_dfiletype:
 				process_cmd_dfiletype(h, drbcc_thread, line);
 				break;
+			case cmdid_tbegin:
+				CHECKCALL(TL_DEBUG, rc, drbcc_files_begin, (h));
+				drbcc_sema_release(drbcc_thread->sema);
+				break;
+			case cmdid_tput:
+				process_cmd_tput(h, drbcc_thread, line);
+				break;
+			case cmdid_tdelete:
+				process_cmd_tdelete(h, drbcc_thread, line);
+				break;
+			case cmdid_tcommit:
+				unregister_flash_cbs(h);
+				session_start(drbcc_thread);
+				CHECKCALL(TL_DEBUG, rc, drbcc_files_commit, (h, &session));
+				if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+				break;
+			case cmdid_tabort:
+				CHECKCALL(TL_DEBUG, rc, drbcc_files_abort, (h));
+				drbcc_sema_release(drbcc_thread->sema);
+				break;
+			case cmdid_logfilter:
+				process_cmd_logfilter(h, drbcc_thread, line);
+				break;
+			case cmdid_journal:
+				process_cmd_journal(h, drbcc_thread, line);
+				break;
+			case cmdid_ptformat:
+				process_cmd_ptformat(h, drbcc_thread, line);
+				break;
+			case cmdid_ckpt:
+				process_cmd_ckpt(h, drbcc_thread, line);
+				break;
+			case cmdid_ckresume:
+				process_cmd_ckresume(h, drbcc_thread, line);
+				break;
+			case cmdid_fbackup:
+				process_cmd_fbackup(h, drbcc_thread, line);
+				break;
+			case cmdid_frestore:
+				process_cmd_frestore(h, drbcc_thread, line, 0);
+				break;
+			case cmdid_fprogram:
+				process_cmd_frestore(h, drbcc_thread, line, DRBCC_RESTORE_PROGRAM | DRBCC_RESTORE_VERIFY);
+				break;
+			case cmdid_mkimage:
+				process_cmd_mkimage(h, drbcc_thread, line);
+				break;
+			case cmdid_compact:
+				unregister_flash_cbs(h);
+				session_start(drbcc_thread);
+				CHECKCALL(TL_DEBUG, rc, drbcc_compact_flash, (h, &session));
+				if(rc != DRBCC_RC_NOERROR) { session_stop(drbcc_thread); }
+				break;
 			case cmdid_blupl:
 				process_cmd_blupl(h, drbcc_thread, line);
 				break;
 			case cmdid_fwupl:
 				process_cmd_fwupl(h, drbcc_thread, line);
 				break;
+			case cmdid_fwupd:
+				process_cmd_fwupd(h, drbcc_thread, line);
+				break;
 			case cmdid_blupd:
 				session_start(drbcc_thread);
 				CHECKCALL(TL_DEBUG, rc, drbcc_request_bootloader_update, (h, &session));
@@ -1706,6 +2617,36 @@ static void process_input(DRBCC_HANDLE_t h, DRBCC_thread_context_t *drbcc_thread
 			case cmdid_getlog:
 				process_cmd_glog(h, drbcc_thread, line);
 				break;
+			case cmdid_getlogsince:
+				process_cmd_glogsince(h, drbcc_thread, line);
+				break;
+			case cmdid_getlogrev:
+				process_cmd_glogrev(h, drbcc_thread, line);
+				break;
+			case cmdid_logstat:
+				process_cmd_logstat(h, drbcc_thread, line);
+				break;
+			case cmdid_logseek:
+				process_cmd_logseek(h, drbcc_thread, line);
+				break;
+			case cmdid_logarchive:
+				process_cmd_logarchive(h, drbcc_thread, line);
+				break;
+			case cmdid_logfollow:
+				process_cmd_logfollow(h, drbcc_thread, line);
+				break;
+			case cmdid_logfind:
+				process_cmd_logfind(drbcc_thread, line);
+				break;
+			case cmdid_logmirror:
+				process_cmd_logmirror(h, drbcc_thread, line);
+				break;
+			case cmdid_logquery:
+				process_cmd_logquery(drbcc_thread, line);
+				break;
+			case cmdid_logdump:
+				process_cmd_logdump(drbcc_thread, line);
+				break;
 			case cmdid_putlog:
 			{
 				unsigned char data[256];
@@ -1816,6 +2757,45 @@ static void * drbcc_thread_main(void *arg)
 	return 0;
 }
 
+// run the command line without opening the device if it needs no board controller, 0: not run
+static int run_offline(const char *line)
+{
+	char dump[FILENAME_MAX] = "";
+	cmdid_t cmd = find_command(line);
+
+	if((cmd == cmdid_logarchive) && (1 != sscanf(line, "%*s %*[^,],%*u,%s", dump)))
+	{
+		// archive of the board controller log
+		return 0;
+	}
+	if((cmd != cmdid_logdump) && (cmd != cmdid_logquery) && (cmd != cmdid_logfind) && (cmd != cmdid_logarchive))
+	{
+		return 0;
+	}
+	if(1 != drbcc_sema_create(&s_drbcc_thread_context.sema))
+	{
+		TRACE(TL_INFO, "drbcc_sema_create failed.");
+		return 0;
+	}
+	switch(cmd)
+	{
+		case cmdid_logdump:
+			process_cmd_logdump(&s_drbcc_thread_context, line);
+			break;
+		case cmdid_logquery:
+			process_cmd_logquery(&s_drbcc_thread_context, line);
+			break;
+		case cmdid_logfind:
+			process_cmd_logfind(&s_drbcc_thread_context, line);
+			break;
+		default:
+			process_cmd_logarchive(NULL, &s_drbcc_thread_context, line);
+			break;
+	}
+	drbcc_sema_destroy(&s_drbcc_thread_context.sema);
+	return 1;
+}
+
 static DRBCC_RC_t run_connection(DRBCC_HANDLE_t h)
 {
 	DRBCC_RC_t rc = DRBCC_RC_NOERROR;
@@ -1825,6 +2805,11 @@ static DRBCC_RC_t run_connection(DRBCC_HANDLE_t h)
 	memset(&s_drbcc_thread_context, 0, sizeof(s_drbcc_thread_context));
 	s_drbcc_thread_context.current_line = empty_cmd_line;
 
+	if((strlen(s_cmd_line) >= 1) && run_offline(s_cmd_line))
+	{
+		// the device is not opened
+		return rc;
+	}
 	CHECKCALL(TL_DEBUG, rc, drbcc_start, (h, &s_context, s_dev, s_speed));
 	if(rc == DRBCC_RC_NOERROR)
 	{